@@ -5,16 +5,94 @@
 
 #define KILOBYTE (1024)
 #define MEGABYTE (1024 * KILOBYTE)
+#define GIGABYTE ((size_t)1024 * MEGABYTE)
+// NOTE: Enough for any SSE load and every scalar type
+#define ARENA_DEFAULT_ALIGNMENT 16
+// NOTE: Reserved arenas commit in steps of this, one huge page
+#define ARENA_COMMIT_GRANULARITY (2 * MEGABYTE)
 
+typedef enum {
+  ARENA_RESERVED = 1 << 0,
+  // NOTE: Transparent huge pages, advised on every committed range
+  ARENA_HUGE_PAGES = 1 << 1,
+  // NOTE: Pages from the hugetlbfs pool, falls back to transparent huge
+  // pages once the pool runs dry
+  ARENA_EXPLICIT_HUGE_PAGES = 1 << 2
+} ArenaFlags;
+
+#define ARENA_STATS_MAX_ARENAS 32
+#define ARENA_STATS_MAX_SITES 64
+#define ARENA_STATS_MAX_NAME 32
+
+// NOTE: Running totals of every allocation made from one source line
+typedef struct {
+  const char *file;
+  unsigned line;
+  size_t count;
+  size_t bytes;
+} ArenaSite;
+
+/* NOTE:
+ * Usage of one tagged arena, kept only when built with ARENA_STATS. `bytes`,
+ * `padding` and the sites count every allocation ever made, restores and
+ * resets included, `highWater` is the furthest `size` ever reached and so
+ * what the arena actually needed.
+ */
+typedef struct {
+  char name[ARENA_STATS_MAX_NAME];
+  size_t capacity;
+  size_t count;
+  size_t bytes;
+  size_t padding;
+  size_t highWater;
+  size_t failedCount;
+  unsigned siteCount;
+  // NOTE: The extra last entry pools the sites that found the table full
+  ArenaSite sites[ARENA_STATS_MAX_SITES + 1];
+} ArenaStats;
+
+/* NOTE:
+ * Bump allocator over one contiguous range. `sfArenaCreate` takes the range
+ * from the heap, `sfArenaReserve` only reserves address space and commits
+ * pages as `size` grows past `committed`, so a reserved arena can be sized
+ * generously and cost nothing until it is used.
+ */
 typedef struct {
   void *baseMemory;
   void *allocPosition;
   size_t size;
   size_t capacity;
+  size_t committed;
+  unsigned flags;
+  // NOTE: Set by `sfArenaTag`, shared by copies of the arena
+  ArenaStats *stats;
 } Arena;
 
+// NOTE: Arena position to return to with `sfArenaRestore`
+typedef struct {
+  size_t size;
+} ArenaMarker;
+
 Arena sfArenaCreate(size_t blockSize, unsigned blockCount);
+Arena sfArenaReserve(size_t capacity, unsigned flags);
 void *sfArenaAlloc(Arena *arena, size_t size);
+void *sfArenaAllocAligned(Arena *arena, size_t size, size_t alignment);
+void *sfArenaAllocAt(Arena *arena, size_t size, size_t alignment,
+                     const char *file, unsigned line);
+ArenaMarker sfArenaMark(const Arena *arena);
+void sfArenaRestore(Arena *arena, ArenaMarker marker);
+void sfArenaReset(Arena *arena);
 void sfArenaFree(Arena *arena);
+void sfArenaTag(Arena *arena, const char *name);
+void sfArenaReport(FILE *stream);
+
+// NOTE: With ARENA_STATS every allocation is attributed to its caller's line.
+// The parentheses in arena.c keep these from expanding in the definitions
+#ifdef ARENA_STATS
+#define sfArenaAlloc(arena, size)                                              \
+  sfArenaAllocAt((arena), (size), ARENA_DEFAULT_ALIGNMENT, __FILE__, __LINE__)
+#define sfArenaAllocAligned(arena, size, alignment)                            \
+  sfArenaAllocAt((arena), (size), (alignment), __FILE__, __LINE__)
+#endif
 
 #endif
@@ -0,0 +1,74 @@
+#ifndef BODIES_H
+#define BODIES_H
+#include "arena.h"
+#include "math3d.h"
+
+// NOTE: 16 floats is one AVX-512 register and one 64-byte cache line
+#define BODIES_SIMD_WIDTH 16
+#define BODIES_ALIGNMENT (BODIES_SIMD_WIDTH * sizeof(float))
+
+/* NOTE:
+ * Structure of arrays body storage. Every array is aligned to
+ * `BODIES_ALIGNMENT` and padded to `capacity`, a multiple of
+ * `BODIES_SIMD_WIDTH`. Padding lanes are massless and at rest, so kernels may
+ * sweep the full `capacity` without a scalar tail.
+ */
+typedef struct {
+  unsigned count;
+  unsigned capacity;
+  float *masses;
+  float *sizes;
+
+  float *positionsX;
+  float *positionsY;
+  float *positionsZ;
+  float *velocitiesX;
+  float *velocitiesY;
+  float *velocitiesZ;
+  float *accelerationsX;
+  float *accelerationsY;
+  float *accelerationsZ;
+} Bodies;
+
+Bodies *sfBodiesArenaAlloc(Arena *arena, unsigned count);
+float *sfFloatsArenaAllocAligned(Arena *arena, unsigned count);
+void sfBodiesGatherPositions(const Bodies *bodies, v3 *positions);
+void sfBodiesGatherVelocities(const Bodies *bodies, v3 *velocities);
+void sfBodiesIntegrate(Bodies *bodies, unsigned first, float dt);
+void sfBodiesIntegrateStream(Bodies *bodies, unsigned first, float dt,
+                             v3 *positionsOut, v3 *velocitiesOut);
+
+static inline v3 sfBodiesPosition(const Bodies *bodies, unsigned i) {
+  return v3_make(bodies->positionsX[i], bodies->positionsY[i],
+                 bodies->positionsZ[i]);
+}
+
+static inline v3 sfBodiesVelocity(const Bodies *bodies, unsigned i) {
+  return v3_make(bodies->velocitiesX[i], bodies->velocitiesY[i],
+                 bodies->velocitiesZ[i]);
+}
+
+static inline v3 sfBodiesAcceleration(const Bodies *bodies, unsigned i) {
+  return v3_make(bodies->accelerationsX[i], bodies->accelerationsY[i],
+                 bodies->accelerationsZ[i]);
+}
+
+static inline void sfBodiesSetPosition(Bodies *bodies, unsigned i, v3 p) {
+  bodies->positionsX[i] = p.x;
+  bodies->positionsY[i] = p.y;
+  bodies->positionsZ[i] = p.z;
+}
+
+static inline void sfBodiesSetVelocity(Bodies *bodies, unsigned i, v3 v) {
+  bodies->velocitiesX[i] = v.x;
+  bodies->velocitiesY[i] = v.y;
+  bodies->velocitiesZ[i] = v.z;
+}
+
+static inline void sfBodiesSetAcceleration(Bodies *bodies, unsigned i, v3 a) {
+  bodies->accelerationsX[i] = a.x;
+  bodies->accelerationsY[i] = a.y;
+  bodies->accelerationsZ[i] = a.z;
+}
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef CULLING_H
+#define CULLING_H
+#include "arena.h"
+#include "bodies.h"
+#include "math3d.h"
+#include "octree.h"
+#include "thread_arena.h"
+
+#define CULL_MIN_ITEMS_PER_THREAD 8
+#define CULL_MAX_ITEMS 4096
+#define CULL_GATHER_MIN_BATCH 4096
+#define VOXEL_CHUNK_SIZE 16.0f
+#define VOXEL_MAX_CHUNKS 4096
+
+// NOTE: Set on visible entries that are octree nodes drawn in place of
+// their subtree, the rest of the bits are then the node index
+#define CULL_AGGREGATE_BIT 0x80000000u
+
+typedef enum { CULL_OUTSIDE, CULL_INTERSECT, CULL_INSIDE } CullResult;
+
+// NOTE: Planes as (normal, distance), normals point into the frustum and are
+// normalized so sphere tests can use world space radii
+typedef struct {
+  v4 planes[6];
+} Frustum;
+
+/* NOTE:
+ * Output of a cull: indices of the visible instances, compacted. The tree or
+ * grid is first cut into a frontier of `items` (octree nodes / voxel chunks)
+ * that are then walked in parallel, each thread appending to its own arena.
+ * The per-thread lists are merged in range order, so the list comes out in
+ * the same order on any thread count.
+ */
+typedef struct {
+  unsigned *visible;
+  unsigned visibleCount;
+  unsigned capacity;
+
+  unsigned *items;
+  unsigned char *itemsInside;
+  unsigned itemCount;
+  // NOTE: Each sized for `capacity` entries, a single thread may see them all
+  ThreadArenas *threadArenas;
+
+  // NOTE: Slack added to every bound, covers bodies that moved since the
+  // octree was built
+  float margin;
+
+  // NOTE: Level of detail for octree culls, off while `lodPixelsPerUnit` is
+  // 0. Nodes projecting to fewer than `lodPixels` are emitted as aggregates
+  v3 lodEye;
+  float lodPixelsPerUnit;
+  float lodPixels;
+} Culler;
+
+/* NOTE:
+ * Voxel instances bucketed into a uniform grid of cubic chunks. The caller
+ * fills `centers` and `radii` per instance before building; `order` then holds
+ * instance indices sorted by chunk, chunk `i` owning
+ * order[firsts[i] .. firsts[i] + counts[i]).
+ */
+typedef struct {
+  float chunkSize;
+  unsigned chunkCount;
+  unsigned instanceCount;
+  v3 *mins;
+  v3 *maxs;
+  unsigned *firsts;
+  unsigned *counts;
+  unsigned *order;
+  unsigned *cells;
+  v3 *centers;
+  float *radii;
+} VoxelChunks;
+
+Frustum sfFrustumFromViewProjection(const m44 *view, const m44 *projection);
+CullResult sfFrustumTestBox(const Frustum *frustum, v3 min, v3 max);
+CullResult sfFrustumTestSphere(const Frustum *frustum, v3 center,
+                               float radius);
+
+Culler *sfCullerArenaAlloc(Arena *arena, unsigned capacity);
+void sfCullerSetLOD(Culler *culler, v3 eye, const m44 *projection,
+                    float viewportHeight, float pixels);
+unsigned sfCullOctree(Culler *culler, const Octree *octree,
+                      const Bodies *bodies, const Frustum *frustum);
+void sfCullerGatherBodies(const Culler *culler, const Octree *octree,
+                          const Bodies *bodies, v3 *positions, v3 *velocities,
+                          float *weights);
+
+VoxelChunks *sfVoxelChunksArenaAlloc(Arena *arena, unsigned instanceCount);
+void sfVoxelChunksBuild(VoxelChunks *chunks, unsigned count);
+unsigned sfCullVoxelChunks(Culler *culler, const VoxelChunks *chunks,
+                           const Frustum *frustum);
+
+#endif
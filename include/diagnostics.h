@@ -0,0 +1,32 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+#include "math3d.h"
+
+/* NOTE:
+ * Conservation diagnostics accumulated inside the physics step. Potential
+ * energy comes from the same tree walk as the accelerations, kinetic energy
+ * and momentum from the velocities at the start of the step, so both describe
+ * the same state.
+ */
+typedef struct {
+  double kinetic;
+  double potential;
+  double momentum[3];
+
+  double initialEnergy;
+  double initialMomentum[3];
+  double energyDrift;
+  double momentumDrift;
+  unsigned steps;
+} Diagnostics;
+
+void sfDiagnosticsReset(Diagnostics *diagnostics);
+void sfDiagnosticsBeginStep(Diagnostics *diagnostics);
+void sfDiagnosticsAddPotential(Diagnostics *diagnostics, float mass,
+                               float potential);
+void sfDiagnosticsAddKinetic(Diagnostics *diagnostics, float mass,
+                             const v3 velocity);
+void sfDiagnosticsEndStep(Diagnostics *diagnostics);
+void sfDiagnosticsPrint(const Diagnostics *diagnostics, unsigned step);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef DIRTY_RANGES_H
+#define DIRTY_RANGES_H
+#include <glad/glad.h>
+
+#define MAX_DIRTY_RANGES 16
+
+// NOTE: Half open [first, end), in elements
+typedef struct {
+  unsigned first;
+  unsigned end;
+} DirtyRange;
+
+/* NOTE:
+ * Sorted, disjoint spans of an instance array modified since the last upload.
+ * Overlapping and touching spans are merged as they are marked; once
+ * `MAX_DIRTY_RANGES` is reached the two spans with the smallest gap are
+ * joined, trading a few clean elements for fewer glBufferSubData calls.
+ */
+typedef struct {
+  unsigned count;
+  DirtyRange ranges[MAX_DIRTY_RANGES];
+} DirtyRanges;
+
+void sfDirtyRangesMark(DirtyRanges *dirty, unsigned first, unsigned count);
+void sfDirtyRangesClear(DirtyRanges *dirty);
+unsigned sfDirtyRangesUpload(DirtyRanges *dirty, GLenum target,
+                             const void *data, GLsizeiptr elementSize);
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef GL_EXTENSIONS_H
+#define GL_EXTENSIONS_H
+#include <glad/glad.h>
+
+/* NOTE:
+ * The bundled glad loader targets core 3.3 without extensions. Entry points
+ * newer than that are resolved here, through the same loader, and are only
+ * used when the context reports them.
+ */
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+#ifndef GL_DYNAMIC_STORAGE_BIT
+#define GL_DYNAMIC_STORAGE_BIT 0x0100
+#endif
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+typedef void(APIENTRYP PFNSFGLBUFFERSTORAGEPROC)(GLenum target,
+                                                 GLsizeiptr size,
+                                                 const void *data,
+                                                 GLbitfield flags);
+
+typedef void(APIENTRYP PFNSFGLGETPROGRAMBINARYPROC)(GLuint program,
+                                                    GLsizei bufSize,
+                                                    GLsizei *length,
+                                                    GLenum *binaryFormat,
+                                                    void *binary);
+typedef void(APIENTRYP PFNSFGLPROGRAMBINARYPROC)(GLuint program,
+                                                 GLenum binaryFormat,
+                                                 const void *binary,
+                                                 GLsizei length);
+typedef void(APIENTRYP PFNSFGLPROGRAMPARAMETERIPROC)(GLuint program,
+                                                     GLenum pname,
+                                                     GLint value);
+
+typedef struct {
+  int major;
+  int minor;
+  unsigned char hasBufferStorage;
+  PFNSFGLBUFFERSTORAGEPROC bufferStorage;
+
+  // NOTE: Also requires the driver to expose at least one binary format
+  unsigned char hasProgramBinary;
+  PFNSFGLGETPROGRAMBINARYPROC getProgramBinary;
+  PFNSFGLPROGRAMBINARYPROC programBinary;
+  PFNSFGLPROGRAMPARAMETERIPROC programParameteri;
+} GLExtensions;
+
+extern GLExtensions sfGLExtensions;
+
+void sfLoadGLExtensions(GLADloadproc load);
+int sfGLHasExtension(const char *name);
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef GRAVITY_H
+#define GRAVITY_H
+#include "math3d.h"
+
+// NOTE: Source counts are padded to this, one AVX-512 register of floats
+#define GRAVITY_SIMD_WIDTH 16
+
+typedef enum {
+  GRAVITY_KERNEL_SCALAR,
+  GRAVITY_KERNEL_SSE,
+  GRAVITY_KERNEL_AVX2,
+  GRAVITY_KERNEL_AVX512,
+  GRAVITY_KERNEL_COUNT
+} GravityKernelType;
+
+/* NOTE:
+ * Point masses pulling on one position, as structure of arrays. They may be
+ * bodies or tree nodes. Counts passed to the kernels are multiples of
+ * GRAVITY_SIMD_WIDTH, padding lanes must be massless. A source at exactly the
+ * pulled position is the position's own body and is skipped.
+ */
+typedef struct {
+  const float *x;
+  const float *y;
+  const float *z;
+  const float *masses;
+} GravitySources;
+
+/* NOTE:
+ * Adds the Plummer softened pull of `count` sources on `position`,
+ *   m * d / (|d|^2 + epsilon^2)^(3/2),
+ * to `acceleration`, and their potential, -m / (|d|^2 + epsilon^2)^(1/2), to
+ * `potential` unless it is NULL. The SIMD kernels get the inverse distance
+ * from an approximate rsqrt refined by one Newton step.
+ */
+typedef void (*GravityKernel)(const GravitySources *sources, unsigned count,
+                              v3 position, float epsilonSquared,
+                              v3 *acceleration, float *potential);
+
+void sfGravityInit();
+unsigned char sfGravityIsSupported(GravityKernelType type);
+unsigned char sfGravitySetKernel(GravityKernelType type);
+GravityKernelType sfGravityKernelType();
+const char *sfGravityKernelName(GravityKernelType type);
+void sfGravityAccumulate(const GravitySources *sources, unsigned count,
+                         v3 position, float epsilonSquared, v3 *acceleration,
+                         float *potential);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef INITIAL_CONDITIONS_H
+#define INITIAL_CONDITIONS_H
+#include "bodies.h"
+#include "math3d.h"
+#include "random.h"
+#include <stdint.h>
+
+typedef enum {
+  IC_PLUMMER,
+  IC_EXPONENTIAL_DISK,
+  IC_UNIFORM_COLLAPSE,
+  IC_MERGING_PAIR
+} InitialConditionsType;
+
+typedef struct {
+  uint64_t seed;
+  float mass;
+  float radius;
+  float G;
+
+  // NOTE: Exponential disk only, `radius` is the scale length
+  float scaleHeight;
+
+  // NOTE: Merging pair only, each half is a Plummer sphere of `radius`
+  float separation;
+  float approachSpeed;
+  float impactParameter;
+} InitialConditions;
+
+InitialConditions sfInitialConditionsDefault(uint64_t seed);
+int sfInitialConditionsParseType(const char *name, InitialConditionsType *type);
+void sfInitialConditionsGenerate(Bodies *bodies, InitialConditionsType type,
+                                 const InitialConditions *ic);
+
+#endif
@@ -9,11 +9,29 @@
 #include <math.h>
 #include <stdint.h>
 #include <stdlib.h>
-#define SIN(x) sin(x)
-#define COS(x) cos(x)
-#define SQRT(x) sqrt(x)
+#define SIN(x) sinf(x)
+#define COS(x) cosf(x)
+#define SQRT(x) sqrtf(x)
 #define TAN(x) tanf(x)
-#define ACOS(x) acos(x)
+#define ACOS(x) acosf(x)
+
+/* NOTE:
+ * The SIMD backend is picked at compile time from the target's flags. AVX
+ * widens `m44_mul` to two rows at a time, SSE covers the rest of the v4 and
+ * m44 operations. Defining MATH3D_SCALAR before including this forces the
+ * portable code, which is also what every non-x86 target, NEON included,
+ * compiles. Vectors carry no alignment, so every access is unaligned.
+ */
+#if !defined(MATH3D_SCALAR) && defined(__AVX__)
+#define MATH3D_AVX
+#define MATH3D_SSE
+#include <immintrin.h>
+#elif !defined(MATH3D_SCALAR) &&                                               \
+    (defined(__SSE__) || defined(_M_X64) ||                                    \
+     (defined(_M_IX86_FP) && _M_IX86_FP >= 1))
+#define MATH3D_SSE
+#include <xmmintrin.h>
+#endif
 
 #define PI 3.14159265358979323846f
 #define PI_HALF PI / 2.0f
@@ -198,6 +216,26 @@ struct v4 {
 };
 typedef struct v4 v4;
 
+#ifdef MATH3D_SSE
+L4VDEF __m128 v4_load_ps(const v4 *v) { return _mm_loadu_ps(v->v); }
+
+L4VDEF v4 v4_store_ps(__m128 m) {
+  v4 result;
+  _mm_storeu_ps(result.v, m);
+  return result;
+}
+
+// NOTE: Dot product of `a` and `b` in every lane
+L4VDEF __m128 v4_dot_ps(__m128 a, __m128 b) {
+  __m128 products = _mm_mul_ps(a, b);
+  __m128 swapped =
+      _mm_shuffle_ps(products, products, _MM_SHUFFLE(2, 3, 0, 1));
+  __m128 pairs = _mm_add_ps(products, swapped);
+  swapped = _mm_shuffle_ps(pairs, pairs, _MM_SHUFFLE(1, 0, 3, 2));
+  return _mm_add_ps(pairs, swapped);
+}
+#endif
+
 L4VDEF v4 v4_make(float x, float y, float z, float w) {
   v4 result = {0};
   result.x = x;
@@ -208,10 +246,19 @@ L4VDEF v4 v4_make(float x, float y, float z, float w) {
 }
 
 L4VDEF float v4_len(const v4 v) {
+#ifdef MATH3D_SSE
+  __m128 m = v4_load_ps(&v);
+  return _mm_cvtss_f32(_mm_sqrt_ss(v4_dot_ps(m, m)));
+#else
   return SQRT(v.x * v.x + v.y * v.y + v.z * v.z + v.w * v.w);
+#endif
 }
 
 L4VDEF v4 v4_norm(const v4 v) {
+#ifdef MATH3D_SSE
+  __m128 m = v4_load_ps(&v);
+  return v4_store_ps(_mm_div_ps(m, _mm_sqrt_ps(v4_dot_ps(m, m))));
+#else
   v4 result = v;
   float l = v4_len(v);
   result.x /= l;
@@ -219,33 +266,46 @@ L4VDEF v4 v4_norm(const v4 v) {
   result.z /= l;
   result.w /= l;
   return result;
+#endif
 }
 
 L4VDEF v4 v4_add(const v4 *a, const v4 *b) {
+#ifdef MATH3D_SSE
+  return v4_store_ps(_mm_add_ps(v4_load_ps(a), v4_load_ps(b)));
+#else
   v4 result;
   result.x = a->x + b->x;
   result.y = a->y + b->y;
   result.z = a->z + b->z;
   result.w = a->w + b->w;
   return result;
+#endif
 }
 
 L4VDEF v4 v4_sub(const v4 *a, const v4 *b) {
+#ifdef MATH3D_SSE
+  return v4_store_ps(_mm_sub_ps(v4_load_ps(a), v4_load_ps(b)));
+#else
   v4 result;
   result.x = a->x - b->x;
   result.y = a->y - b->y;
   result.z = a->z - b->z;
   result.w = a->w - b->w;
   return result;
+#endif
 }
 
 L4VDEF v4 v4_mul_scalar(const v4 *a, float s) {
+#ifdef MATH3D_SSE
+  return v4_store_ps(_mm_mul_ps(v4_load_ps(a), _mm_set1_ps(s)));
+#else
   v4 result;
   result.x = a->x * s;
   result.y = a->y * s;
   result.z = a->z * s;
   result.w = a->w * s;
   return result;
+#endif
 }
 
 /* TODO|NOTE(Jovan):
@@ -420,9 +480,40 @@ L4VDEF float m44_det(const m44 *m) {
   return m->ax * minor0 - m->bx * minor1 + m->cx * minor2 - m->dx * minor3;
 }
 
+// NOTE: Row i of the product is row i of `a` weighting the rows of `b`
 L4VDEF m44 m44_mul(const m44 *a, const m44 *b) {
   m44 result = {0};
 
+#if defined(MATH3D_AVX)
+  __m256 b0 = _mm256_broadcast_ps((const __m128 *)b->v[0].v);
+  __m256 b1 = _mm256_broadcast_ps((const __m128 *)b->v[1].v);
+  __m256 b2 = _mm256_broadcast_ps((const __m128 *)b->v[2].v);
+  __m256 b3 = _mm256_broadcast_ps((const __m128 *)b->v[3].v);
+  for (int i = 0; i < 4; i += 2) {
+    __m256 rows = _mm256_loadu_ps(a->v[i].v);
+    __m256 sum = _mm256_mul_ps(_mm256_shuffle_ps(rows, rows, 0x00), b0);
+    sum = _mm256_add_ps(
+        sum, _mm256_mul_ps(_mm256_shuffle_ps(rows, rows, 0x55), b1));
+    sum = _mm256_add_ps(
+        sum, _mm256_mul_ps(_mm256_shuffle_ps(rows, rows, 0xaa), b2));
+    sum = _mm256_add_ps(
+        sum, _mm256_mul_ps(_mm256_shuffle_ps(rows, rows, 0xff), b3));
+    _mm256_storeu_ps(result.v[i].v, sum);
+  }
+#elif defined(MATH3D_SSE)
+  __m128 b0 = v4_load_ps(&b->v[0]);
+  __m128 b1 = v4_load_ps(&b->v[1]);
+  __m128 b2 = v4_load_ps(&b->v[2]);
+  __m128 b3 = v4_load_ps(&b->v[3]);
+  for (int i = 0; i < 4; ++i) {
+    __m128 row = v4_load_ps(&a->v[i]);
+    __m128 sum = _mm_mul_ps(_mm_shuffle_ps(row, row, 0x00), b0);
+    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_shuffle_ps(row, row, 0x55), b1));
+    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_shuffle_ps(row, row, 0xaa), b2));
+    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_shuffle_ps(row, row, 0xff), b3));
+    _mm_storeu_ps(result.v[i].v, sum);
+  }
+#else
   for (int i = 0; i < 4; ++i) {
     for (int j = 0; j < 4; ++j) {
       float sum = 0.0f;
@@ -432,6 +523,7 @@ L4VDEF m44 m44_mul(const m44 *a, const m44 *b) {
       result.v[i].v[j] = sum;
     }
   }
+#endif
 
   return result;
 }
@@ -462,13 +554,114 @@ L4VDEF m44 m44_mul_scalar(const m44 *a, float s) {
 }
 
 L4VDEF m44 m44_transpose(const m44 m) {
-  m44 result = {m.ax, m.ab, m.az, m.aw, m.bx, m.by, m.bz, m.bw,
-                m.cx, m.cy, m.cz, m.cw, m.dx, m.dy, m.dz, m.dw};
+#ifdef MATH3D_SSE
+  __m128 a = v4_load_ps(&m.v[0]);
+  __m128 b = v4_load_ps(&m.v[1]);
+  __m128 c = v4_load_ps(&m.v[2]);
+  __m128 d = v4_load_ps(&m.v[3]);
+  _MM_TRANSPOSE4_PS(a, b, c, d);
+  m44 result;
+  _mm_storeu_ps(result.v[0].v, a);
+  _mm_storeu_ps(result.v[1].v, b);
+  _mm_storeu_ps(result.v[2].v, c);
+  _mm_storeu_ps(result.v[3].v, d);
+  return result;
+#else
+  m44 result = {m.ax, m.bx, m.cx, m.dx, m.ab, m.by, m.cy, m.dy,
+                m.az, m.bz, m.cz, m.dz, m.aw, m.bw, m.cw, m.dw};
+  return result;
+#endif
+}
+
+#ifdef MATH3D_SSE
+// NOTE: 2x2 matrices packed row major in one register, (a b c d) is
+// | a b |
+// | c d |. `#` is the adjugate
+#define M22_SHUFFLE(m, x, y, z, w) _mm_shuffle_ps(m, m, _MM_SHUFFLE(w, z, y, x))
+
+// NOTE: a * b
+L4VDEF __m128 m22_mul(__m128 a, __m128 b) {
+  return _mm_add_ps(
+      _mm_mul_ps(a, M22_SHUFFLE(b, 0, 3, 0, 3)),
+      _mm_mul_ps(M22_SHUFFLE(a, 1, 0, 3, 2), M22_SHUFFLE(b, 2, 1, 2, 1)));
+}
+
+// NOTE: a# * b
+L4VDEF __m128 m22_adj_mul(__m128 a, __m128 b) {
+  return _mm_sub_ps(
+      _mm_mul_ps(M22_SHUFFLE(a, 3, 3, 0, 0), b),
+      _mm_mul_ps(M22_SHUFFLE(a, 1, 1, 2, 2), M22_SHUFFLE(b, 2, 3, 0, 1)));
+}
+
+// NOTE: a * b#
+L4VDEF __m128 m22_mul_adj(__m128 a, __m128 b) {
+  return _mm_sub_ps(
+      _mm_mul_ps(a, M22_SHUFFLE(b, 3, 0, 3, 0)),
+      _mm_mul_ps(M22_SHUFFLE(a, 1, 0, 3, 2), M22_SHUFFLE(b, 2, 1, 2, 1)));
+}
+
+/* NOTE:
+ * Blockwise inverse of
+ * | A B |
+ * | C D |
+ * out of 2x2 adjugates, the determinant comes from the same products as
+ * |A||D| + |B||C| - tr(A#B D#C).
+ */
+L4VDEF m44 m44_inverse_sse(const m44 *m) {
+  __m128 row0 = v4_load_ps(&m->v[0]);
+  __m128 row1 = v4_load_ps(&m->v[1]);
+  __m128 row2 = v4_load_ps(&m->v[2]);
+  __m128 row3 = v4_load_ps(&m->v[3]);
+
+  __m128 A = _mm_movelh_ps(row0, row1);
+  __m128 B = _mm_movehl_ps(row1, row0);
+  __m128 C = _mm_movelh_ps(row2, row3);
+  __m128 D = _mm_movehl_ps(row3, row2);
+
+  // NOTE: (|A| |B| |C| |D|)
+  __m128 dets = _mm_sub_ps(
+      _mm_mul_ps(_mm_shuffle_ps(row0, row2, _MM_SHUFFLE(2, 0, 2, 0)),
+                 _mm_shuffle_ps(row1, row3, _MM_SHUFFLE(3, 1, 3, 1))),
+      _mm_mul_ps(_mm_shuffle_ps(row0, row2, _MM_SHUFFLE(3, 1, 3, 1)),
+                 _mm_shuffle_ps(row1, row3, _MM_SHUFFLE(2, 0, 2, 0))));
+  __m128 detA = M22_SHUFFLE(dets, 0, 0, 0, 0);
+  __m128 detB = M22_SHUFFLE(dets, 1, 1, 1, 1);
+  __m128 detC = M22_SHUFFLE(dets, 2, 2, 2, 2);
+  __m128 detD = M22_SHUFFLE(dets, 3, 3, 3, 3);
+
+  __m128 DC = m22_adj_mul(D, C);
+  __m128 AB = m22_adj_mul(A, B);
+  __m128 X = _mm_sub_ps(_mm_mul_ps(detD, A), m22_mul(B, DC));
+  __m128 W = _mm_sub_ps(_mm_mul_ps(detA, D), m22_mul(C, AB));
+  __m128 Y = _mm_sub_ps(_mm_mul_ps(detB, C), m22_mul_adj(D, AB));
+  __m128 Z = _mm_sub_ps(_mm_mul_ps(detC, B), m22_mul_adj(A, DC));
+
+  __m128 trace = _mm_mul_ps(AB, M22_SHUFFLE(DC, 0, 2, 1, 3));
+  trace = _mm_add_ps(trace, M22_SHUFFLE(trace, 2, 3, 0, 1));
+  trace = _mm_add_ps(trace, M22_SHUFFLE(trace, 1, 0, 3, 2));
+  __m128 det = _mm_sub_ps(
+      _mm_add_ps(_mm_mul_ps(detA, detD), _mm_mul_ps(detB, detC)), trace);
+  __m128 iDet = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), det);
+
+  X = _mm_mul_ps(X, iDet);
+  Y = _mm_mul_ps(Y, iDet);
+  Z = _mm_mul_ps(Z, iDet);
+  W = _mm_mul_ps(W, iDet);
+
+  m44 result;
+  _mm_storeu_ps(result.v[0].v, _mm_shuffle_ps(X, Y, _MM_SHUFFLE(1, 3, 1, 3)));
+  _mm_storeu_ps(result.v[1].v, _mm_shuffle_ps(X, Y, _MM_SHUFFLE(0, 2, 0, 2)));
+  _mm_storeu_ps(result.v[2].v, _mm_shuffle_ps(Z, W, _MM_SHUFFLE(1, 3, 1, 3)));
+  _mm_storeu_ps(result.v[3].v, _mm_shuffle_ps(Z, W, _MM_SHUFFLE(0, 2, 0, 2)));
   return result;
 }
+#endif
 
 // NOTE(Jovan): Inverse
 L4VDEF m44 m44_inverse(const m44 m) {
+#ifdef MATH3D_SSE
+  return m44_inverse_sse(&m);
+#else
   // NOTE(Jovan): Determinants of 2x2
   float y1z0 = m.by * m.az - m.ab * m.bz;
   float y2z0 = m.cy * m.az - m.ab * m.cz;
@@ -516,16 +709,27 @@ L4VDEF m44 m44_inverse(const m44 m) {
                             min33,  -min32, min31,  -min30};
 
   return m44_mul_scalar(&transposedcofactor, iDet);
-};
+#endif
+}
 
 L4VDEF m44 translate(const m44 *m, float x, float y, float z) {
   m44 result = *m;
 
+#ifdef MATH3D_SSE
+  __m128 d = v4_load_ps(&m->v[3]);
+  __m128 moved = _mm_add_ps(
+      _mm_add_ps(_mm_mul_ps(_mm_set1_ps(x), v4_load_ps(&m->v[0])),
+                 _mm_mul_ps(_mm_set1_ps(y), v4_load_ps(&m->v[1]))),
+      _mm_add_ps(_mm_mul_ps(_mm_set1_ps(z), v4_load_ps(&m->v[2])), d));
+  _mm_storeu_ps(result.v[3].v, _mm_add_ps(d, moved));
+  return result;
+#else
   result.dx += x * m->ax + y * m->bx + z * m->cx + m->dx;
   result.dy += x * m->ab + y * m->by + z * m->cy + m->dy;
   result.dz += x * m->az + y * m->bz + z * m->cz + m->dz;
   result.dw += x * m->aw + y * m->bw + z * m->cw + m->dw;
   return result;
+#endif
 }
 
 L4VDEF m44 translate_v3(const m44 *m, const v3 *v) {
@@ -534,6 +738,15 @@ L4VDEF m44 translate_v3(const m44 *m, const v3 *v) {
 
 L4VDEF m44 scale(const m44 *m, float x, float y, float z) {
   m44 result = *m;
+#ifdef MATH3D_SSE
+  _mm_storeu_ps(result.v[0].v, _mm_mul_ps(v4_load_ps(&m->v[0]),
+                                          _mm_setr_ps(x, x, x, 1.0f)));
+  _mm_storeu_ps(result.v[1].v, _mm_mul_ps(v4_load_ps(&m->v[1]),
+                                          _mm_setr_ps(y, y, y, 1.0f)));
+  _mm_storeu_ps(result.v[2].v, _mm_mul_ps(v4_load_ps(&m->v[2]),
+                                          _mm_setr_ps(z, z, z, 1.0f)));
+  return result;
+#else
   result.ax *= x;
   result.ab *= x;
   result.az *= x;
@@ -546,6 +759,7 @@ L4VDEF m44 scale(const m44 *m, float x, float y, float z) {
   result.cy *= z;
   result.cz *= z;
   return result;
+#endif
 }
 
 L4VDEF m44 scale_v3(const m44 *m, const v3 *v) {
@@ -667,6 +881,149 @@ L4VDEF m44 lookAt(const v3 eye, const v3 center, const v3 up) {
   return result;
 }
 
+/* NOTE:
+ * Per-instance transforms as structure of arrays, element i of every array
+ * belongs to instance i. `scales` may be NULL for unit scale. The rotation
+ * arrays are unit quaternions and either all set or all NULL.
+ */
+struct transform_soa {
+  const float *positionsX;
+  const float *positionsY;
+  const float *positionsZ;
+  const float *scales;
+  const float *rotationsX;
+  const float *rotationsY;
+  const float *rotationsZ;
+  const float *rotationsW;
+};
+typedef struct transform_soa transform_soa;
+
+// NOTE: Rotation columns of quaternion (x, y, z, w), each scaled by `s`
+#define TRANSFORM_ROTATION_COLUMNS(x, y, z, w, s, MUL, ADD, SUB, TWO)          \
+  xx = MUL(x, x), yy = MUL(y, y), zz = MUL(z, z);                              \
+  xy = MUL(x, y), xz = MUL(x, z), yz = MUL(y, z);                              \
+  wx = MUL(w, x), wy = MUL(w, y), wz = MUL(w, z);                              \
+  ts = MUL(TWO, s);                                                            \
+  c00 = SUB(s, MUL(ts, ADD(yy, zz)));                                          \
+  c01 = MUL(ts, ADD(xy, wz));                                                  \
+  c02 = MUL(ts, SUB(xz, wy));                                                  \
+  c10 = MUL(ts, SUB(xy, wz));                                                  \
+  c11 = SUB(s, MUL(ts, ADD(xx, zz)));                                          \
+  c12 = MUL(ts, ADD(yz, wx));                                                  \
+  c20 = MUL(ts, ADD(xz, wy));                                                  \
+  c21 = MUL(ts, SUB(yz, wx));                                                  \
+  c22 = SUB(s, MUL(ts, ADD(xx, yy)))
+
+#define TRANSFORM_MUL(a, b) ((a) * (b))
+#define TRANSFORM_ADD(a, b) ((a) + (b))
+#define TRANSFORM_SUB(a, b) ((a) - (b))
+
+L4VDEF float transform_scale(const transform_soa *in, unsigned i) {
+  return in->scales ? in->scales[i] : 1.0f;
+}
+
+// NOTE: translation * rotation * scale of instance i, the matrix the
+// compact voxel instance expands to when there is no rotation
+L4VDEF m44 transform_m44(const transform_soa *in, unsigned i) {
+  float s = transform_scale(in, i);
+  m44 result = m44_identity(s);
+  if (in->rotationsX) {
+    float xx, yy, zz, xy, xz, yz, wx, wy, wz, ts;
+    float c00, c01, c02, c10, c11, c12, c20, c21, c22;
+    TRANSFORM_ROTATION_COLUMNS(in->rotationsX[i], in->rotationsY[i],
+                               in->rotationsZ[i], in->rotationsW[i], s,
+                               TRANSFORM_MUL, TRANSFORM_ADD, TRANSFORM_SUB,
+                               2.0f);
+    result.v[0] = v4_make(c00, c01, c02, 0.0f);
+    result.v[1] = v4_make(c10, c11, c12, 0.0f);
+    result.v[2] = v4_make(c20, c21, c22, 0.0f);
+  }
+  result.v[3] = v4_make(in->positionsX[i], in->positionsY[i],
+                        in->positionsZ[i], 1.0f);
+  return result;
+}
+
+#ifdef MATH3D_SSE
+L4VDEF __m128 transform_scales_ps(const transform_soa *in, unsigned i) {
+  return in->scales ? _mm_loadu_ps(in->scales + i) : _mm_set1_ps(1.0f);
+}
+
+// NOTE: Stores row `row` of four matrices given as the row's columns
+L4VDEF void transform_store_rows_ps(m44 *out, unsigned row, __m128 x,
+                                    __m128 y, __m128 z, __m128 w) {
+  _MM_TRANSPOSE4_PS(x, y, z, w);
+  _mm_storeu_ps(out[0].v[row].v, x);
+  _mm_storeu_ps(out[1].v[row].v, y);
+  _mm_storeu_ps(out[2].v[row].v, z);
+  _mm_storeu_ps(out[3].v[row].v, w);
+}
+#endif
+
+/* NOTE:
+ * Writes the matrices of instances [begin, end) to `out[begin..end)`, the
+ * same ones `transform_m44` builds. Four instances go through one pass of
+ * SSE, their columns transposed into rows on the way out.
+ */
+L4VDEF void m44_batch_transforms(m44 *out, const transform_soa *in,
+                                 unsigned begin, unsigned end) {
+  unsigned i = begin;
+#ifdef MATH3D_SSE
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 two = _mm_set1_ps(2.0f);
+  for (; i + 4 <= end; i += 4) {
+    __m128 s = transform_scales_ps(in, i);
+    if (in->rotationsX) {
+      __m128 xx, yy, zz, xy, xz, yz, wx, wy, wz, ts;
+      __m128 c00, c01, c02, c10, c11, c12, c20, c21, c22;
+      TRANSFORM_ROTATION_COLUMNS(
+          _mm_loadu_ps(in->rotationsX + i), _mm_loadu_ps(in->rotationsY + i),
+          _mm_loadu_ps(in->rotationsZ + i), _mm_loadu_ps(in->rotationsW + i),
+          s, _mm_mul_ps, _mm_add_ps, _mm_sub_ps, two);
+      transform_store_rows_ps(out + i, 0, c00, c01, c02, zero);
+      transform_store_rows_ps(out + i, 1, c10, c11, c12, zero);
+      transform_store_rows_ps(out + i, 2, c20, c21, c22, zero);
+    } else {
+      transform_store_rows_ps(out + i, 0, s, zero, zero, zero);
+      transform_store_rows_ps(out + i, 1, zero, s, zero, zero);
+      transform_store_rows_ps(out + i, 2, zero, zero, s, zero);
+    }
+    transform_store_rows_ps(out + i, 3, _mm_loadu_ps(in->positionsX + i),
+                            _mm_loadu_ps(in->positionsY + i),
+                            _mm_loadu_ps(in->positionsZ + i), one);
+  }
+#endif
+  for (; i < end; ++i) {
+    out[i] = transform_m44(in, i);
+  }
+}
+
+// NOTE: Writes (x, y, z, scale) of instances [begin, end) to
+// `out[4 * begin..4 * end)`, rotations are ignored
+L4VDEF void v4_batch_instances(float *out, const transform_soa *in,
+                               unsigned begin, unsigned end) {
+  unsigned i = begin;
+#ifdef MATH3D_SSE
+  for (; i + 4 <= end; i += 4) {
+    __m128 x = _mm_loadu_ps(in->positionsX + i);
+    __m128 y = _mm_loadu_ps(in->positionsY + i);
+    __m128 z = _mm_loadu_ps(in->positionsZ + i);
+    __m128 s = transform_scales_ps(in, i);
+    _MM_TRANSPOSE4_PS(x, y, z, s);
+    _mm_storeu_ps(out + 4 * i, x);
+    _mm_storeu_ps(out + 4 * i + 4, y);
+    _mm_storeu_ps(out + 4 * i + 8, z);
+    _mm_storeu_ps(out + 4 * i + 12, s);
+  }
+#endif
+  for (; i < end; ++i) {
+    out[4 * i] = in->positionsX[i];
+    out[4 * i + 1] = in->positionsY[i];
+    out[4 * i + 2] = in->positionsZ[i];
+    out[4 * i + 3] = transform_scale(in, i);
+  }
+}
+
 L4VDEF void m44_print(m44 m) {
   for (int i = 0; i < 4; ++i) {
     for (int j = 0; j < 4; ++j) {
@@ -0,0 +1,11 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+typedef void (*ParallelKernel)(void *context, unsigned begin, unsigned end);
+
+unsigned sfParallelThreadCount();
+unsigned sfParallelThreadIndex();
+void sfParallelFor(unsigned count, unsigned minBatch, ParallelKernel kernel,
+                   void *context);
+
+#endif
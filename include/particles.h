@@ -3,25 +3,40 @@
 #include "arena.h"
 #include "common.h"
 #include "math3d.h"
+#include "render_queue.h"
+#include "stream_buffer.h"
 #include <glad/glad.h>
 
 const static unsigned POSITION_LOCATION = 0;
 const static unsigned VELOCITY_LOCATION = 1;
+const static unsigned WEIGHT_LOCATION = 2;
 
 typedef struct {
   unsigned vao;
-  unsigned positionsVbo;
-  unsigned velocitiesVbo;
   unsigned count;
+  // NOTE: Leading particles drawn this frame, `count` unless culled
+  unsigned drawCount;
+  StreamBuffer *positionsStream;
+  StreamBuffer *velocitiesStream;
+  StreamBuffer *weightsStream;
 
+  // NOTE: Write-only views into this frame's stream regions, valid between
+  // `sfParticlesBeginFrame` and `sfParticlesRender`
   v3 *positions;
   v3 *velocities;
+  // NOTE: How many bodies each point stands for, only read when
+  // `hasWeights` is set for the frame, otherwise every point weighs 1
+  float *weights;
+  unsigned char hasWeights;
 } Particles;
 
 void initBuffers(Particles *particles);
 
 Particles *sfParticlesArenaAlloc(Arena *arena, unsigned count);
 void sfParticlesDestroy(Particles *particles);
-void sfParticlesRender(const Particles *particles);
+void sfParticlesBeginFrame(Particles *particles);
+void sfParticlesRender(Particles *particles);
+void sfParticlesSubmit(RenderQueue *queue, Particles *particles,
+                       unsigned program);
 
 #endif
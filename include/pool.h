@@ -0,0 +1,41 @@
+#ifndef POOL_H
+#define POOL_H
+#include "arena.h"
+#include <stdint.h>
+
+#define POOL_SLOTS_PER_PAGE 64
+#define POOL_NO_SLOT 0xffffffffu
+
+// NOTE: A zeroed handle is never valid, it can stand for "none"
+typedef struct {
+  uint32_t index;
+  uint32_t generation;
+} PoolHandle;
+
+/* NOTE:
+ * Fixed size elements in pages of `POOL_SLOTS_PER_PAGE`, taken from the arena
+ * as the pool grows and never returned to it. Freed slots link into a free
+ * list through their own storage and are reused first. Every slot counts
+ * its generation, odd while live, and a handle only resolves while its
+ * generation matches, so stale handles read as NULL instead of aliasing the
+ * slot's next owner. Not thread safe.
+ */
+typedef struct {
+  Arena *arena;
+  size_t elementSize;
+  size_t stride;
+  unsigned char **pages;
+  unsigned pageCount;
+  unsigned maxPages;
+  uint32_t freeHead;
+  unsigned liveCount;
+} Pool;
+
+Pool *sfPoolArenaAlloc(Arena *arena, size_t elementSize, unsigned maxCount);
+PoolHandle sfPoolAlloc(Pool *pool);
+void sfPoolFree(Pool *pool, PoolHandle handle);
+void *sfPoolGet(const Pool *pool, PoolHandle handle);
+
+#define sfPoolGetAs(type, pool, handle) ((type *)sfPoolGet((pool), (handle)))
+
+#endif
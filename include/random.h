@@ -0,0 +1,76 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+#include <stdint.h>
+
+/* NOTE:
+ * Counter-based generator (Philox4x32-10). Every draw is a pure function of
+ * (seed, body, counter), so bodies can be generated in any order, on any
+ * number of threads, and still come out bit identical.
+ */
+typedef struct {
+  uint64_t seed;
+  uint32_t body;
+  uint32_t counter;
+  uint32_t buffer[4];
+  unsigned used;
+} RandomStream;
+
+static inline uint32_t philoxMulHiLo(uint32_t a, uint32_t b, uint32_t *hi) {
+  uint64_t product = (uint64_t)a * b;
+  *hi = (uint32_t)(product >> 32);
+  return (uint32_t)product;
+}
+
+static inline void sfPhilox4x32(uint32_t counter[4], uint64_t seed) {
+  uint32_t key0 = (uint32_t)seed;
+  uint32_t key1 = (uint32_t)(seed >> 32);
+  for (int round = 0; round < 10; ++round) {
+    uint32_t hi0, hi1;
+    uint32_t lo0 = philoxMulHiLo(0xD2511F53u, counter[0], &hi0);
+    uint32_t lo1 = philoxMulHiLo(0xCD9E8D57u, counter[2], &hi1);
+    uint32_t c1 = counter[1];
+    uint32_t c3 = counter[3];
+    counter[0] = hi1 ^ c1 ^ key0;
+    counter[1] = lo1;
+    counter[2] = hi0 ^ c3 ^ key1;
+    counter[3] = lo0;
+    key0 += 0x9E3779B9u;
+    key1 += 0xBB67AE85u;
+  }
+}
+
+static inline RandomStream sfRandomStream(uint64_t seed, uint32_t body) {
+  RandomStream stream = {0};
+  stream.seed = seed;
+  stream.body = body;
+  stream.used = 4;
+  return stream;
+}
+
+static inline uint32_t sfRandomU32(RandomStream *stream) {
+  if (stream->used == 4) {
+    stream->buffer[0] = stream->body;
+    stream->buffer[1] = stream->counter++;
+    stream->buffer[2] = 0;
+    stream->buffer[3] = 0;
+    sfPhilox4x32(stream->buffer, stream->seed);
+    stream->used = 0;
+  }
+  return stream->buffer[stream->used++];
+}
+
+// NOTE: Uniform in [0, 1)
+static inline float sfRandomFloat(RandomStream *stream) {
+  return (sfRandomU32(stream) >> 8) * (1.0f / 16777216.0f);
+}
+
+// NOTE: Uniform in (0, 1], safe to take the log of
+static inline float sfRandomFloatOpen(RandomStream *stream) {
+  return ((sfRandomU32(stream) >> 8) + 1) * (1.0f / 16777216.0f);
+}
+
+static inline float sfRandomRange(RandomStream *stream, float min, float max) {
+  return min + sfRandomFloat(stream) * (max - min);
+}
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+#include "arena.h"
+#include <glad/glad.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define RENDER_KEY_PROGRAM_SHIFT 48
+#define RENDER_KEY_TEXTURE_SHIFT 32
+#define RENDER_KEY_VAO_SHIFT 16
+#define RENDER_KEY_FIELD_MASK 0xffffull
+
+// NOTE: Issues the draw with the packet's program, texture and VAO bound
+typedef void (*RenderDraw)(void *data);
+
+/* NOTE:
+ * One draw and the state it needs. A texture of 0 means the draw samples
+ * nothing and leaves whatever is bound alone. The key only decides the order,
+ * binds compare the actual names, so names that collide in their 16 key bits
+ * merely sort together.
+ */
+typedef struct {
+  uint64_t key;
+  unsigned program;
+  unsigned texture;
+  unsigned vao;
+  RenderDraw draw;
+  void *data;
+} RenderPacket;
+
+/* NOTE:
+ * Packets are appended with an atomic counter, so any number of threads may
+ * submit between two `sfRenderQueueExecute` calls. Executing sorts by key,
+ * (program, texture, VAO, depth) from the most significant bits down, and
+ * binds only the state that differs from the previous packet. Executing must
+ * happen on the GL thread, after every submitter is done.
+ */
+typedef struct {
+  RenderPacket *packets;
+  RenderPacket *sorted;
+  unsigned capacity;
+  atomic_uint count;
+
+  // NOTE: Statistics of the last execute
+  unsigned drawCount;
+  unsigned droppedCount;
+  unsigned programBinds;
+  unsigned textureBinds;
+  unsigned vaoBinds;
+} RenderQueue;
+
+RenderQueue *sfRenderQueueArenaAlloc(Arena *arena, unsigned capacity);
+uint64_t sfRenderKey(unsigned program, unsigned texture, unsigned vao,
+                     float depth);
+void sfRenderQueueSubmit(RenderQueue *queue, unsigned program,
+                         unsigned texture, unsigned vao, float depth,
+                         RenderDraw draw, void *data);
+void sfRenderQueueSort(RenderQueue *queue);
+void sfRenderQueueExecute(RenderQueue *queue);
+
+#endif
@@ -1,14 +1,78 @@
 #include "math3d.h"
 #include <glad/glad.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#define MAX_SHADER_PROGRAMS 32
+#define MAX_PROGRAM_UNIFORMS 32
+#define MAX_UNIFORM_NAME 48
+#define CAMERA_UNIFORM_BINDING 0
+#define SHADER_CACHE_DIR ".shader_cache"
+#define SHADER_CACHE_VERSION 1
+
+/* NOTE:
+ * Active uniforms of a linked program, resolved once by `reflectProgram`.
+ * `sfProgramUniform` hands one out as a handle for the sfUniformSet*
+ * setters, which need no lookup. The last value written is kept, so setting
+ * an unchanged value costs no GL call.
+ */
+typedef struct {
+  uint32_t hash;
+  char name[MAX_UNIFORM_NAME];
+  GLint location;
+  unsigned char hasValue;
+  float value[4];
+} ProgramUniform;
+
+typedef struct {
+  GLuint program;
+  unsigned uniformCount;
+  ProgramUniform uniforms[MAX_PROGRAM_UNIFORMS];
+} ProgramReflection;
+
+/* NOTE:
+ * Linked programs are kept under SHADER_CACHE_DIR as
+ *   ShaderCacheHeader, binary[length]
+ * named after a hash of both sources and the GL vendor/renderer/version
+ * strings. Editing a shader or updating the driver changes the name, so a
+ * stale binary is never looked up, and one the driver rejects is recompiled.
+ */
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint32_t format;
+  uint32_t length;
+} ShaderCacheHeader;
+
+// NOTE: std140 layout of the `Camera` block shared by every program
+typedef struct {
+  m44 projection;
+  m44 view;
+  v4 position;
+} CameraUniforms;
+
 char *readShaderSource(const char *filepath);
 GLuint compileShader(const char *source, GLenum shaderType);
 int checkShaderCompilation(GLuint shader, const char *shaderTypeStr);
 int checkProgramLinking(GLuint program);
 GLuint createShaderProgram(const char *vertexPath, const char *fragmentPath);
+void reflectProgram(GLuint program);
+GLint sfUniformLocation(int program, const char *uniform);
+ProgramUniform *sfProgramUniform(int program, const char *uniform);
+
+unsigned sfCameraUniformsCreate();
+void sfCameraUniformsUpdate(unsigned ubo, const m44 *projection, const m44 *view,
+                            v3 position);
+
+void sfUniformSetI1(ProgramUniform *uniform, int i);
+void sfUniformSetM44(ProgramUniform *uniform, const m44 *m);
+void sfUniformSetFloat(ProgramUniform *uniform, float f);
+void sfUniformSetF2(ProgramUniform *uniform, float r, float g);
+void sfUniformSetF3(ProgramUniform *uniform, float r, float g, float b);
+void sfUniformSetF4(ProgramUniform *uniform, float r, float g, float b,
+                    float a);
 
 void setUniformI1(int program, const char *uniform, int i);
 void setUniformM44(int program, const char *uniform, const m44 *m);
@@ -16,3 +80,4 @@ void setUniformFloat(int program, const char *uniform, float f);
 void setUniformF3(int program, const char *uniform, float r, float g, float b);
 void setUniformF4(int program, const char *uniform, float r, float g, float b,
                   float a);
+void setUniformF2(int program, const char *uniform, float r, float g);
@@ -14,7 +14,7 @@ typedef struct {
 
 typedef struct {
   union {
-    Key keys[12];
+    Key keys[15];
     struct {
       Key moveLeft;
       Key moveRight;
@@ -31,6 +31,10 @@ typedef struct {
       Key toggleFly;
 
       Key debugStep;
+
+      Key togglePlayback;
+      Key scrubForward;
+      Key scrubBackward;
     };
   };
 } Keyboard;
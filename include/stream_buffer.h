@@ -0,0 +1,31 @@
+#ifndef STREAM_BUFFER_H
+#define STREAM_BUFFER_H
+#include "arena.h"
+#include "gl_extensions.h"
+#include <glad/glad.h>
+
+#define STREAM_BUFFER_FRAMES 3
+
+/* NOTE:
+ * Triple buffered, fenced ring of `STREAM_BUFFER_FRAMES` regions in a single
+ * buffer object. The CPU writes region `frame` while the GPU may still read
+ * the other two; a fence per region guards reuse. With buffer storage the
+ * whole ring is mapped once, persistently, otherwise each region is mapped
+ * unsynchronized for the frame and unmapped before drawing.
+ */
+typedef struct {
+  unsigned vbo;
+  GLsizeiptr regionSize;
+  unsigned frame;
+  unsigned char isPersistent;
+  unsigned char *mapped;
+  GLsync fences[STREAM_BUFFER_FRAMES];
+} StreamBuffer;
+
+StreamBuffer *sfStreamBufferArenaAlloc(Arena *arena, GLsizeiptr regionSize);
+void *sfStreamBufferBegin(StreamBuffer *buffer);
+void sfStreamBufferEnd(StreamBuffer *buffer);
+void sfStreamBufferFence(StreamBuffer *buffer);
+void sfStreamBufferDestroy(StreamBuffer *buffer);
+
+#endif
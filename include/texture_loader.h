@@ -0,0 +1,77 @@
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+#include "arena.h"
+#include <glad/glad.h>
+#include <pthread.h>
+#include <stddef.h>
+
+#define TEXTURE_LOADER_MAX_TEXTURES 64
+#define TEXTURE_LOADER_MAX_PATH 256
+#define TEXTURE_LOADER_MAX_LEVELS 16
+#define TEXTURE_LOADER_MAX_WORKERS 4
+// NOTE: Seconds per frame spent uploading, at least one level always goes
+#define TEXTURE_LOADER_FRAME_BUDGET 0.002
+
+typedef enum {
+  TEXTURE_QUEUED,
+  TEXTURE_DECODING,
+  TEXTURE_DECODED,
+  TEXTURE_UPLOADING,
+  TEXTURE_READY,
+  TEXTURE_FAILED
+} TextureState;
+
+typedef struct {
+  // NOTE: Valid from the request on. Holds a 1x1 placeholder until the
+  // image is uploaded, `width` and `height` describe whichever is current
+  unsigned id;
+  int width;
+  int height;
+  TextureState state;
+
+  char path[TEXTURE_LOADER_MAX_PATH];
+  GLint minFilter;
+  GLint magFilter;
+
+  // NOTE: Written by a worker while DECODING, read by the GL thread after.
+  // `pixels` holds the whole mip chain, level i at `levelOffsets[i]`
+  unsigned char *pixels;
+  int imageWidth;
+  int imageHeight;
+  int channels;
+  unsigned levelCount;
+  size_t levelOffsets[TEXTURE_LOADER_MAX_LEVELS];
+  // NOTE: Levels go up smallest first, each one widening the base level,
+  // so the texture stays complete and sharpens as it streams in
+  unsigned uploadedLevels;
+} AsyncTexture;
+
+/* NOTE:
+ * Images are decoded and their mips built on worker threads. The GL thread
+ * uploads finished levels through a pixel unpack buffer in
+ * `sfTextureLoaderUpdate`, for as long as the frame's budget allows, so
+ * startup does not wait on any of it.
+ */
+typedef struct {
+  AsyncTexture textures[TEXTURE_LOADER_MAX_TEXTURES];
+  unsigned textureCount;
+  unsigned pbo;
+
+  unsigned queue[TEXTURE_LOADER_MAX_TEXTURES];
+  unsigned queueHead;
+  unsigned queueCount;
+  unsigned char shouldQuit;
+
+  unsigned workerCount;
+  pthread_t workers[TEXTURE_LOADER_MAX_WORKERS];
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+} TextureLoader;
+
+TextureLoader *sfTextureLoaderArenaAlloc(Arena *arena);
+AsyncTexture *sfTextureLoaderLoad(TextureLoader *loader, const char *path,
+                                  GLint minFilter, GLint magFilter);
+unsigned sfTextureLoaderUpdate(TextureLoader *loader, double budget);
+void sfTextureLoaderDestroy(TextureLoader *loader);
+
+#endif
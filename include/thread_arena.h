@@ -0,0 +1,31 @@
+#ifndef THREAD_ARENA_H
+#define THREAD_ARENA_H
+#include "arena.h"
+
+#define THREAD_ARENA_MAX_THREADS 64
+// NOTE: Children start on their own cache line, so neighbouring threads
+// never write the same one
+#define THREAD_ARENA_ALIGNMENT 64
+
+/* NOTE:
+ * One child arena per `sfParallelFor` thread, carved from a parent once.
+ * A kernel only ever allocates from the child of the range it runs, so the
+ * fast path is a plain bump with no locks and no heap. Children are reset
+ * together, and `sfThreadArenasMerge` compacts what the threads wrote into
+ * one contiguous block, in range order. Children are never freed on their
+ * own, their memory belongs to the parent.
+ */
+typedef struct {
+  Arena threads[THREAD_ARENA_MAX_THREADS];
+  unsigned threadCount;
+} ThreadArenas;
+
+ThreadArenas *sfThreadArenasArenaAlloc(Arena *parent, size_t threadCapacity);
+Arena *sfThreadArena(ThreadArenas *arenas);
+void *sfThreadArenaBegin(Arena *arena, size_t alignment, size_t *capacity);
+void sfThreadArenaEnd(Arena *arena, const void *begin, size_t used);
+void sfThreadArenasReset(ThreadArenas *arenas);
+size_t sfThreadArenasMerge(const ThreadArenas *arenas, void *destination,
+                           size_t capacity);
+
+#endif
@@ -0,0 +1,137 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+#include "arena.h"
+#include "bodies.h"
+#include "math3d.h"
+#include "octree.h"
+#include <pthread.h>
+#include <stdint.h>
+
+#define TRAJECTORY_VERSION 1
+#define TRAJECTORY_QUANTIZATION_MAX 65535.0f
+#define TRAJECTORY_PREFETCH_CHUNKS 2
+#define TRAJECTORY_CACHE_SLOTS (TRAJECTORY_PREFETCH_CHUNKS + 1)
+
+/* NOTE:
+ * File layout:
+ *   TrajectoryHeader
+ *   chunk*: TrajectoryChunkHeader, TrajectoryFrameHeader[frameCount], payload
+ *
+ * Positions are quantized to 16 bits relative to each frame's
+ * `sfOctantContaining` bounds, velocities relative to the frame's largest
+ * velocity component. The first frame of a chunk is stored as is, the rest as
+ * deltas against the previous frame. Values are zigzag + varint encoded and
+ * runs of zeros are collapsed, so a chunk decodes on its own.
+ */
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint32_t bodyCount;
+  uint32_t stride;
+  uint32_t framesPerChunk;
+} TrajectoryHeader;
+
+typedef struct {
+  char magic[4];
+  uint32_t frameCount;
+  uint32_t payloadSize;
+} TrajectoryChunkHeader;
+
+typedef struct {
+  uint32_t step;
+  Octant bounds;
+  float velocityRange;
+} TrajectoryFrameHeader;
+
+typedef struct {
+  unsigned frameCount;
+  unsigned *steps;
+  v3 *positions;
+  v3 *velocities;
+} TrajectoryChunk;
+
+typedef struct {
+  FILE *file;
+  unsigned bodyCount;
+  unsigned stride;
+  unsigned framesPerChunk;
+
+  // NOTE: Double buffered, the step thread fills `chunks[active]` while the
+  // writer thread encodes and writes `chunks[pending]`
+  TrajectoryChunk chunks[2];
+  unsigned active;
+  int pending;
+  unsigned char shouldQuit;
+  // NOTE: Set by the writer thread on a short write, read after it joins
+  unsigned char hasFailed;
+
+  uint16_t *quantized;
+  uint16_t *previousQuantized;
+  TrajectoryFrameHeader *frameHeaders;
+  uint8_t *payload;
+  size_t payloadCapacity;
+
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+} TrajectoryWriter;
+
+typedef enum {
+  TRAJECTORY_SLOT_EMPTY,
+  TRAJECTORY_SLOT_DECODING,
+  TRAJECTORY_SLOT_READY
+} TrajectorySlotState;
+
+typedef struct {
+  TrajectorySlotState state;
+  unsigned chunk;
+  TrajectoryChunk frames;
+  uint16_t *quantized;
+  uint16_t *previousQuantized;
+} TrajectorySlot;
+
+typedef struct {
+  int fd;
+  const uint8_t *data;
+  size_t size;
+  TrajectoryHeader header;
+
+  unsigned frameCount;
+  unsigned chunkCount;
+  size_t *chunkOffsets;
+  unsigned *chunkFirstFrames;
+
+  // NOTE: Decoded chunks. The prefetch thread fills slots for the chunks
+  // ahead of `currentChunk`, the slot holding `currentChunk` is never evicted
+  TrajectorySlot slots[TRAJECTORY_CACHE_SLOTS];
+  unsigned currentChunk;
+  unsigned char shouldQuit;
+
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+} TrajectoryReader;
+
+TrajectoryWriter *sfTrajectoryWriterArenaAlloc(Arena *arena, const char *path,
+                                               unsigned bodyCount,
+                                               unsigned stride,
+                                               unsigned framesPerChunk);
+void sfTrajectoryWriterRecord(TrajectoryWriter *writer, unsigned step,
+                              const Bodies *bodies);
+unsigned char sfTrajectoryWriterClose(TrajectoryWriter *writer);
+
+TrajectoryReader *sfTrajectoryReaderArenaAlloc(Arena *arena, const char *path);
+unsigned sfTrajectoryReaderFrame(TrajectoryReader *reader, unsigned frame,
+                                 v3 *positions, v3 *velocities);
+void sfTrajectoryReaderClose(TrajectoryReader *reader);
+
+size_t sfTrajectoryEncode(const uint16_t *values, const uint16_t *previous,
+                          unsigned count, uint8_t *out);
+size_t sfTrajectoryDecode(const uint8_t *in, size_t inSize,
+                          const uint16_t *previous, unsigned count,
+                          uint16_t *values);
+void sfTrajectoryDequantize(const TrajectoryFrameHeader *header,
+                            const uint16_t *quantized, unsigned count,
+                            v3 *positions, v3 *velocities);
+
+#endif
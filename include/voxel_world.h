@@ -0,0 +1,104 @@
+#ifndef VOXEL_WORLD_H
+#define VOXEL_WORLD_H
+#include "arena.h"
+#include "culling.h"
+#include "math3d.h"
+#include "pool.h"
+#include "voxels.h"
+#include <glad/glad.h>
+#include <pthread.h>
+#include <stdint.h>
+
+// NOTE: One row of a chunk along x is one 32 bit mask
+#define VOXEL_WORLD_CHUNK_SIZE 32
+#define VOXEL_WORLD_PADDED_SIZE (VOXEL_WORLD_CHUNK_SIZE + 2)
+#define VOXEL_WORLD_MAX_WORKERS 4
+#define VOXEL_WORLD_VERTEX_FLOATS 5
+// NOTE: A 3D checkerboard, every solid voxel showing all six faces
+#define VOXEL_WORLD_MAX_QUADS                                                  \
+  (VOXEL_WORLD_CHUNK_SIZE * VOXEL_WORLD_CHUNK_SIZE * VOXEL_WORLD_CHUNK_SIZE * 3)
+#define VOXEL_WORLD_MESH_BLOCK_VERTICES 3072
+#define VOXEL_WORLD_MAX_MESH_BLOCKS                                            \
+  ((VOXEL_WORLD_MAX_QUADS * 6 + VOXEL_WORLD_MESH_BLOCK_VERTICES - 1) /         \
+   VOXEL_WORLD_MESH_BLOCK_VERTICES)
+
+typedef enum {
+  VOXEL_CHUNK_CLEAN,
+  VOXEL_CHUNK_DIRTY,
+  VOXEL_CHUNK_QUEUED,
+  VOXEL_CHUNK_MESHED
+} VoxelChunkState;
+
+// NOTE: Finished meshes are chains of these, in vertex order
+typedef struct {
+  PoolHandle next;
+  float vertices[VOXEL_WORLD_MESH_BLOCK_VERTICES * VOXEL_WORLD_VERTEX_FLOATS];
+} VoxelMeshBlock;
+
+typedef struct {
+  // NOTE: occupancy[z * CHUNK_SIZE + y], bit x
+  uint32_t occupancy[VOXEL_WORLD_CHUNK_SIZE * VOXEL_WORLD_CHUNK_SIZE];
+  VoxelChunkState state;
+  // NOTE: Edited while queued, remesh again once the stale mesh is uploaded
+  unsigned char isStale;
+
+  // NOTE: Owned by the worker while QUEUED, by the main thread otherwise.
+  // `snapshot` is the occupancy with a one voxel border from the neighbours,
+  // padded[z][y] with bit x + 1
+  uint64_t snapshot[VOXEL_WORLD_PADDED_SIZE * VOXEL_WORLD_PADDED_SIZE];
+  // NOTE: First block of the mesh awaiting upload, zeroed once uploaded
+  PoolHandle mesh;
+  unsigned vertexCount;
+
+  unsigned vao;
+  unsigned vbo;
+  unsigned uploadedCount;
+} VoxelWorldChunk;
+
+/* NOTE:
+ * Voxel world made of fixed size chunks with bitmask occupancy. Edited
+ * chunks are snapshotted by `sfVoxelWorldUpdate` and meshed on worker threads:
+ * faces between solid voxels are dropped and the remaining faces of each
+ * slice are greedily merged into quads. Finished meshes are uploaded on the
+ * next update, on the thread owning the GL context.
+ */
+typedef struct {
+  unsigned dimensions[3];
+  unsigned chunkCount;
+  v3 origin;
+  float voxelSize;
+  unsigned texture;
+  VoxelWorldChunk *chunks;
+  // NOTE: Shared by the workers and the GL thread, only touched with `mutex`
+  // held. Pages come from the world's arena
+  Pool *meshBlocks;
+
+  unsigned *queue;
+  unsigned queueHead;
+  unsigned queueCount;
+  unsigned char shouldQuit;
+
+  unsigned workerCount;
+  unsigned startedCount;
+  float *scratch[VOXEL_WORLD_MAX_WORKERS];
+  pthread_t workers[VOXEL_WORLD_MAX_WORKERS];
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+} VoxelWorld;
+
+VoxelWorld *sfVoxelWorldArenaAlloc(Arena *arena, unsigned chunksX,
+                                   unsigned chunksY, unsigned chunksZ,
+                                   v3 origin, float voxelSize);
+void sfVoxelWorldSet(VoxelWorld *world, unsigned x, unsigned y, unsigned z,
+                     unsigned char isSolid);
+void sfVoxelWorldInitFloor(VoxelWorld *world, unsigned width, unsigned depth);
+void sfVoxelWorldUpdate(VoxelWorld *world);
+void sfVoxelWorldRender(const VoxelWorld *world, const Frustum *frustum);
+void sfVoxelWorldSubmit(RenderQueue *queue, const VoxelWorld *world,
+                        unsigned program, const Frustum *frustum, v3 eye);
+void sfVoxelWorldDestroy(VoxelWorld *world);
+
+unsigned sfVoxelGreedyMesh(const uint64_t *padded, v3 origin, float voxelSize,
+                           float *vertices);
+
+#endif
@@ -1,8 +1,13 @@
 #ifndef VOXELS_H
 #define VOXELS_H
 #include "arena.h"
+#include "culling.h"
+#include "dirty_ranges.h"
 #include "math3d.h"
+#include "render_queue.h"
+#include "stream_buffer.h"
 #include <glad/glad.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -14,14 +19,47 @@ const static unsigned VERTEX_POSITION_LOCATION = 0;
 const static unsigned TEX_COORD_LOCATION = 1;
 const static unsigned INSTANCE_TRANSFORM_LOCATION = 2;
 const static unsigned INSTANCE_COLOR_LOCATION = 6;
+const static unsigned INSTANCE_COMPACT_LOCATION = 7;
+
+typedef enum {
+  // NOTE: Translate + uniform scale, the matrix is rebuilt in `voxels.vs`
+  VOXEL_INSTANCE_COMPACT,
+  // NOTE: Full model matrix, for instances that need rotation
+  VOXEL_INSTANCE_MATRIX
+} VoxelInstanceFormat;
+
+typedef struct {
+  v3 position;
+  float scale;
+} VoxelInstance;
 
 typedef struct {
   unsigned vao;
   unsigned vbo;
-  unsigned transformsVbo;
+  unsigned instancesVbo;
+  unsigned colorsVbo;
   unsigned count;
   unsigned texture;
+  VoxelInstanceFormat format;
+  // NOTE: Only the array matching `format` is allocated
+  VoxelInstance *instances;
   m44 *transforms;
+  // NOTE: Optional RGBA8 per instance, NULL if unused
+  uint32_t *colors;
+  // NOTE: Only these spans are uploaded by `sfRenderVoxels`. Writing the
+  // arrays directly requires a matching `sfVoxelsMarkDirty`
+  DirtyRanges instancesDirty;
+  DirtyRanges colorsDirty;
+
+  // NOTE: Culling state, NULL until `sfVoxelsEnableCulling`. Visible
+  // instances are gathered into the streams and drawn from `cullVao`
+  VoxelChunks *chunks;
+  Culler *culler;
+  StreamBuffer *visibleInstances;
+  StreamBuffer *visibleColors;
+  unsigned cullVao;
+  unsigned char areChunksStale;
+  unsigned char isCulled;
 } Voxels;
 
 /*
@@ -141,11 +179,24 @@ static v2 texCoords[VERTEX_COUNT] = {
 
 void __bufferInstanceData(Voxels *voxels);
 void __initBuffers(Voxels *voxels);
+void __setIdentityInstance(VoxelInstanceFormat format);
 
 void sfDestroyVoxels(Voxels *voxels);
-void sfVoxelInitFloorInstances(const Voxels *voxels);
-void sfRenderVoxels(const Voxels *voxels);
-void sfUpdateVoxelTransforms(Voxels *voxels, const v3 *positions);
+void sfVoxelInitFloorInstances(Voxels *voxels, Arena *scratch);
+void sfRenderVoxels(Voxels *voxels);
+void sfVoxelsSubmit(RenderQueue *queue, Voxels *voxels, unsigned program,
+                    float depth);
+void sfUpdateVoxelTransforms(Voxels *voxels,
+                             const transform_soa *transforms);
+void sfSetVoxelInstance(Voxels *voxels, unsigned index, v3 position,
+                        float scale);
+void sfSetVoxelColor(Voxels *voxels, unsigned index, uint32_t color);
+void sfVoxelsMarkDirty(Voxels *voxels, unsigned first, unsigned count);
+void sfVoxelsEnableCulling(Arena *arena, Voxels *voxels);
+unsigned sfCullVoxels(Voxels *voxels, const Frustum *frustum);
 
 Voxels *sfVoxelsArenaAlloc(Arena *arena, unsigned count);
+Voxels *sfVoxelsArenaAllocFormat(Arena *arena, unsigned count,
+                                 VoxelInstanceFormat format,
+                                 unsigned char hasColors);
 #endif
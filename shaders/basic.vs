@@ -3,8 +3,11 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in mat4 aInstanceModel;
 
-uniform mat4 projection;
-uniform mat4 view;
+layout (std140) uniform Camera {
+  mat4 projection;
+  mat4 view;
+  vec4 cameraPosition;
+};
 
 void main() {
   gl_Position = projection * view * aInstanceModel * vec4(aPos, 1.0);
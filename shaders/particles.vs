@@ -2,21 +2,27 @@
 
 layout (location = 0) in vec3 aPosition;
 layout (location = 1) in vec3 aVelocity;
+layout (location = 2) in float aWeight;
 
 out VS_OUT {
   float particleSize;
   vec3 velocity;
 } vs_out;
 
-uniform mat4 projection;
-uniform mat4 view;
-uniform vec3 cameraPos;
+layout (std140) uniform Camera {
+  mat4 projection;
+  mat4 view;
+  vec4 cameraPosition;
+};
 uniform int totalParticles;
 uniform float worldSize;
+// NOTE: Aggregates grow with the bodies they stand for, but never past the
+// size they were cut at
+uniform float lodPixels;
 
 float getParticleSize(){
     float baseSize = 1.0;  
-    float distanceFactor = length(cameraPos - aPosition);
+    float distanceFactor = length(cameraPosition.xyz - aPosition);
     float size = baseSize / distanceFactor;
     
     if(totalParticles < 1000) return max(size * worldSize, 3);
@@ -29,7 +35,8 @@ float getParticleSize(){
 
 void main() {
   gl_Position = projection * view * vec4(aPosition, 1.0);
-  gl_PointSize = getParticleSize();
+  float size = getParticleSize();
+  gl_PointSize = max(size, min(size * sqrt(aWeight), lodPixels));
   vs_out.velocity = aVelocity;
   vs_out.particleSize = gl_PointSize;
 }
@@ -10,8 +10,11 @@ out VS_OUT {
   flat int tileIndex;
 } vs_out;
 
-uniform mat4 projection;
-uniform mat4 view;
+layout (std140) uniform Camera {
+  mat4 projection;
+  mat4 view;
+  vec4 cameraPosition;
+};
 
 void main() {
   gl_Position = projection * view * aInstanceModel * vec4(aPos, 1.0);
@@ -4,17 +4,31 @@ layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec2 aTexCoord;
 layout (location = 2) in mat4 aInstanceModel;
 layout (location = 6) in vec4 aColor;
+layout (location = 7) in vec4 aInstance;
 
 out VS_OUT {
   vec4 color;
   vec2 texCoord;
 } vs_out;
 
-uniform mat4 projection;
-uniform mat4 view;
+layout (std140) uniform Camera {
+  mat4 projection;
+  mat4 view;
+  vec4 cameraPosition;
+};
+
+// NOTE: Only one of aInstanceModel / aInstance is fed per draw, the other is
+// held at its identity value by `sfRenderVoxels`
+mat4 instanceModel() {
+  mat4 compact = mat4(vec4(aInstance.w, 0.0, 0.0, 0.0),
+                      vec4(0.0, aInstance.w, 0.0, 0.0),
+                      vec4(0.0, 0.0, aInstance.w, 0.0),
+                      vec4(aInstance.xyz, 1.0));
+  return aInstanceModel * compact;
+}
 
 void main() {
-  gl_Position = projection * view * aInstanceModel * vec4(aPos, 1.0);
+  gl_Position = projection * view * instanceModel() * vec4(aPos, 1.0);
   vs_out.color = aColor;
   vs_out.texCoord = aTexCoord;
 }
@@ -1,5 +1,15 @@
-
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
 #include "arena.h"
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#ifdef ARENA_STATS
+static ArenaStats arenaStats[ARENA_STATS_MAX_ARENAS];
+static unsigned arenaStatsCount;
+#endif
 
 Arena sfArenaCreate(size_t blockSize, unsigned blockCount) {
   Arena arena = {0};
@@ -7,22 +17,272 @@ Arena sfArenaCreate(size_t blockSize, unsigned blockCount) {
   arena.baseMemory = calloc(blockSize, blockCount);
   arena.allocPosition = arena.baseMemory;
   arena.size = 0;
+  arena.committed = arena.capacity;
+  return arena;
+}
+
+// NOTE: The range is aligned to the commit granularity, so huge pages line
+// up with it. Untouched pages are never backed, reserving costs only
+// address space
+Arena sfArenaReserve(size_t capacity, unsigned flags) {
+  Arena arena = {0};
+  capacity = (capacity + ARENA_COMMIT_GRANULARITY - 1) &
+             ~(size_t)(ARENA_COMMIT_GRANULARITY - 1);
+
+  size_t mappedSize = capacity + ARENA_COMMIT_GRANULARITY;
+  void *mapped = mmap(NULL, mappedSize, PROT_NONE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (mapped == MAP_FAILED) {
+    fprintf(stderr, "ERROR: Failed to reserve %zu bytes for arena\n",
+            capacity);
+    return arena;
+  }
+
+  uintptr_t start = (uintptr_t)mapped;
+  uintptr_t base = (start + ARENA_COMMIT_GRANULARITY - 1) &
+                   ~(uintptr_t)(ARENA_COMMIT_GRANULARITY - 1);
+  if (base > start) {
+    munmap(mapped, base - start);
+  }
+  size_t tail = start + mappedSize - (base + capacity);
+  if (tail) {
+    munmap((void *)(base + capacity), tail);
+  }
+
+  arena.baseMemory = (void *)base;
+  arena.allocPosition = arena.baseMemory;
+  arena.capacity = capacity;
+  arena.flags = flags | ARENA_RESERVED;
   return arena;
 }
 
-void *sfArenaAlloc(Arena *arena, size_t size) {
-  size_t newArenaSize = arena->size + size;
-  if (newArenaSize > arena->capacity) {
+static int commit(Arena *arena, size_t size) {
+  size_t target = (size + ARENA_COMMIT_GRANULARITY - 1) &
+                  ~(size_t)(ARENA_COMMIT_GRANULARITY - 1);
+  if (target > arena->capacity) {
+    target = arena->capacity;
+  }
+  char *start = (char *)arena->baseMemory + arena->committed;
+  size_t length = target - arena->committed;
+
+  // NOTE: Mapping hugetlb pages up front fails cleanly when the pool is
+  // empty, faulting them in lazily would raise SIGBUS instead. They are
+  // mapped elsewhere and moved over the reservation, a failed MAP_FIXED
+  // would have unmapped it
+  if (arena->flags & ARENA_EXPLICIT_HUGE_PAGES) {
+    void *huge = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (huge != MAP_FAILED) {
+      if (mremap(huge, length, length, MREMAP_MAYMOVE | MREMAP_FIXED, start) !=
+          MAP_FAILED) {
+        arena->committed = target;
+        return 1;
+      }
+      munmap(huge, length);
+    }
+    arena->flags &= ~ARENA_EXPLICIT_HUGE_PAGES;
+    arena->flags |= ARENA_HUGE_PAGES;
+  }
+
+  if (mprotect(start, length, PROT_READ | PROT_WRITE)) {
+    return 0;
+  }
+  if (arena->flags & ARENA_HUGE_PAGES) {
+    madvise(start, length, MADV_HUGEPAGE);
+  }
+  arena->committed = target;
+  return 1;
+}
+
+#ifdef ARENA_STATS
+// NOTE: Sites are told apart by line first, the file string only breaks ties.
+// Once the table is full, new sites are pooled in the overflow entry past it
+static ArenaSite *findSite(ArenaStats *stats, const char *file,
+                           unsigned line) {
+  for (unsigned i = 0; i < stats->siteCount; ++i) {
+    ArenaSite *site = &stats->sites[i];
+    if (site->line == line &&
+        (site->file == file ||
+         (site->file && file && !strcmp(site->file, file)))) {
+      return site;
+    }
+  }
+  if (stats->siteCount == ARENA_STATS_MAX_SITES) {
+    return &stats->sites[ARENA_STATS_MAX_SITES];
+  }
+  ArenaSite *site = &stats->sites[stats->siteCount++];
+  site->file = file;
+  site->line = line;
+  return site;
+}
+
+static void record(Arena *arena, size_t size, size_t padding,
+                   const char *file, unsigned line) {
+  ArenaStats *stats = arena->stats;
+  stats->count++;
+  stats->bytes += size;
+  stats->padding += padding;
+  if (arena->size > stats->highWater) {
+    stats->highWater = arena->size;
+  }
+
+  ArenaSite *site = findSite(stats, file, line);
+  site->count++;
+  site->bytes += size;
+}
+#endif
+
+void *(sfArenaAlloc)(Arena *arena, size_t size) {
+  return sfArenaAllocAt(arena, size, ARENA_DEFAULT_ALIGNMENT, NULL, 0);
+}
+
+void *(sfArenaAllocAligned)(Arena *arena, size_t size, size_t alignment) {
+  return sfArenaAllocAt(arena, size, alignment, NULL, 0);
+}
+
+// NOTE: `alignment` must be a power of two. `file` and `line` name the caller
+// for the arena's statistics and are ignored without ARENA_STATS
+void *sfArenaAllocAt(Arena *arena, size_t size, size_t alignment,
+                     const char *file, unsigned line) {
+  uintptr_t position = (uintptr_t)arena->baseMemory + arena->size;
+  size_t padding = (alignment - (position & (alignment - 1))) & (alignment - 1);
+  if (padding + size > arena->capacity - arena->size) {
     fprintf(
         stderr,
-        "ERROR: Failed arena allocation. Capacity: %ld, requested size: %ld\n",
+        "ERROR: Failed arena allocation. Capacity: %zu, requested size: %zu\n",
         arena->capacity, size);
+#ifdef ARENA_STATS
+    if (arena->stats) {
+      arena->stats->failedCount++;
+    }
+#endif
+    return NULL;
+  }
+
+  if (padding + size > arena->committed - arena->size &&
+      !commit(arena, arena->size + padding + size)) {
+    fprintf(stderr, "ERROR: Failed to commit arena memory. Requested: %zu\n",
+            size);
+#ifdef ARENA_STATS
+    if (arena->stats) {
+      arena->stats->failedCount++;
+    }
+#endif
     return NULL;
   }
 
-  arena->allocPosition += newArenaSize;
-  arena->size = arena->allocPosition - arena->baseMemory;
-  return arena->allocPosition;
+  arena->size += padding;
+  void *memory = (char *)arena->baseMemory + arena->size;
+  arena->size += size;
+  arena->allocPosition = (char *)arena->baseMemory + arena->size;
+#ifdef ARENA_STATS
+  if (arena->stats) {
+    record(arena, size, padding, file, line);
+  }
+#else
+  (void)file;
+  (void)line;
+#endif
+  return memory;
+}
+
+ArenaMarker sfArenaMark(const Arena *arena) {
+  ArenaMarker marker = {arena->size};
+  return marker;
 }
 
-void sfArenaFree(Arena *arena) { free(arena->baseMemory); }
+// NOTE: Everything allocated since `marker` is released. The memory is not
+// cleared, unlike a fresh arena
+void sfArenaRestore(Arena *arena, ArenaMarker marker) {
+  arena->size = marker.size;
+  arena->allocPosition = (char *)arena->baseMemory + arena->size;
+}
+
+void sfArenaReset(Arena *arena) {
+  ArenaMarker start = {0};
+  sfArenaRestore(arena, start);
+}
+
+void sfArenaFree(Arena *arena) {
+  if (arena->flags & ARENA_RESERVED) {
+    munmap(arena->baseMemory, arena->capacity);
+  } else {
+    free(arena->baseMemory);
+  }
+}
+
+#ifdef ARENA_STATS
+static int compareSites(const void *a, const void *b) {
+  size_t bytesA = ((const ArenaSite *)a)->bytes;
+  size_t bytesB = ((const ArenaSite *)b)->bytes;
+  return (bytesA < bytesB) - (bytesA > bytesB);
+}
+
+static void reportAtExit() { sfArenaReport(stderr); }
+#endif
+
+// NOTE: Starts keeping statistics for `arena` under `name`, tagging it again
+// only renames it. The first tag also schedules a report at exit. Without
+// ARENA_STATS this does nothing
+void sfArenaTag(Arena *arena, const char *name) {
+#ifdef ARENA_STATS
+  if (!arena->stats) {
+    if (arenaStatsCount == ARENA_STATS_MAX_ARENAS) {
+      fprintf(stderr, "ERROR: Too many tagged arenas, %s is not tracked\n",
+              name);
+      return;
+    }
+    if (!arenaStatsCount) {
+      atexit(reportAtExit);
+    }
+    arena->stats = &arenaStats[arenaStatsCount++];
+    arena->stats->highWater = arena->size;
+  }
+  snprintf(arena->stats->name, ARENA_STATS_MAX_NAME, "%s", name);
+  arena->stats->capacity = arena->capacity;
+#else
+  (void)arena;
+  (void)name;
+#endif
+}
+
+// NOTE: Statistics outlive their arena, so freed arenas are still reported
+void sfArenaReport(FILE *stream) {
+#ifdef ARENA_STATS
+  fprintf(stream, "Arena report\n");
+  for (unsigned i = 0; i < arenaStatsCount; ++i) {
+    const ArenaStats *stats = &arenaStats[i];
+    fprintf(stream,
+            "  %s: high water %zu of %zu bytes (%.2f%%), %zu allocations, "
+            "%zu bytes requested, %zu bytes of alignment padding",
+            stats->name, stats->highWater, stats->capacity,
+            stats->capacity ? 100.0 * stats->highWater / stats->capacity : 0.0,
+            stats->count, stats->bytes, stats->padding);
+    if (stats->failedCount) {
+      fprintf(stream, ", %zu failed", stats->failedCount);
+    }
+    fprintf(stream, "\n");
+
+    ArenaSite sites[ARENA_STATS_MAX_SITES];
+    memcpy(sites, stats->sites, stats->siteCount * sizeof(ArenaSite));
+    qsort(sites, stats->siteCount, sizeof(ArenaSite), compareSites);
+    for (unsigned j = 0; j < stats->siteCount; ++j) {
+      const ArenaSite *site = &sites[j];
+      if (site->file) {
+        fprintf(stream, "    %s:%u", site->file, site->line);
+      } else {
+        fprintf(stream, "    (unknown)");
+      }
+      fprintf(stream, ": %zu bytes in %zu allocations\n", site->bytes,
+              site->count);
+    }
+    const ArenaSite *other = &stats->sites[ARENA_STATS_MAX_SITES];
+    if (other->count) {
+      fprintf(stream, "    (other): %zu bytes in %zu allocations\n",
+              other->bytes, other->count);
+    }
+  }
+#else
+  fprintf(stream, "Arena report needs a build with ARENA_STATS\n");
+#endif
+}
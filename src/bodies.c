@@ -0,0 +1,129 @@
+#include "bodies.h"
+#include <stdint.h>
+#include <string.h>
+
+float *sfFloatsArenaAllocAligned(Arena *arena, unsigned count) {
+  uint8_t *memory = (uint8_t *)sfArenaAlloc(
+      arena, sizeof(float) * count + BODIES_ALIGNMENT - 1);
+  if (!memory) {
+    return NULL;
+  }
+
+  uintptr_t address = (uintptr_t)memory;
+  address = (address + BODIES_ALIGNMENT - 1) & ~(uintptr_t)(BODIES_ALIGNMENT - 1);
+  float *floats = (float *)address;
+  memset(floats, 0, sizeof(float) * count);
+  return floats;
+}
+
+Bodies *sfBodiesArenaAlloc(Arena *arena, unsigned count) {
+  Bodies *bodies = (Bodies *)sfArenaAlloc(arena, sizeof(Bodies));
+  bodies->count = count;
+  bodies->capacity =
+      (count + BODIES_SIMD_WIDTH - 1) / BODIES_SIMD_WIDTH * BODIES_SIMD_WIDTH;
+
+  unsigned capacity = bodies->capacity;
+  bodies->masses = sfFloatsArenaAllocAligned(arena, capacity);
+  bodies->sizes = sfFloatsArenaAllocAligned(arena, capacity);
+  bodies->positionsX = sfFloatsArenaAllocAligned(arena, capacity);
+  bodies->positionsY = sfFloatsArenaAllocAligned(arena, capacity);
+  bodies->positionsZ = sfFloatsArenaAllocAligned(arena, capacity);
+  bodies->velocitiesX = sfFloatsArenaAllocAligned(arena, capacity);
+  bodies->velocitiesY = sfFloatsArenaAllocAligned(arena, capacity);
+  bodies->velocitiesZ = sfFloatsArenaAllocAligned(arena, capacity);
+  bodies->accelerationsX = sfFloatsArenaAllocAligned(arena, capacity);
+  bodies->accelerationsY = sfFloatsArenaAllocAligned(arena, capacity);
+  bodies->accelerationsZ = sfFloatsArenaAllocAligned(arena, capacity);
+
+  for (int i = 0; i < bodies->count; ++i) {
+    bodies->sizes[i] = 1.0f;
+  }
+
+  return bodies;
+}
+
+void sfBodiesGatherPositions(const Bodies *bodies, v3 *positions) {
+  for (unsigned i = 0; i < bodies->count; ++i) {
+    positions[i] = sfBodiesPosition(bodies, i);
+  }
+}
+
+void sfBodiesGatherVelocities(const Bodies *bodies, v3 *velocities) {
+  for (unsigned i = 0; i < bodies->count; ++i) {
+    velocities[i] = sfBodiesVelocity(bodies, i);
+  }
+}
+
+// NOTE: Kept apart so the restrict qualifiers let the compiler vectorize it
+static void integrateKernel(float *restrict px, float *restrict py,
+                            float *restrict pz, float *restrict vx,
+                            float *restrict vy, float *restrict vz,
+                            float *restrict ax, float *restrict ay,
+                            float *restrict az, unsigned first, unsigned end,
+                            float dt) {
+  for (unsigned i = first; i < end; ++i) {
+    vx[i] += ax[i] * dt;
+    vy[i] += ay[i] * dt;
+    vz[i] += az[i] * dt;
+
+    px[i] += vx[i] * dt;
+    py[i] += vy[i] * dt;
+    pz[i] += vz[i] * dt;
+
+    ax[i] = 0.0f;
+    ay[i] = 0.0f;
+    az[i] = 0.0f;
+  }
+}
+
+void sfBodiesIntegrate(Bodies *bodies, unsigned first, float dt) {
+  integrateKernel(bodies->positionsX, bodies->positionsY, bodies->positionsZ,
+                  bodies->velocitiesX, bodies->velocitiesY,
+                  bodies->velocitiesZ, bodies->accelerationsX,
+                  bodies->accelerationsY, bodies->accelerationsZ, first,
+                  bodies->count, dt);
+}
+
+// NOTE: Same sweep as `integrateKernel`, also writing the interleaved result
+// to (write-combined) GPU memory so no separate copy pass is needed
+static void integrateStreamKernel(
+    float *restrict px, float *restrict py, float *restrict pz,
+    float *restrict vx, float *restrict vy, float *restrict vz,
+    float *restrict ax, float *restrict ay, float *restrict az,
+    unsigned first, unsigned end, float dt, v3 *restrict positionsOut,
+    v3 *restrict velocitiesOut) {
+  for (unsigned i = first; i < end; ++i) {
+    vx[i] += ax[i] * dt;
+    vy[i] += ay[i] * dt;
+    vz[i] += az[i] * dt;
+
+    px[i] += vx[i] * dt;
+    py[i] += vy[i] * dt;
+    pz[i] += vz[i] * dt;
+
+    ax[i] = 0.0f;
+    ay[i] = 0.0f;
+    az[i] = 0.0f;
+
+    positionsOut[i].x = px[i];
+    positionsOut[i].y = py[i];
+    positionsOut[i].z = pz[i];
+    velocitiesOut[i].x = vx[i];
+    velocitiesOut[i].y = vy[i];
+    velocitiesOut[i].z = vz[i];
+  }
+}
+
+void sfBodiesIntegrateStream(Bodies *bodies, unsigned first, float dt,
+                             v3 *positionsOut, v3 *velocitiesOut) {
+  for (unsigned i = 0; i < first && i < bodies->count; ++i) {
+    positionsOut[i] = sfBodiesPosition(bodies, i);
+    velocitiesOut[i] = sfBodiesVelocity(bodies, i);
+  }
+
+  integrateStreamKernel(
+      bodies->positionsX, bodies->positionsY, bodies->positionsZ,
+      bodies->velocitiesX, bodies->velocitiesY, bodies->velocitiesZ,
+      bodies->accelerationsX, bodies->accelerationsY, bodies->accelerationsZ,
+      first, bodies->count, dt, positionsOut, velocitiesOut);
+}
@@ -0,0 +1,543 @@
+#include "culling.h"
+#include "parallel.h"
+#include <math.h>
+
+static v4 frustumPlane(v4 row, v4 clip, float sign) {
+  v4 plane = v4_make(row.x + sign * clip.x, row.y + sign * clip.y,
+                     row.z + sign * clip.z, row.w + sign * clip.w);
+  float length =
+      sqrtf(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z);
+  if (length > 0.0f) {
+    plane = v4_make(plane.x / length, plane.y / length, plane.z / length,
+                    plane.w / length);
+  }
+  return plane;
+}
+
+// NOTE: Gribb & Hartmann. Matrices are stored row-vector style, so the
+// combined transform is view * projection and its columns are the clip rows
+Frustum sfFrustumFromViewProjection(const m44 *view, const m44 *projection) {
+  m44 m = m44_mul(view, projection);
+  v4 rows[4];
+  for (int j = 0; j < 4; ++j) {
+    rows[j] = v4_make(m.v[0].v[j], m.v[1].v[j], m.v[2].v[j], m.v[3].v[j]);
+  }
+
+  Frustum frustum;
+  for (int axis = 0; axis < 3; ++axis) {
+    frustum.planes[axis * 2 + 0] = frustumPlane(rows[3], rows[axis], 1.0f);
+    frustum.planes[axis * 2 + 1] = frustumPlane(rows[3], rows[axis], -1.0f);
+  }
+  return frustum;
+}
+
+CullResult sfFrustumTestBox(const Frustum *frustum, v3 min, v3 max) {
+  v3 center = v3_scale(v3_add(min, max), 0.5f);
+  v3 extent = v3_scale(v3_sub(max, min), 0.5f);
+  CullResult result = CULL_INSIDE;
+  for (int i = 0; i < 6; ++i) {
+    const v4 *plane = &frustum->planes[i];
+    float distance = plane->x * center.x + plane->y * center.y +
+                     plane->z * center.z + plane->w;
+    float radius = extent.x * fabsf(plane->x) + extent.y * fabsf(plane->y) +
+                   extent.z * fabsf(plane->z);
+    if (distance < -radius) {
+      return CULL_OUTSIDE;
+    }
+    if (distance < radius) {
+      result = CULL_INTERSECT;
+    }
+  }
+  return result;
+}
+
+CullResult sfFrustumTestSphere(const Frustum *frustum, v3 center,
+                               float radius) {
+  CullResult result = CULL_INSIDE;
+  for (int i = 0; i < 6; ++i) {
+    const v4 *plane = &frustum->planes[i];
+    float distance = plane->x * center.x + plane->y * center.y +
+                     plane->z * center.z + plane->w;
+    if (distance < -radius) {
+      return CULL_OUTSIDE;
+    }
+    if (distance < radius) {
+      result = CULL_INTERSECT;
+    }
+  }
+  return result;
+}
+
+// NOTE: Returns NULL and leaves `arena` untouched when it is too small
+Culler *sfCullerArenaAlloc(Arena *arena, unsigned capacity) {
+  ArenaMarker marker = sfArenaMark(arena);
+  Culler *culler = (Culler *)sfArenaAlloc(arena, sizeof(Culler));
+  if (!culler) {
+    return NULL;
+  }
+  culler->capacity = capacity;
+  culler->visibleCount = 0;
+  culler->itemCount = 0;
+  culler->margin = 1.0f;
+  culler->lodEye = v3_0();
+  culler->lodPixelsPerUnit = 0.0f;
+  culler->lodPixels = 0.0f;
+  culler->visible = (unsigned *)sfArenaAlloc(arena, sizeof(unsigned) * capacity);
+  culler->items =
+      (unsigned *)sfArenaAlloc(arena, sizeof(unsigned) * CULL_MAX_ITEMS);
+  culler->itemsInside = (unsigned char *)sfArenaAlloc(
+      arena, sizeof(unsigned char) * CULL_MAX_ITEMS);
+  culler->threadArenas =
+      sfThreadArenasArenaAlloc(arena, sizeof(unsigned) * capacity);
+  if (!culler->visible || !culler->items || !culler->itemsInside ||
+      !culler->threadArenas) {
+    sfArenaRestore(arena, marker);
+    return NULL;
+  }
+  return culler;
+}
+
+// NOTE: `projection->by` is cot(fovy / 2), so a unit at distance 1 covers
+// by * height / 2 pixels
+void sfCullerSetLOD(Culler *culler, v3 eye, const m44 *projection,
+                    float viewportHeight, float pixels) {
+  culler->lodEye = eye;
+  culler->lodPixelsPerUnit =
+      pixels > 0.0f ? projection->by * viewportHeight * 0.5f : 0.0f;
+  culler->lodPixels = pixels;
+}
+
+// NOTE: Projected edge length of the node's octant against the threshold,
+// both sides multiplied by the distance to avoid the division
+static int isBelowLOD(const Culler *culler, const Octree *octree,
+                      unsigned node) {
+  if (culler->lodPixelsPerUnit <= 0.0f) {
+    return 0;
+  }
+  v3 d = v3_sub(octree->positions[node], culler->lodEye);
+  float distanceSquared = v3_dot(d, d);
+  float projected = octree->octants[node].size * culler->lodPixelsPerUnit;
+  return projected * projected <
+         culler->lodPixels * culler->lodPixels * distanceSquared;
+}
+
+// NOTE: Compacts the threads' visible lists into `visible`
+static void cullerMerge(Culler *culler) {
+  culler->visibleCount =
+      sfThreadArenasMerge(culler->threadArenas, culler->visible,
+                          sizeof(unsigned) * culler->capacity) /
+      sizeof(unsigned);
+}
+
+static CullResult cullOctreeNode(const Culler *culler, const Octree *octree,
+                                 const Frustum *frustum, unsigned node) {
+  const Octant *octant = &octree->octants[node];
+  float half = octant->size * 0.5f + culler->margin;
+  v3 extent = v3_make(half, half, half);
+  return sfFrustumTestBox(frustum, v3_sub(octant->center, extent),
+                          v3_add(octant->center, extent));
+}
+
+static int isEmptyLeaf(const Octree *octree, unsigned node) {
+  return octree->children[node] == 0 &&
+         octree->bodies[node] == OCTREE_NO_BODY;
+}
+
+// NOTE: Breadth first until there is enough independent work, nodes fully
+// outside are dropped and nodes fully inside stop splitting
+static void cullOctreeFrontier(Culler *culler, const Octree *octree,
+                               const Frustum *frustum) {
+  unsigned target = sfParallelThreadCount() * CULL_MIN_ITEMS_PER_THREAD;
+
+  culler->itemCount = 0;
+  CullResult rootResult = cullOctreeNode(culler, octree, frustum, 0);
+  if (rootResult == CULL_OUTSIDE || isEmptyLeaf(octree, 0)) {
+    return;
+  }
+  culler->items[0] = 0;
+  culler->itemsInside[0] = rootResult == CULL_INSIDE;
+  culler->itemCount = 1;
+
+  unsigned char hasSplit = 1;
+  while (hasSplit && culler->itemCount < target) {
+    hasSplit = 0;
+    unsigned count = culler->itemCount;
+    for (unsigned i = 0; i < count; ++i) {
+      unsigned node = culler->items[i];
+      if (culler->itemsInside[i] || octree->children[node] == 0 ||
+          isBelowLOD(culler, octree, node) ||
+          culler->itemCount + 7 > CULL_MAX_ITEMS) {
+        continue;
+      }
+
+      // NOTE: The first surviving child takes the parent's slot, an item
+      // with none left is marked and compacted below
+      unsigned slot = i;
+      culler->items[i] = OCTREE_NO_BODY;
+      unsigned children = octree->children[node];
+      for (unsigned j = 0; j < 8; ++j) {
+        unsigned child = children + j;
+        if (isEmptyLeaf(octree, child)) {
+          continue;
+        }
+        CullResult result = cullOctreeNode(culler, octree, frustum, child);
+        if (result == CULL_OUTSIDE) {
+          continue;
+        }
+        culler->items[slot] = child;
+        culler->itemsInside[slot] = result == CULL_INSIDE;
+        slot = culler->itemCount++;
+      }
+      // NOTE: One slot too many was claimed after the last survivor
+      if (slot != i) {
+        culler->itemCount--;
+      }
+      hasSplit = 1;
+    }
+
+    unsigned kept = 0;
+    for (unsigned i = 0; i < culler->itemCount; ++i) {
+      if (culler->items[i] != OCTREE_NO_BODY) {
+        culler->items[kept] = culler->items[i];
+        culler->itemsInside[kept] = culler->itemsInside[i];
+        ++kept;
+      }
+    }
+    culler->itemCount = kept;
+  }
+}
+
+typedef struct {
+  Culler *culler;
+  const Octree *octree;
+  const Bodies *bodies;
+  const Frustum *frustum;
+} CullOctreeContext;
+
+// NOTE: Walks [root, nexts[root]) using the skip pointers, subtrees fully
+// inside the frustum are emitted without further tests. Stops once `out`
+// holds `capacity` entries
+static unsigned cullOctreeSubtree(const CullOctreeContext *ctx, unsigned root,
+                                  unsigned char isInside, unsigned *out,
+                                  unsigned capacity) {
+  const Octree *octree = ctx->octree;
+  const Bodies *bodies = ctx->bodies;
+  unsigned end = octree->nexts[root];
+  unsigned char inside = isInside;
+  unsigned insideEnd = end;
+  unsigned count = 0;
+  unsigned node = root;
+
+  do {
+    if (count == capacity) {
+      break;
+    }
+    if (inside && node == insideEnd) {
+      inside = 0;
+    }
+
+    if (octree->children[node] == 0) {
+      // NOTE: Coincident bodies share the leaf, one test covers them all
+      unsigned body = octree->bodies[node];
+      if (body != OCTREE_NO_BODY &&
+          (inside ||
+           sfFrustumTestSphere(ctx->frustum, sfBodiesPosition(bodies, body),
+                               ctx->culler->margin) != CULL_OUTSIDE)) {
+        for (; body != OCTREE_NO_BODY && count < capacity;
+             body = octree->bodyNexts[body]) {
+          out[count++] = body;
+        }
+      }
+      node = octree->nexts[node];
+      continue;
+    }
+
+    if (isBelowLOD(ctx->culler, octree, node) &&
+        (inside || cullOctreeNode(ctx->culler, octree, ctx->frustum, node) !=
+                       CULL_OUTSIDE)) {
+      out[count++] = node | CULL_AGGREGATE_BIT;
+      node = octree->nexts[node];
+      continue;
+    }
+
+    if (!inside) {
+      CullResult result =
+          cullOctreeNode(ctx->culler, octree, ctx->frustum, node);
+      if (result == CULL_OUTSIDE) {
+        node = octree->nexts[node];
+        continue;
+      }
+      if (result == CULL_INSIDE) {
+        inside = 1;
+        insideEnd = octree->nexts[node];
+      }
+    }
+    node = octree->children[node];
+  } while (node != end);
+
+  return count;
+}
+
+static void cullOctreeKernel(void *context, unsigned begin, unsigned end) {
+  CullOctreeContext *ctx = (CullOctreeContext *)context;
+  Culler *culler = ctx->culler;
+  Arena *scratch = sfThreadArena(culler->threadArenas);
+  size_t bytes;
+  unsigned *out =
+      (unsigned *)sfThreadArenaBegin(scratch, sizeof(unsigned), &bytes);
+  unsigned capacity = (unsigned)(bytes / sizeof(unsigned));
+  unsigned count = 0;
+  for (unsigned i = begin; i < end && count < capacity; ++i) {
+    count += cullOctreeSubtree(ctx, culler->items[i], culler->itemsInside[i],
+                               out + count, capacity - count);
+  }
+  sfThreadArenaEnd(scratch, out, sizeof(unsigned) * count);
+}
+
+unsigned sfCullOctree(Culler *culler, const Octree *octree,
+                      const Bodies *bodies, const Frustum *frustum) {
+  cullOctreeFrontier(culler, octree, frustum);
+
+  sfThreadArenasReset(culler->threadArenas);
+  CullOctreeContext context = {culler, octree, bodies, frustum};
+  sfParallelFor(culler->itemCount, 1, cullOctreeKernel, &context);
+  cullerMerge(culler);
+  return culler->visibleCount;
+}
+
+typedef struct {
+  const Culler *culler;
+  const Octree *octree;
+  const Bodies *bodies;
+  v3 *positions;
+  v3 *velocities;
+  float *weights;
+  float weightScale;
+} GatherBodiesContext;
+
+// NOTE: Aggregates take the velocity of the heaviest body down one path, a
+// cheap stand in that keeps the coloring by speed plausible
+static unsigned representativeBody(const Octree *octree, unsigned node) {
+  while (octree->children[node] != 0) {
+    unsigned children = octree->children[node];
+    unsigned heaviest = children;
+    for (unsigned j = 1; j < 8; ++j) {
+      if (octree->masses[children + j] > octree->masses[heaviest]) {
+        heaviest = children + j;
+      }
+    }
+    node = heaviest;
+  }
+  return octree->bodies[node];
+}
+
+static void gatherBodiesKernel(void *context, unsigned begin, unsigned end) {
+  GatherBodiesContext *ctx = (GatherBodiesContext *)context;
+  const Octree *octree = ctx->octree;
+  const Bodies *bodies = ctx->bodies;
+  for (unsigned i = begin; i < end; ++i) {
+    unsigned entry = ctx->culler->visible[i];
+    if (!(entry & CULL_AGGREGATE_BIT)) {
+      ctx->positions[i] = sfBodiesPosition(bodies, entry);
+      ctx->velocities[i] = sfBodiesVelocity(bodies, entry);
+      if (ctx->weights) {
+        ctx->weights[i] = bodies->masses[entry] * ctx->weightScale;
+      }
+      continue;
+    }
+
+    unsigned node = entry & ~CULL_AGGREGATE_BIT;
+    unsigned body = representativeBody(octree, node);
+    ctx->positions[i] = octree->positions[node];
+    ctx->velocities[i] =
+        body != OCTREE_NO_BODY ? sfBodiesVelocity(bodies, body) : v3_0();
+    if (ctx->weights) {
+      ctx->weights[i] = octree->masses[node] * ctx->weightScale;
+    }
+  }
+}
+
+// NOTE: Weights are masses relative to the mean body mass, so a lone body
+// is about 1 and an aggregate about the number of bodies it stands for
+void sfCullerGatherBodies(const Culler *culler, const Octree *octree,
+                          const Bodies *bodies, v3 *positions, v3 *velocities,
+                          float *weights) {
+  float totalMass = octree->masses[0];
+  float weightScale =
+      totalMass > 0.0f ? (float)bodies->count / totalMass : 1.0f;
+  GatherBodiesContext context = {culler,     octree,  bodies,     positions,
+                                 velocities, weights, weightScale};
+  sfParallelFor(culler->visibleCount, CULL_GATHER_MIN_BATCH,
+                gatherBodiesKernel, &context);
+}
+
+VoxelChunks *sfVoxelChunksArenaAlloc(Arena *arena, unsigned instanceCount) {
+  VoxelChunks *chunks = (VoxelChunks *)sfArenaAlloc(arena, sizeof(VoxelChunks));
+  chunks->chunkSize = VOXEL_CHUNK_SIZE;
+  chunks->chunkCount = 0;
+  chunks->instanceCount = 0;
+  chunks->mins = sfV3ArenaAlloc(arena, VOXEL_MAX_CHUNKS);
+  chunks->maxs = sfV3ArenaAlloc(arena, VOXEL_MAX_CHUNKS);
+  chunks->firsts =
+      (unsigned *)sfArenaAlloc(arena, sizeof(unsigned) * VOXEL_MAX_CHUNKS);
+  chunks->counts =
+      (unsigned *)sfArenaAlloc(arena, sizeof(unsigned) * VOXEL_MAX_CHUNKS);
+  chunks->order =
+      (unsigned *)sfArenaAlloc(arena, sizeof(unsigned) * instanceCount);
+  chunks->cells =
+      (unsigned *)sfArenaAlloc(arena, sizeof(unsigned) * instanceCount);
+  chunks->centers = sfV3ArenaAlloc(arena, instanceCount);
+  chunks->radii = (float *)sfArenaAlloc(arena, sizeof(float) * instanceCount);
+  return chunks;
+}
+
+// NOTE: Counting sort of the instances by grid cell, the chunk size grows
+// until the grid fits in `VOXEL_MAX_CHUNKS` cells
+void sfVoxelChunksBuild(VoxelChunks *chunks, unsigned count) {
+  chunks->instanceCount = count;
+  chunks->chunkCount = 0;
+  if (!count) {
+    return;
+  }
+
+  v3 origin = v3_make(FLT_MAX, FLT_MAX, FLT_MAX);
+  v3 extent = v3_make(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+  for (unsigned i = 0; i < count; ++i) {
+    v3 center = chunks->centers[i];
+    origin = v3_make(fminf(origin.x, center.x), fminf(origin.y, center.y),
+                     fminf(origin.z, center.z));
+    extent = v3_make(fmaxf(extent.x, center.x), fmaxf(extent.y, center.y),
+                     fmaxf(extent.z, center.z));
+  }
+  extent = v3_sub(extent, origin);
+
+  // NOTE: Per axis, so flat content like the floor gets flat grids
+  float chunkSize = VOXEL_CHUNK_SIZE;
+  unsigned dimensions[3];
+  while (1) {
+    for (int axis = 0; axis < 3; ++axis) {
+      dimensions[axis] = (unsigned)(extent.v[axis] / chunkSize) + 1;
+    }
+    if (dimensions[0] * dimensions[1] * dimensions[2] <= VOXEL_MAX_CHUNKS) {
+      break;
+    }
+    chunkSize *= 2.0f;
+  }
+  chunks->chunkSize = chunkSize;
+
+  unsigned cellCount = dimensions[0] * dimensions[1] * dimensions[2];
+  unsigned *cellCounts = chunks->counts;
+  memset(cellCounts, 0, sizeof(unsigned) * cellCount);
+
+  for (unsigned i = 0; i < count; ++i) {
+    v3 local = v3_sub(chunks->centers[i], origin);
+    unsigned cell = 0;
+    for (int axis = 2; axis >= 0; --axis) {
+      unsigned coordinate =
+          (unsigned)fminf(fmaxf(local.v[axis] / chunkSize, 0.0f),
+                          (float)(dimensions[axis] - 1));
+      cell = cell * dimensions[axis] + coordinate;
+    }
+    chunks->cells[i] = cell;
+    cellCounts[cell]++;
+  }
+
+  // NOTE: Compact to the occupied cells, reusing `firsts` as the cell to
+  // chunk map while scattering
+  unsigned offset = 0;
+  unsigned *cellChunks = chunks->firsts;
+  for (unsigned cell = 0; cell < cellCount; ++cell) {
+    cellChunks[cell] = offset;
+    offset += cellCounts[cell];
+  }
+
+  for (unsigned i = 0; i < count; ++i) {
+    chunks->order[cellChunks[chunks->cells[i]]++] = i;
+  }
+
+  unsigned first = 0;
+  for (unsigned cell = 0; cell < cellCount; ++cell) {
+    unsigned occupancy = cellCounts[cell];
+    if (!occupancy) {
+      continue;
+    }
+
+    unsigned chunk = chunks->chunkCount++;
+    v3 min = v3_make(FLT_MAX, FLT_MAX, FLT_MAX);
+    v3 max = v3_make(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    for (unsigned k = first; k < first + occupancy; ++k) {
+      unsigned i = chunks->order[k];
+      v3 center = chunks->centers[i];
+      float radius = chunks->radii[i];
+      min = v3_make(fminf(min.x, center.x - radius),
+                    fminf(min.y, center.y - radius),
+                    fminf(min.z, center.z - radius));
+      max = v3_make(fmaxf(max.x, center.x + radius),
+                    fmaxf(max.y, center.y + radius),
+                    fmaxf(max.z, center.z + radius));
+    }
+    // NOTE: chunk <= cell, so these never overwrite unread counts
+    chunks->mins[chunk] = min;
+    chunks->maxs[chunk] = max;
+    chunks->firsts[chunk] = first;
+    chunks->counts[chunk] = occupancy;
+    first += occupancy;
+  }
+}
+
+typedef struct {
+  Culler *culler;
+  const VoxelChunks *chunks;
+  const Frustum *frustum;
+} CullVoxelsContext;
+
+static void cullVoxelsKernel(void *context, unsigned begin, unsigned end) {
+  CullVoxelsContext *ctx = (CullVoxelsContext *)context;
+  Culler *culler = ctx->culler;
+  const VoxelChunks *chunks = ctx->chunks;
+  Arena *scratch = sfThreadArena(culler->threadArenas);
+  size_t bytes;
+  unsigned *out =
+      (unsigned *)sfThreadArenaBegin(scratch, sizeof(unsigned), &bytes);
+  unsigned capacity = (unsigned)(bytes / sizeof(unsigned));
+  unsigned count = 0;
+  for (unsigned item = begin; item < end; ++item) {
+    unsigned chunk = culler->items[item];
+    unsigned first = chunks->firsts[chunk];
+    unsigned last = first + chunks->counts[chunk];
+
+    for (unsigned k = first; k < last && count < capacity; ++k) {
+      unsigned i = chunks->order[k];
+      if (culler->itemsInside[item] ||
+          sfFrustumTestSphere(ctx->frustum, chunks->centers[i],
+                              chunks->radii[i] + culler->margin) !=
+              CULL_OUTSIDE) {
+        out[count++] = i;
+      }
+    }
+  }
+  sfThreadArenaEnd(scratch, out, sizeof(unsigned) * count);
+}
+
+unsigned sfCullVoxelChunks(Culler *culler, const VoxelChunks *chunks,
+                           const Frustum *frustum) {
+  culler->itemCount = 0;
+  v3 margin = v3_make(culler->margin, culler->margin, culler->margin);
+  for (unsigned chunk = 0; chunk < chunks->chunkCount; ++chunk) {
+    CullResult result =
+        sfFrustumTestBox(frustum, v3_sub(chunks->mins[chunk], margin),
+                         v3_add(chunks->maxs[chunk], margin));
+    if (result == CULL_OUTSIDE) {
+      continue;
+    }
+    culler->items[culler->itemCount] = chunk;
+    culler->itemsInside[culler->itemCount] = result == CULL_INSIDE;
+    culler->itemCount++;
+  }
+
+  sfThreadArenasReset(culler->threadArenas);
+  CullVoxelsContext context = {culler, chunks, frustum};
+  sfParallelFor(culler->itemCount, 1, cullVoxelsKernel, &context);
+  cullerMerge(culler);
+  return culler->visibleCount;
+}
@@ -0,0 +1,57 @@
+#include "diagnostics.h"
+
+void sfDiagnosticsReset(Diagnostics *diagnostics) {
+  *diagnostics = (Diagnostics){0};
+}
+
+void sfDiagnosticsBeginStep(Diagnostics *diagnostics) {
+  diagnostics->kinetic = 0.0;
+  diagnostics->potential = 0.0;
+  for (int k = 0; k < 3; ++k) {
+    diagnostics->momentum[k] = 0.0;
+  }
+}
+
+void sfDiagnosticsAddPotential(Diagnostics *diagnostics, float mass,
+                               float potential) {
+  // NOTE: Every pair is seen from both ends
+  diagnostics->potential += 0.5 * mass * potential;
+}
+
+void sfDiagnosticsAddKinetic(Diagnostics *diagnostics, float mass,
+                             const v3 velocity) {
+  diagnostics->kinetic += 0.5 * mass * v3_dot(velocity, velocity);
+  for (int k = 0; k < 3; ++k) {
+    diagnostics->momentum[k] += (double)mass * velocity.v[k];
+  }
+}
+
+void sfDiagnosticsEndStep(Diagnostics *diagnostics) {
+  double energy = diagnostics->kinetic + diagnostics->potential;
+  if (diagnostics->steps++ == 0) {
+    diagnostics->initialEnergy = energy;
+    for (int k = 0; k < 3; ++k) {
+      diagnostics->initialMomentum[k] = diagnostics->momentum[k];
+    }
+  }
+
+  double initialEnergy = fabs(diagnostics->initialEnergy);
+  diagnostics->energyDrift = energy - diagnostics->initialEnergy;
+  if (initialEnergy > 0.0) {
+    diagnostics->energyDrift /= initialEnergy;
+  }
+
+  double momentumDriftSquared = 0.0;
+  for (int k = 0; k < 3; ++k) {
+    double d = diagnostics->momentum[k] - diagnostics->initialMomentum[k];
+    momentumDriftSquared += d * d;
+  }
+  diagnostics->momentumDrift = sqrt(momentumDriftSquared);
+}
+
+void sfDiagnosticsPrint(const Diagnostics *diagnostics, unsigned step) {
+  printf("step %u | E: %e (K: %e, U: %e) | dE/E0: %+e | |dP|: %e\n", step,
+         diagnostics->kinetic + diagnostics->potential, diagnostics->kinetic,
+         diagnostics->potential, diagnostics->energyDrift,
+         diagnostics->momentumDrift);
+}
@@ -0,0 +1,98 @@
+#include "dirty_ranges.h"
+
+static void __removeRange(DirtyRanges *dirty, unsigned index) {
+  for (unsigned i = index; i + 1 < dirty->count; ++i) {
+    dirty->ranges[i] = dirty->ranges[i + 1];
+  }
+  dirty->count--;
+}
+
+static void __mergeClosest(DirtyRanges *dirty) {
+  unsigned closest = 0;
+  unsigned smallestGap = ~0u;
+  for (unsigned i = 0; i + 1 < dirty->count; ++i) {
+    unsigned gap = dirty->ranges[i + 1].first - dirty->ranges[i].end;
+    if (gap < smallestGap) {
+      smallestGap = gap;
+      closest = i;
+    }
+  }
+
+  dirty->ranges[closest].end = dirty->ranges[closest + 1].end;
+  __removeRange(dirty, closest + 1);
+}
+
+void sfDirtyRangesMark(DirtyRanges *dirty, unsigned first, unsigned count) {
+  if (!count) {
+    return;
+  }
+
+  unsigned end = first + count;
+
+  // NOTE: Fast path for writers sweeping forward one element at a time
+  if (dirty->count) {
+    DirtyRange *last = &dirty->ranges[dirty->count - 1];
+    if (first >= last->first && first <= last->end) {
+      if (end > last->end) {
+        last->end = end;
+      }
+      return;
+    }
+  }
+
+  unsigned index = 0;
+  while (index < dirty->count && dirty->ranges[index].end < first) {
+    index++;
+  }
+
+  if (index < dirty->count && dirty->ranges[index].first <= end) {
+    DirtyRange *range = &dirty->ranges[index];
+    if (first < range->first) {
+      range->first = first;
+    }
+    if (end > range->end) {
+      range->end = end;
+    }
+
+    while (index + 1 < dirty->count &&
+           dirty->ranges[index + 1].first <= range->end) {
+      if (dirty->ranges[index + 1].end > range->end) {
+        range->end = dirty->ranges[index + 1].end;
+      }
+      __removeRange(dirty, index + 1);
+    }
+    return;
+  }
+
+  if (dirty->count == MAX_DIRTY_RANGES) {
+    __mergeClosest(dirty);
+    sfDirtyRangesMark(dirty, first, count);
+    return;
+  }
+
+  for (unsigned i = dirty->count; i > index; --i) {
+    dirty->ranges[i] = dirty->ranges[i - 1];
+  }
+  dirty->ranges[index] = (DirtyRange){first, end};
+  dirty->count++;
+}
+
+void sfDirtyRangesClear(DirtyRanges *dirty) { dirty->count = 0; }
+
+// NOTE: Expects the target buffer to be bound, returns the uploaded element
+// count
+unsigned sfDirtyRangesUpload(DirtyRanges *dirty, GLenum target,
+                             const void *data, GLsizeiptr elementSize) {
+  unsigned uploaded = 0;
+  const unsigned char *bytes = (const unsigned char *)data;
+  for (unsigned i = 0; i < dirty->count; ++i) {
+    const DirtyRange *range = &dirty->ranges[i];
+    unsigned count = range->end - range->first;
+    glBufferSubData(target, range->first * elementSize, count * elementSize,
+                    bytes + range->first * elementSize);
+    uploaded += count;
+  }
+
+  sfDirtyRangesClear(dirty);
+  return uploaded;
+}
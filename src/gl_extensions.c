@@ -0,0 +1,47 @@
+#include "gl_extensions.h"
+#include <string.h>
+
+GLExtensions sfGLExtensions = {0};
+
+int sfGLHasExtension(const char *name) {
+  GLint count = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+  for (GLint i = 0; i < count; ++i) {
+    const char *extension = (const char *)glGetStringi(GL_EXTENSIONS, i);
+    if (extension && !strcmp(extension, name)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static int versionAtLeast(int major, int minor) {
+  return sfGLExtensions.major > major ||
+         (sfGLExtensions.major == major && sfGLExtensions.minor >= minor);
+}
+
+void sfLoadGLExtensions(GLADloadproc load) {
+  glGetIntegerv(GL_MAJOR_VERSION, &sfGLExtensions.major);
+  glGetIntegerv(GL_MINOR_VERSION, &sfGLExtensions.minor);
+
+  if (versionAtLeast(4, 4) || sfGLHasExtension("GL_ARB_buffer_storage")) {
+    sfGLExtensions.bufferStorage =
+        (PFNSFGLBUFFERSTORAGEPROC)load("glBufferStorage");
+    sfGLExtensions.hasBufferStorage = sfGLExtensions.bufferStorage != NULL;
+  }
+
+  if (versionAtLeast(4, 1) || sfGLHasExtension("GL_ARB_get_program_binary")) {
+    sfGLExtensions.getProgramBinary =
+        (PFNSFGLGETPROGRAMBINARYPROC)load("glGetProgramBinary");
+    sfGLExtensions.programBinary =
+        (PFNSFGLPROGRAMBINARYPROC)load("glProgramBinary");
+    sfGLExtensions.programParameteri =
+        (PFNSFGLPROGRAMPARAMETERIPROC)load("glProgramParameteri");
+
+    GLint formatCount = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+    sfGLExtensions.hasProgramBinary =
+        formatCount > 0 && sfGLExtensions.getProgramBinary &&
+        sfGLExtensions.programBinary && sfGLExtensions.programParameteri;
+  }
+}
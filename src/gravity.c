@@ -0,0 +1,274 @@
+#include "gravity.h"
+
+// NOTE: Every SIMD kernel is compiled for its own target, so the rest of the
+// build keeps its baseline flags and `sfGravityInit` picks what the CPU runs
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define GRAVITY_X86
+#include <immintrin.h>
+#endif
+
+static void gravityScalar(const GravitySources *sources, unsigned count,
+                          v3 position, float epsilonSquared, v3 *acceleration,
+                          float *potential) {
+  float ax = 0.0f, ay = 0.0f, az = 0.0f, phi = 0.0f;
+  for (unsigned i = 0; i < count; ++i) {
+    float dx = sources->x[i] - position.x;
+    float dy = sources->y[i] - position.y;
+    float dz = sources->z[i] - position.z;
+    float distanceSquared = dx * dx + dy * dy + dz * dz;
+    if (distanceSquared == 0.0f) {
+      continue;
+    }
+
+    float inverse = 1.0f / sqrtf(distanceSquared + epsilonSquared);
+    float massInverse = sources->masses[i] * inverse;
+    float strength = massInverse * inverse * inverse;
+    ax += dx * strength;
+    ay += dy * strength;
+    az += dz * strength;
+    phi -= massInverse;
+  }
+
+  acceleration->x += ax;
+  acceleration->y += ay;
+  acceleration->z += az;
+  if (potential) {
+    *potential += phi;
+  }
+}
+
+#ifdef GRAVITY_X86
+__attribute__((target("sse2"))) static float horizontalSum128(__m128 v) {
+  __m128 swapped = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+  __m128 pairs = _mm_add_ps(v, swapped);
+  swapped = _mm_shuffle_ps(pairs, pairs, _MM_SHUFFLE(1, 0, 3, 2));
+  return _mm_cvtss_f32(_mm_add_ps(pairs, swapped));
+}
+
+// NOTE: Lanes with a zero distance are masked after the products, a zero
+// epsilon turns their inverse distance into inf and the products into NaN
+__attribute__((target("sse2"))) static void
+gravitySse(const GravitySources *sources, unsigned count, v3 position,
+           float epsilonSquared, v3 *acceleration, float *potential) {
+  const __m128 px = _mm_set1_ps(position.x);
+  const __m128 py = _mm_set1_ps(position.y);
+  const __m128 pz = _mm_set1_ps(position.z);
+  const __m128 epsilon = _mm_set1_ps(epsilonSquared);
+  const __m128 half = _mm_set1_ps(0.5f);
+  const __m128 threeHalves = _mm_set1_ps(1.5f);
+  const __m128 zero = _mm_setzero_ps();
+  __m128 ax = zero, ay = zero, az = zero, phi = zero;
+
+  for (unsigned i = 0; i < count; i += 4) {
+    __m128 dx = _mm_sub_ps(_mm_loadu_ps(sources->x + i), px);
+    __m128 dy = _mm_sub_ps(_mm_loadu_ps(sources->y + i), py);
+    __m128 dz = _mm_sub_ps(_mm_loadu_ps(sources->z + i), pz);
+    __m128 distanceSquared = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+    __m128 radiusSquared = _mm_add_ps(distanceSquared, epsilon);
+
+    __m128 inverse = _mm_rsqrt_ps(radiusSquared);
+    inverse = _mm_mul_ps(
+        inverse,
+        _mm_sub_ps(threeHalves,
+                   _mm_mul_ps(_mm_mul_ps(half, radiusSquared),
+                              _mm_mul_ps(inverse, inverse))));
+
+    __m128 mask = _mm_cmpgt_ps(distanceSquared, zero);
+    __m128 massInverse =
+        _mm_and_ps(mask, _mm_mul_ps(_mm_loadu_ps(sources->masses + i), inverse));
+    __m128 strength =
+        _mm_and_ps(mask, _mm_mul_ps(massInverse, _mm_mul_ps(inverse, inverse)));
+    ax = _mm_add_ps(ax, _mm_mul_ps(dx, strength));
+    ay = _mm_add_ps(ay, _mm_mul_ps(dy, strength));
+    az = _mm_add_ps(az, _mm_mul_ps(dz, strength));
+    phi = _mm_sub_ps(phi, massInverse);
+  }
+
+  acceleration->x += horizontalSum128(ax);
+  acceleration->y += horizontalSum128(ay);
+  acceleration->z += horizontalSum128(az);
+  if (potential) {
+    *potential += horizontalSum128(phi);
+  }
+}
+
+__attribute__((target("avx2,fma"))) static float horizontalSum256(__m256 v) {
+  __m128 sum =
+      _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+  __m128 swapped = _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(2, 3, 0, 1));
+  sum = _mm_add_ps(sum, swapped);
+  swapped = _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(1, 0, 3, 2));
+  return _mm_cvtss_f32(_mm_add_ps(sum, swapped));
+}
+
+__attribute__((target("avx2,fma"))) static void
+gravityAvx2(const GravitySources *sources, unsigned count, v3 position,
+            float epsilonSquared, v3 *acceleration, float *potential) {
+  const __m256 px = _mm256_set1_ps(position.x);
+  const __m256 py = _mm256_set1_ps(position.y);
+  const __m256 pz = _mm256_set1_ps(position.z);
+  const __m256 epsilon = _mm256_set1_ps(epsilonSquared);
+  const __m256 half = _mm256_set1_ps(0.5f);
+  const __m256 threeHalves = _mm256_set1_ps(1.5f);
+  const __m256 zero = _mm256_setzero_ps();
+  __m256 ax = zero, ay = zero, az = zero, phi = zero;
+
+  for (unsigned i = 0; i < count; i += 8) {
+    __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(sources->x + i), px);
+    __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(sources->y + i), py);
+    __m256 dz = _mm256_sub_ps(_mm256_loadu_ps(sources->z + i), pz);
+    __m256 distanceSquared = _mm256_fmadd_ps(
+        dx, dx, _mm256_fmadd_ps(dy, dy, _mm256_mul_ps(dz, dz)));
+    __m256 radiusSquared = _mm256_add_ps(distanceSquared, epsilon);
+
+    __m256 inverse = _mm256_rsqrt_ps(radiusSquared);
+    inverse = _mm256_mul_ps(
+        inverse, _mm256_fnmadd_ps(_mm256_mul_ps(half, radiusSquared),
+                                  _mm256_mul_ps(inverse, inverse),
+                                  threeHalves));
+
+    __m256 mask = _mm256_cmp_ps(distanceSquared, zero, _CMP_GT_OQ);
+    __m256 massInverse = _mm256_and_ps(
+        mask, _mm256_mul_ps(_mm256_loadu_ps(sources->masses + i), inverse));
+    __m256 strength = _mm256_and_ps(
+        mask, _mm256_mul_ps(massInverse, _mm256_mul_ps(inverse, inverse)));
+    ax = _mm256_fmadd_ps(dx, strength, ax);
+    ay = _mm256_fmadd_ps(dy, strength, ay);
+    az = _mm256_fmadd_ps(dz, strength, az);
+    phi = _mm256_sub_ps(phi, massInverse);
+  }
+
+  acceleration->x += horizontalSum256(ax);
+  acceleration->y += horizontalSum256(ay);
+  acceleration->z += horizontalSum256(az);
+  if (potential) {
+    *potential += horizontalSum256(phi);
+  }
+}
+
+// NOTE: rsqrt14 is exact to 14 bits, the Newton step takes it to ~23
+__attribute__((target("avx512f"))) static void
+gravityAvx512(const GravitySources *sources, unsigned count, v3 position,
+              float epsilonSquared, v3 *acceleration, float *potential) {
+  const __m512 px = _mm512_set1_ps(position.x);
+  const __m512 py = _mm512_set1_ps(position.y);
+  const __m512 pz = _mm512_set1_ps(position.z);
+  const __m512 epsilon = _mm512_set1_ps(epsilonSquared);
+  const __m512 half = _mm512_set1_ps(0.5f);
+  const __m512 threeHalves = _mm512_set1_ps(1.5f);
+  const __m512 zero = _mm512_setzero_ps();
+  __m512 ax = zero, ay = zero, az = zero, phi = zero;
+
+  for (unsigned i = 0; i < count; i += 16) {
+    __m512 dx = _mm512_sub_ps(_mm512_loadu_ps(sources->x + i), px);
+    __m512 dy = _mm512_sub_ps(_mm512_loadu_ps(sources->y + i), py);
+    __m512 dz = _mm512_sub_ps(_mm512_loadu_ps(sources->z + i), pz);
+    __m512 distanceSquared = _mm512_fmadd_ps(
+        dx, dx, _mm512_fmadd_ps(dy, dy, _mm512_mul_ps(dz, dz)));
+    __m512 radiusSquared = _mm512_add_ps(distanceSquared, epsilon);
+
+    __m512 inverse = _mm512_rsqrt14_ps(radiusSquared);
+    inverse = _mm512_mul_ps(
+        inverse, _mm512_fnmadd_ps(_mm512_mul_ps(half, radiusSquared),
+                                  _mm512_mul_ps(inverse, inverse),
+                                  threeHalves));
+
+    __mmask16 mask = _mm512_cmp_ps_mask(distanceSquared, zero, _CMP_GT_OQ);
+    __m512 massInverse = _mm512_maskz_mul_ps(
+        mask, _mm512_loadu_ps(sources->masses + i), inverse);
+    __m512 strength = _mm512_maskz_mul_ps(mask, massInverse,
+                                          _mm512_mul_ps(inverse, inverse));
+    ax = _mm512_fmadd_ps(dx, strength, ax);
+    ay = _mm512_fmadd_ps(dy, strength, ay);
+    az = _mm512_fmadd_ps(dz, strength, az);
+    phi = _mm512_sub_ps(phi, massInverse);
+  }
+
+  acceleration->x += _mm512_reduce_add_ps(ax);
+  acceleration->y += _mm512_reduce_add_ps(ay);
+  acceleration->z += _mm512_reduce_add_ps(az);
+  if (potential) {
+    *potential += _mm512_reduce_add_ps(phi);
+  }
+}
+#endif
+
+static const GravityKernel gravityKernels[GRAVITY_KERNEL_COUNT] = {
+    gravityScalar,
+#ifdef GRAVITY_X86
+    gravitySse,
+    gravityAvx2,
+    gravityAvx512,
+#endif
+};
+
+static const char *gravityKernelNames[GRAVITY_KERNEL_COUNT] = {
+    "scalar", "sse", "avx2", "avx512"};
+
+static GravityKernelType gravityKernelType = GRAVITY_KERNEL_SCALAR;
+static unsigned char isGravityInitialized = 0;
+
+unsigned char sfGravityIsSupported(GravityKernelType type) {
+  if (type >= GRAVITY_KERNEL_COUNT || !gravityKernels[type]) {
+    return 0;
+  }
+#ifdef GRAVITY_X86
+  __builtin_cpu_init();
+  switch (type) {
+  case GRAVITY_KERNEL_SSE:
+    return __builtin_cpu_supports("sse2") != 0;
+  case GRAVITY_KERNEL_AVX2:
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+  case GRAVITY_KERNEL_AVX512:
+    return __builtin_cpu_supports("avx512f") != 0;
+  default:
+    break;
+  }
+#endif
+  return 1;
+}
+
+// NOTE: Picks the widest kernel the CPU runs. Call once at startup, before
+// any thread evaluates forces
+void sfGravityInit() {
+  gravityKernelType = GRAVITY_KERNEL_SCALAR;
+  for (int type = GRAVITY_KERNEL_COUNT - 1; type > GRAVITY_KERNEL_SCALAR;
+       --type) {
+    if (sfGravityIsSupported((GravityKernelType)type)) {
+      gravityKernelType = (GravityKernelType)type;
+      break;
+    }
+  }
+  isGravityInitialized = 1;
+}
+
+// NOTE: Overrides the detected kernel, returns 0 and keeps the current one
+// when the CPU lacks `type`
+unsigned char sfGravitySetKernel(GravityKernelType type) {
+  if (!sfGravityIsSupported(type)) {
+    return 0;
+  }
+  gravityKernelType = type;
+  isGravityInitialized = 1;
+  return 1;
+}
+
+GravityKernelType sfGravityKernelType() {
+  if (!isGravityInitialized) {
+    sfGravityInit();
+  }
+  return gravityKernelType;
+}
+
+const char *sfGravityKernelName(GravityKernelType type) {
+  return type < GRAVITY_KERNEL_COUNT ? gravityKernelNames[type] : "unknown";
+}
+
+void sfGravityAccumulate(const GravitySources *sources, unsigned count,
+                         v3 position, float epsilonSquared, v3 *acceleration,
+                         float *potential) {
+  gravityKernels[sfGravityKernelType()](sources, count, position,
+                                        epsilonSquared, acceleration,
+                                        potential);
+}
@@ -0,0 +1,136 @@
+#include "initial_conditions.h"
+#include "parallel.h"
+#include <string.h>
+
+#define IC_MIN_BATCH 4096
+#define PLUMMER_MAX_RADIUS 10.0f
+
+typedef struct {
+  Bodies *bodies;
+  InitialConditionsType type;
+  const InitialConditions *ic;
+} GenerateContext;
+
+static v3 randomDirection(RandomStream *stream) {
+  float z = sfRandomRange(stream, -1.0f, 1.0f);
+  float phi = sfRandomRange(stream, 0.0f, 2.0f * PI);
+  float s = sqrtf(fmaxf(0.0f, 1.0f - z * z));
+  return v3_make(s * cosf(phi), s * sinf(phi), z);
+}
+
+// NOTE: Aarseth, Henon & Wielen (1974) sampling of a Plummer sphere
+static void plummerBody(RandomStream *stream, float mass, float radius,
+                        float G, v3 *position, v3 *velocity) {
+  float r;
+  do {
+    float x = sfRandomFloatOpen(stream);
+    r = radius / sqrtf(powf(x, -2.0f / 3.0f) - 1.0f);
+  } while (!(r < PLUMMER_MAX_RADIUS * radius));
+
+  float q, g;
+  do {
+    q = sfRandomFloat(stream);
+    g = sfRandomRange(stream, 0.0f, 0.1f);
+  } while (g > q * q * powf(1.0f - q * q, 3.5f));
+
+  float escapeSpeed = sqrtf(2.0f * G * mass / sqrtf(r * r + radius * radius));
+  *position = v3_scale(randomDirection(stream), r);
+  *velocity = v3_scale(randomDirection(stream), q * escapeSpeed);
+}
+
+static void exponentialDiskBody(RandomStream *stream, const InitialConditions *ic,
+                                v3 *position, v3 *velocity) {
+  // NOTE: R * exp(-R / Rd) is a Gamma(2) distribution, the sum of two
+  // exponentials
+  float scaleLength = ic->radius;
+  float R = -scaleLength * logf(sfRandomFloatOpen(stream) *
+                                sfRandomFloatOpen(stream));
+  float phi = sfRandomRange(stream, 0.0f, 2.0f * PI);
+  float u = clampf(sfRandomFloatOpen(stream), 1e-6f, 1.0f - 1e-6f);
+  float height = ic->scaleHeight * atanhf(2.0f * u - 1.0f);
+
+  float x = R / scaleLength;
+  float enclosedMass = ic->mass * (1.0f - (1.0f + x) * expf(-x));
+  float softenedR = sqrtf(R * R + ic->scaleHeight * ic->scaleHeight);
+  float circularSpeed = sqrtf(ic->G * enclosedMass / softenedR);
+
+  *position = v3_make(R * cosf(phi), height, R * sinf(phi));
+  *velocity = v3_make(-sinf(phi) * circularSpeed, 0.0f,
+                      cosf(phi) * circularSpeed);
+}
+
+static void generateKernel(void *context, unsigned begin, unsigned end) {
+  GenerateContext *ctx = (GenerateContext *)context;
+  Bodies *bodies = ctx->bodies;
+  const InitialConditions *ic = ctx->ic;
+  float bodyMass = bodies->count ? ic->mass / bodies->count : 0.0f;
+
+  for (unsigned i = begin; i < end; ++i) {
+    RandomStream stream = sfRandomStream(ic->seed, i);
+    v3 position = v3_0();
+    v3 velocity = v3_0();
+
+    switch (ctx->type) {
+    case IC_PLUMMER:
+      plummerBody(&stream, ic->mass, ic->radius, ic->G, &position, &velocity);
+      break;
+    case IC_EXPONENTIAL_DISK:
+      exponentialDiskBody(&stream, ic, &position, &velocity);
+      break;
+    case IC_UNIFORM_COLLAPSE:
+      position = v3_scale(randomDirection(&stream),
+                          ic->radius * cbrtf(sfRandomFloat(&stream)));
+      break;
+    case IC_MERGING_PAIR: {
+      float side = i < bodies->count / 2 ? -0.5f : 0.5f;
+      plummerBody(&stream, ic->mass * 0.5f, ic->radius, ic->G, &position,
+                  &velocity);
+      position = v3_add(position, v3_make(side * ic->separation, 0.0f,
+                                          side * ic->impactParameter));
+      velocity = v3_add(velocity,
+                        v3_make(-side * ic->approachSpeed, 0.0f, 0.0f));
+    } break;
+    }
+
+    sfBodiesSetPosition(bodies, i, position);
+    sfBodiesSetVelocity(bodies, i, velocity);
+    sfBodiesSetAcceleration(bodies, i, v3_0());
+    bodies->masses[i] = bodyMass;
+    bodies->sizes[i] = 0.1f;
+  }
+}
+
+InitialConditions sfInitialConditionsDefault(uint64_t seed) {
+  InitialConditions ic = {0};
+  ic.seed = seed;
+  ic.mass = 100.0f;
+  ic.radius = 5.0f;
+  ic.G = 1.0f;
+  ic.scaleHeight = 0.5f;
+  ic.separation = 30.0f;
+  ic.approachSpeed = 1.0f;
+  ic.impactParameter = 5.0f;
+  return ic;
+}
+
+int sfInitialConditionsParseType(const char *name, InitialConditionsType *type) {
+  if (!strcmp(name, "plummer")) {
+    *type = IC_PLUMMER;
+  } else if (!strcmp(name, "disk")) {
+    *type = IC_EXPONENTIAL_DISK;
+  } else if (!strcmp(name, "collapse")) {
+    *type = IC_UNIFORM_COLLAPSE;
+  } else if (!strcmp(name, "pair")) {
+    *type = IC_MERGING_PAIR;
+  } else {
+    fprintf(stderr, "ERROR: Unknown initial conditions: %s\n", name);
+    return 0;
+  }
+  return 1;
+}
+
+void sfInitialConditionsGenerate(Bodies *bodies, InitialConditionsType type,
+                                 const InitialConditions *ic) {
+  GenerateContext context = {bodies, type, ic};
+  sfParallelFor(bodies->count, IC_MIN_BATCH, generateKernel, &context);
+}
@@ -8,12 +8,21 @@
 #include <GLFW/glfw3.h>
 #include <stdio.h>
 #include <stdlib.h>
-#define STB_IMAGE_IMPLEMENTATION
 #include "arena.h"
-#include "cubes.h"
+#include "bodies.h"
+#include "culling.h"
+#include "diagnostics.h"
+#include "gl_extensions.h"
+#include "gravity.h"
+#include "initial_conditions.h"
 #include "octree.h"
 #include "particles.h"
-#include "stb_image.h"
+#include "random.h"
+#include "render_queue.h"
+#include "texture_loader.h"
+#include "trajectory.h"
+#include "voxel_world.h"
+#include <string.h>
 #include <time.h>
 
 float randf() { return (float)rand() / RAND_MAX; }
@@ -88,6 +97,20 @@ void glfwKeyCallback(GLFWwindow *window, int key, int scancode, int action,
     case GLFW_KEY_L:
       processKeyEvent(&keyboard->debugStep, isDown);
       break;
+    case GLFW_KEY_P:
+      processKeyEvent(&keyboard->togglePlayback, isDown);
+      break;
+    case GLFW_KEY_PERIOD:
+      processKeyEvent(&keyboard->scrubForward, isDown);
+      break;
+    case GLFW_KEY_COMMA:
+      processKeyEvent(&keyboard->scrubBackward, isDown);
+      break;
+    case GLFW_KEY_M:
+      if (isDown) {
+        sfArenaReport(stdout);
+      }
+      break;
     }
   }
 }
@@ -122,47 +145,20 @@ GLFWwindow *initGlfwWindow(int width, int height) {
   return window;
 }
 
-unsigned loadImageAsTexture(const char *filename) {
-  stbi_set_flip_vertically_on_load(1);
-  int texWidth, texHeight, texChannels;
-  unsigned char *texData =
-      stbi_load(filename, &texWidth, &texHeight, &texChannels, 0);
-  if (!texData) {
-    fprintf(stderr, "ERROR: Failed to load texture\n");
-  }
-
-  unsigned texture;
-  glGenTextures(1, &texture);
-
-  glBindTexture(GL_TEXTURE_2D, texture);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
-                  GL_LINEAR_MIPMAP_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, texWidth, texHeight, 0, GL_RGB,
-               GL_UNSIGNED_BYTE, texData);
-  glGenerateMipmap(GL_TEXTURE_2D);
-  stbi_image_free(texData);
-  return texture;
-}
-
-void sfVoxelsFromCubes(Voxels *voxels, const Cubes *cubes) {
-  for (int i = 0; i < cubes->count; ++i) {
-    const v3 *position = &cubes->positions[i];
-    const float size = cubes->sizes[i];
-    voxels->transforms[i] = m44_identity(1.0f);
-
-    voxels->transforms[i] = translate(&voxels->transforms[i], position->x,
-                                      position->y, position->z);
-    voxels->transforms[i] = scale(&voxels->transforms[i], size, size, size);
-  }
+void sfVoxelsFromBodies(Voxels *voxels, const Bodies *bodies) {
+  transform_soa transforms = {bodies->positionsX, bodies->positionsY,
+                              bodies->positionsZ, bodies->sizes};
+  sfUpdateVoxelTransforms(voxels, &transforms);
 }
 
-// TODO(Jovan): Use arena
-GLuint generateColorTexture(int width, int height, int r, int g, int b, int a) {
+GLuint generateColorTexture(Arena *scratch, int width, int height, int r,
+                            int g, int b, int a) {
   GLuint texture;
-  GLubyte *data = (GLubyte *)malloc(width * height * 4);
+  ArenaMarker marker = sfArenaMark(scratch);
+  GLubyte *data = (GLubyte *)sfArenaAlloc(scratch, width * height * 4);
+  if (!data) {
+    return 0;
+  }
 
   for (int i = 0; i < width * height * 4; i += 4) {
     data[i] = r;
@@ -194,96 +190,174 @@ GLuint generateColorTexture(int width, int height, int r, int g, int b, int a) {
   glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA,
                GL_UNSIGNED_BYTE, data);
 
-  free(data);
+  sfArenaRestore(scratch, marker);
   return texture;
 }
 
-v3 v3_rand_clamp(float min, float max) {
-  return v3_make(randf_clamped(min, max), randf_clamped(min, max),
-                 randf_clamped(min, max));
+v3 v3_rand_clamp(RandomStream *stream, float min, float max) {
+  return v3_make(sfRandomRange(stream, min, max),
+                 sfRandomRange(stream, min, max),
+                 sfRandomRange(stream, min, max));
 }
 
-void initCircularOrbit(Cubes *cubes, v3 worldDimensions) {
+void initCircularOrbit(Bodies *bodies, v3 worldDimensions, uint64_t seed) {
 
   float radius = v3_len(worldDimensions) / 3.0f;
   float minLen = 1e-6;
   v3 center = v3_0();
   float worldVolume = worldDimensions.x * worldDimensions.y * worldDimensions.z;
   float baseMass =
-      (cubes->count > 0) ? (worldVolume / cubes->count) * 0.5f : 1.0f;
+      (bodies->count > 0) ? (worldVolume / bodies->count) * 0.5f : 1.0f;
   // float baseSpeed = v3_len(worldDimensions) / .5f;
   float baseSpeed = 7.0f;
   v3 orbitAxis = v3_norm(v3_make(0.2f, 1.0f, -0.1f));
 
-  for (int i = 0; i < cubes->count; ++i) {
-    v3 position = v3_rand_clamp(-1.0f, 1.0f);
+  for (int i = 0; i < bodies->count; ++i) {
+    RandomStream stream = sfRandomStream(seed, i);
+    v3 position = v3_rand_clamp(&stream, -1.0f, 1.0f);
     float lenSq = v3_dot(position, position);
     while (lenSq < minLen) {
-      position = v3_rand_clamp(-1.0f, 1.0f);
-      float lenSq = v3_dot(position, position);
+      position = v3_rand_clamp(&stream, -1.0f, 1.0f);
+      lenSq = v3_dot(position, position);
     }
 
     position = v3_norm(position);
     position = v3_scale(position, radius);
     position = v3_add(position, center);
 
-    float mass = randf_clamped(baseMass * 0.7f, baseMass * 1.3f);
+    float mass = sfRandomRange(&stream, baseMass * 0.7f, baseMass * 1.3f);
     v3 initialVelocity = v3_0();
-    float speed = randf_clamped(baseSpeed * 0.5f, baseSpeed * 1.5f);
+    float speed = sfRandomRange(&stream, baseSpeed * 0.5f, baseSpeed * 1.5f);
     v3 positionRelativeToCenter = v3_sub(position, center);
     v3 tangent = v3_cross(orbitAxis, positionRelativeToCenter);
     if (v3_len(tangent) > minLen) {
       initialVelocity = v3_norm(tangent);
       initialVelocity = v3_scale(initialVelocity, -speed);
     } else {
-      v3 randDirection = v3_rand_clamp(-1.0f, 1.0f);
+      v3 randDirection = v3_rand_clamp(&stream, -1.0f, 1.0f);
       lenSq = v3_dot(randDirection, randDirection);
       while (lenSq < minLen) {
-        randDirection = v3_rand_clamp(-1.0f, 1.0f);
+        randDirection = v3_rand_clamp(&stream, -1.0f, 1.0f);
         lenSq = v3_dot(randDirection, randDirection);
       }
       initialVelocity = v3_norm(randDirection);
       initialVelocity = v3_scale(randDirection, speed * 0.1f);
     }
-    cubes->positions[i] = position;
-    cubes->velocities[i] = initialVelocity;
-    cubes->masses[i] = mass;
-    cubes->sizes[i] = 0.1f;
+    sfBodiesSetPosition(bodies, i, position);
+    sfBodiesSetVelocity(bodies, i, initialVelocity);
+    bodies->masses[i] = mass;
+    bodies->sizes[i] = 0.1f;
   }
 }
 
-void updatePhysics(Octree *octree, v3 *positions, v3 *velocities,
-                   v3 *accelerations, float *masses, unsigned bodyCount,
-                   float dt) {
-  Octant initialOctant = sfOctantContaining(positions, bodyCount);
+// NOTE: `arena` holds the per-body potentials when `diagnostics` is set, so
+// diagnostics take the same parallel force path as a plain step
+void updatePhysics(Arena *arena, Octree *octree, Bodies *bodies, float dt,
+                   Diagnostics *diagnostics, v3 *positionsOut,
+                   v3 *velocitiesOut) {
+  unsigned bodyCount = bodies->count;
+
+  Octant initialOctant =
+      sfOctantContainingSoA(bodies->positionsX, bodies->positionsY,
+                            bodies->positionsZ, bodyCount);
   sfOctreeClear(octree, &initialOctant);
 
   for (int i = 0; i < bodyCount; ++i) {
-    const v3 position = positions[i];
-    sfOctreeInsert(octree, position, masses[i]);
+    sfOctreeInsertBody(octree, i, sfBodiesPosition(bodies, i),
+                       bodies->masses[i]);
   }
 
   sfOctreePropagate(octree);
-  for (int i = 0; i < bodyCount; ++i) {
-    accelerations[i] = sfOctreeAcceleration(octree, positions[i]);
+  float *potentials = NULL;
+  if (diagnostics) {
+    potentials = (float *)sfArenaAlloc(arena, sizeof(float) * bodyCount);
+  }
+  sfOctreeAccelerations(octree, bodies->positionsX, bodies->positionsY,
+                        bodies->positionsZ, bodyCount, bodies->accelerationsX,
+                        bodies->accelerationsY, bodies->accelerationsZ,
+                        potentials);
+
+  if (diagnostics) {
+    sfDiagnosticsBeginStep(diagnostics);
+    for (int i = 0; i < bodyCount; ++i) {
+      if (potentials) {
+        sfDiagnosticsAddPotential(diagnostics, bodies->masses[i],
+                                  potentials[i]);
+      }
+      sfDiagnosticsAddKinetic(diagnostics, bodies->masses[i],
+                              sfBodiesVelocity(bodies, i));
+    }
   }
 
   // Integrate accelerations & velocities
-  for (int i = 1; i < bodyCount; ++i) {
-    v3 *acceleration = &accelerations[i];
-    v3 *velocity = &velocities[i];
-    v3 *position = &positions[i];
-
-    *velocity = v3_add(*velocity, v3_scale(*acceleration, dt));
-    *position = v3_add(*position, v3_scale(*velocity, dt));
+  if (positionsOut && velocitiesOut) {
+    sfBodiesIntegrateStream(bodies, 1, dt, positionsOut, velocitiesOut);
+  } else {
+    sfBodiesIntegrate(bodies, 1, dt);
+  }
 
-    v3_zero(acceleration);
+  if (diagnostics) {
+    sfDiagnosticsEndStep(diagnostics);
   }
 }
 
-int main() {
-  srand(time(NULL));
+int main(int argc, char **argv) {
+  const char *recordPath = NULL;
+  const char *playPath = NULL;
+  unsigned recordEvery = 1;
+  uint64_t seed = (uint64_t)time(NULL);
+  unsigned bodyCount = 0;
+  unsigned char hasInitialConditions = 0;
+  InitialConditionsType initialConditionsType = IC_PLUMMER;
+  unsigned diagnosticsEvery = 0;
+  unsigned char shouldCull = 1;
+  float lodPixels = 1.0f;
+  unsigned floorSize = 0;
+  const char *gravityKernelName = NULL;
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--record") && i + 1 < argc) {
+      recordPath = argv[++i];
+    } else if (!strcmp(argv[i], "--record-every") && i + 1 < argc) {
+      recordEvery = (unsigned)atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--play") && i + 1 < argc) {
+      playPath = argv[++i];
+    } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+      seed = strtoull(argv[++i], NULL, 10);
+    } else if (!strcmp(argv[i], "--bodies") && i + 1 < argc) {
+      bodyCount = (unsigned)atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--ic") && i + 1 < argc) {
+      hasInitialConditions =
+          sfInitialConditionsParseType(argv[++i], &initialConditionsType);
+    } else if (!strcmp(argv[i], "--diagnostics") && i + 1 < argc) {
+      diagnosticsEvery = (unsigned)atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--no-cull")) {
+      shouldCull = 0;
+    } else if (!strcmp(argv[i], "--lod-pixels") && i + 1 < argc) {
+      lodPixels = (float)atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--floor") && i + 1 < argc) {
+      floorSize = (unsigned)atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--gravity-kernel") && i + 1 < argc) {
+      gravityKernelName = argv[++i];
+    }
+  }
+
+  sfGravityInit();
+  if (gravityKernelName) {
+    unsigned type = 0;
+    while (type < GRAVITY_KERNEL_COUNT &&
+           strcmp(gravityKernelName, sfGravityKernelName(type))) {
+      type++;
+    }
+    if (!sfGravitySetKernel(type)) {
+      fprintf(stderr, "ERROR: Gravity kernel %s is not available\n",
+              gravityKernelName);
+    }
+  }
+  printf("Gravity kernel: %s\n", sfGravityKernelName(sfGravityKernelType()));
+
+  srand(seed);
   Arena inputArena = sfArenaCreate(MEGABYTE, 1);
+  sfArenaTag(&inputArena, "input");
 
   if (!glfwInit()) {
     fprintf(stderr, "Failed to init glfw\n");
@@ -295,6 +369,7 @@ int main() {
   GLFWwindow *window = initGlfwWindow(windowWidth, windowHeight);
 
   gladLoadGLLoader((GLADloadproc)glfwGetProcAddress);
+  sfLoadGLExtensions((GLADloadproc)glfwGetProcAddress);
   glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 
   Input *input = sfInputArenaAlloc(&inputArena);
@@ -307,9 +382,15 @@ int main() {
   glEnable(GL_BLEND);
   glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-  Arena cubesArena = sfArenaCreate(MEGABYTE, 100);
-  Arena voxelsArena = sfArenaCreate(MEGABYTE, 100);
-  Arena particlesArena = sfArenaCreate(MEGABYTE, 100);
+  Arena bodiesArena = sfArenaReserve(64 * GIGABYTE, ARENA_HUGE_PAGES);
+  Arena voxelsArena = sfArenaReserve(64 * GIGABYTE, 0);
+  Arena particlesArena = sfArenaReserve(64 * GIGABYTE, 0);
+  // NOTE: Transient, reset at the start of every frame
+  Arena frameArena = sfArenaReserve(GIGABYTE, 0);
+  sfArenaTag(&bodiesArena, "bodies");
+  sfArenaTag(&voxelsArena, "voxels");
+  sfArenaTag(&particlesArena, "particles");
+  sfArenaTag(&frameArena, "frame");
 
   Voxels *voxels[MAX_VOXELS];
   unsigned voxelsCount = 0;
@@ -317,35 +398,91 @@ int main() {
   unsigned starVao, starVbo, starVertexCount, starInstanceCount;
   sfInitStarBuffers(&starVao, &starVbo, &starVertexCount, &starInstanceCount);
 
-  Cubes *physCubes = sfCubesArenaAlloc(&cubesArena, 2);
+  Bodies *bodies = sfBodiesArenaAlloc(
+      &bodiesArena, hasInitialConditions && bodyCount ? bodyCount : 2);
 
   v3 worldDimensions = v3_make(5.0f, 5.0f, 5.0f);
-  // initCircularOrbit(physCubes, worldDimensions);
-
-  physCubes->positions[0] = v3_0();
-  physCubes->velocities[0] = v3_0();
-  physCubes->masses[0] = 100.0f;
-  physCubes->sizes[0] = 1.0f;
-
-  physCubes->positions[1] = v3_make(5.0f, 0.0f, 0.0f);
-  float r = v3_len(v3_sub(physCubes->positions[1], physCubes->positions[0]));
-  float G = 6.6743;
-  physCubes->velocities[1] =
-      v3_scale(v3_make(0.0f, 1.0f, 0.0f), sqrtf(physCubes->masses[0] * G / r));
-  physCubes->masses[1] = 1.0f;
-  physCubes->sizes[1] = 0.1f;
-
-  Particles *particles =
-      sfParticlesArenaAlloc(&particlesArena, physCubes->count);
-
-  unsigned containerTexture = loadImageAsTexture("res/container.jpg");
-  unsigned redDebugTexture = generateColorTexture(64, 64, 255, 0, 0, 64);
-  unsigned greenDebugTexture = generateColorTexture(64, 64, 0, 255, 0, 255);
-  unsigned blueDebugTexture = generateColorTexture(64, 64, 0, 0, 255, 255);
-
-  Voxels *cubeVoxels = sfVoxelsArenaAlloc(&voxelsArena, physCubes->count);
+  // initCircularOrbit(bodies, worldDimensions, seed);
+
+  if (hasInitialConditions) {
+    InitialConditions ic = sfInitialConditionsDefault(seed);
+    sfInitialConditionsGenerate(bodies, initialConditionsType, &ic);
+  } else {
+    sfBodiesSetPosition(bodies, 0, v3_0());
+    sfBodiesSetVelocity(bodies, 0, v3_0());
+    bodies->masses[0] = 100.0f;
+    bodies->sizes[0] = 1.0f;
+
+    sfBodiesSetPosition(bodies, 1, v3_make(5.0f, 0.0f, 0.0f));
+    float r = v3_len(
+        v3_sub(sfBodiesPosition(bodies, 1), sfBodiesPosition(bodies, 0)));
+    float G = 6.6743;
+    sfBodiesSetVelocity(bodies, 1,
+                        v3_scale(v3_make(0.0f, 1.0f, 0.0f),
+                                 sqrtf(bodies->masses[0] * G / r)));
+    bodies->masses[1] = 1.0f;
+    bodies->sizes[1] = 0.1f;
+  }
+
+  // NOTE: Playback streams recorded frames into the particles and skips
+  // `updatePhysics` entirely
+  Arena playbackArena = {0};
+  TrajectoryReader *trajectoryReader = NULL;
+  if (playPath) {
+    playbackArena = sfArenaReserve(64 * GIGABYTE, 0);
+    sfArenaTag(&playbackArena, "playback");
+    trajectoryReader = sfTrajectoryReaderArenaAlloc(&playbackArena, playPath);
+  }
+  float playhead = 0.0f;
+  unsigned char isPlaybackPaused = 0;
+  const float scrubSpeed = 10.0f;
+
+  Particles *particles = sfParticlesArenaAlloc(
+      &particlesArena, trajectoryReader ? trajectoryReader->header.bodyCount
+                                        : bodies->count);
+
+  // NOTE: Textures show a placeholder until the loader has streamed them in
+  TextureLoader *textureLoader = sfTextureLoaderArenaAlloc(&voxelsArena);
+  unsigned containerTexture =
+      sfTextureLoaderLoad(textureLoader, "res/container.jpg",
+                          GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR)
+          ->id;
+  unsigned redDebugTexture =
+      generateColorTexture(&frameArena, 64, 64, 255, 0, 0, 64);
+  unsigned greenDebugTexture =
+      generateColorTexture(&frameArena, 64, 64, 0, 255, 0, 255);
+  unsigned blueDebugTexture =
+      generateColorTexture(&frameArena, 64, 64, 0, 0, 255, 255);
+
+  Voxels *cubeVoxels = sfVoxelsArenaAlloc(&voxelsArena, bodies->count);
   cubeVoxels->texture = containerTexture;
   voxels[voxelsCount++] = cubeVoxels;
+  if (shouldCull) {
+    sfVoxelsEnableCulling(&voxelsArena, cubeVoxels);
+  }
+
+  Arena worldArena = {0};
+  VoxelWorld *world = NULL;
+  if (floorSize) {
+    unsigned chunks =
+        (floorSize + VOXEL_WORLD_CHUNK_SIZE - 1) / VOXEL_WORLD_CHUNK_SIZE;
+    worldArena = sfArenaReserve(64 * GIGABYTE, 0);
+    sfArenaTag(&worldArena, "world");
+    world = sfVoxelWorldArenaAlloc(&worldArena, chunks, 1, chunks,
+                                   v3_make(0.0f, -2.0f, 0.0f), 2.0f);
+    world->texture = containerTexture;
+    sfVoxelWorldInitFloor(world, floorSize, floorSize);
+  }
+
+  // NOTE: One packet per voxel set, world chunk and the particles
+  RenderQueue *renderQueue = sfRenderQueueArenaAlloc(
+      &voxelsArena, MAX_VOXELS + (world ? world->chunkCount : 0) + 1);
+
+  // NOTE: Culling bodies walks the physics octree, so playback draws all
+  Culler *particlesCuller = NULL;
+  if (shouldCull && !trajectoryReader) {
+    particlesCuller = sfCullerArenaAlloc(&particlesArena, bodies->count);
+  }
 
   int starProgram = createShaderProgram("shaders/basic.vs", "shaders/basic.fs");
   int voxelProgram =
@@ -354,6 +491,16 @@ int main() {
       createShaderProgram("shaders/voxels.vs", "shaders/debug.fs");
   int particlesProgram =
       createShaderProgram("shaders/particles.vs", "shaders/particles.fs");
+  unsigned cameraUniforms = sfCameraUniformsCreate();
+
+  // NOTE: Resolved once, the frame loop sets uniforms through the handles
+  ProgramUniform *starTimeUniform = sfProgramUniform(starProgram, "time");
+  ProgramUniform *totalParticlesUniform =
+      sfProgramUniform(particlesProgram, "totalParticles");
+  ProgramUniform *worldSizeUniform =
+      sfProgramUniform(particlesProgram, "worldSize");
+  ProgramUniform *lodPixelsUniform =
+      sfProgramUniform(particlesProgram, "lodPixels");
 
   Camera camera = {0};
   sfInitCamera(&camera);
@@ -372,19 +519,37 @@ int main() {
   char fovAnimTimeStart = time;
   float fovAnimTime = 0;
 
-  Arena octreeArena = sfArenaCreate(MEGABYTE, 100);
+  Arena octreeArena = sfArenaReserve(64 * GIGABYTE, ARENA_HUGE_PAGES);
+  sfArenaTag(&octreeArena, "octree");
   Octree *octree =
-      sfOctreeArenaAlloc(&octreeArena, 1.0f, 1.0f, 8 * physCubes->count - 1);
+      sfOctreeArenaAlloc(&octreeArena, 1.0f, 1.0f, 8 * bodies->count - 1);
+
+  Arena trajectoryArena = {0};
+  TrajectoryWriter *trajectoryWriter = NULL;
+  if (recordPath) {
+    trajectoryArena = sfArenaReserve(64 * GIGABYTE, 0);
+    sfArenaTag(&trajectoryArena, "trajectory");
+    trajectoryWriter = sfTrajectoryWriterArenaAlloc(
+        &trajectoryArena, recordPath, bodies->count, recordEvery, 64);
+  }
+  unsigned physicsStep = 0;
+
+  Diagnostics diagnostics;
+  sfDiagnosticsReset(&diagnostics);
 
   Keyboard *keyboard = input->keyboard;
 
   unsigned char wasDebugStepDown = 0;
+  unsigned char wasTogglePlaybackDown = 0;
   unsigned char shouldUpdatePhysics = 0;
   unsigned char shouldPausePhysics = 0;
+  unsigned char hasOctree = 0;
   while (!glfwWindowShouldClose(window)) {
     float startTime = glfwGetTime();
+    sfArenaReset(&frameArena);
 
     wasDebugStepDown = keyboard->debugStep.isDown;
+    wasTogglePlaybackDown = keyboard->togglePlayback.isDown;
 
     sfInputClearControllers(input);
     glfwPollEvents();
@@ -397,13 +562,36 @@ int main() {
     }
 
     sfUpdate(input, &camera, &player, dt);
+    sfTextureLoaderUpdate(textureLoader, TEXTURE_LOADER_FRAME_BUDGET);
+
+    // NOTE: Physics and playback write straight into the mapped particle
+    // buffers for this frame. With culling only the visible bodies are
+    // written, once the frustum is known
+    sfParticlesBeginFrame(particles);
+    unsigned char hasStreamedParticles = 0;
 
     float physicsTime = glfwGetTime();
     // Calculate gravitational forces
-    if (shouldUpdatePhysics || !shouldPausePhysics) {
-      updatePhysics(octree, physCubes->positions, physCubes->velocities,
-                    physCubes->accelerations, physCubes->masses,
-                    physCubes->count, dt);
+    if (!trajectoryReader && (shouldUpdatePhysics || !shouldPausePhysics)) {
+      if (particlesCuller) {
+        updatePhysics(&frameArena, octree, bodies, dt,
+                      diagnosticsEvery ? &diagnostics : NULL, NULL, NULL);
+      } else {
+        updatePhysics(&frameArena, octree, bodies, dt,
+                      diagnosticsEvery ? &diagnostics : NULL,
+                      particles->positions, particles->velocities);
+        hasStreamedParticles = 1;
+      }
+      hasOctree = 1;
+
+      if (diagnosticsEvery && physicsStep % diagnosticsEvery == 0) {
+        sfDiagnosticsPrint(&diagnostics, physicsStep);
+      }
+
+      if (trajectoryWriter) {
+        sfTrajectoryWriterRecord(trajectoryWriter, physicsStep, bodies);
+      }
+      ++physicsStep;
     }
     physicsTime = glfwGetTime() - physicsTime;
 
@@ -434,43 +622,78 @@ int main() {
 
     glUseProgram(starProgram);
 
-    setUniformFloat(starProgram, "time", time);
+    sfUniformSetFloat(starTimeUniform, time);
     v3 cameraCenter = v3_add(camera.position, camera.forward);
     m44 view = lookAt(camera.position, cameraCenter, camera.up);
     m44 projection =
         perspective(fov, windowWidth / (float)windowHeight, 0.1f, 1000.0f);
-
-    setUniformM44(starProgram, "projection", &projection);
-    setUniformM44(starProgram, "view", &view);
+    Frustum frustum = sfFrustumFromViewProjection(&view, &projection);
+    sfCameraUniformsUpdate(cameraUniforms, &projection, &view,
+                           camera.position);
 
     // glBindVertexArray(starVao);
     // glDrawArraysInstanced(GL_TRIANGLES, 0, starVertexCount,
     // starInstanceCount);
 
-    glUseProgram(voxelProgram);
-    setUniformM44(voxelProgram, "projection", &projection);
-    setUniformM44(voxelProgram, "view", &view);
-
-    // sfVoxelsFromCubes(cubeVoxels, physCubes);
+    // sfVoxelsFromBodies(cubeVoxels, bodies);
 
     // Render voxel arena
     for (int i = 0; i < voxelsCount; ++i) {
-      sfRenderVoxels(voxels[i]);
+      if (voxels[i]->culler) {
+        sfCullVoxels(voxels[i], &frustum);
+      }
+      sfVoxelsSubmit(renderQueue, voxels[i], voxelProgram, 0.0f);
+    }
+
+    if (world) {
+      sfVoxelWorldUpdate(world);
+      sfVoxelWorldSubmit(renderQueue, world, voxelProgram,
+                         shouldCull ? &frustum : NULL, camera.position);
     }
 
-    for (int i = 0; i < particles->count; ++i) {
-      particles->positions[i] = physCubes->positions[i];
-      particles->velocities[i] = physCubes->velocities[i];
+    if (trajectoryReader) {
+      if (keyboard->togglePlayback.isDown && !wasTogglePlaybackDown) {
+        isPlaybackPaused = !isPlaybackPaused;
+      }
+
+      float frameCount = trajectoryReader->frameCount;
+      if (keyboard->scrubForward.isDown) {
+        playhead += scrubSpeed;
+      } else if (keyboard->scrubBackward.isDown) {
+        playhead -= scrubSpeed;
+      } else if (!isPlaybackPaused) {
+        playhead += 1.0f;
+      }
+      // NOTE: Scrubbing can step over more than one recording's length
+      playhead = fmodf(playhead, frameCount);
+      if (playhead < 0.0f) {
+        playhead += frameCount;
+      }
+
+      sfTrajectoryReaderFrame(trajectoryReader, (unsigned)playhead,
+                              particles->positions, particles->velocities);
+    } else if (particlesCuller && hasOctree) {
+      // NOTE: The octree is from the start of the step, its bounds are
+      // padded by the culler's margin to cover the integration since
+      sfCullerSetLOD(particlesCuller, camera.position, &projection,
+                     windowHeight, lodPixels);
+      particles->drawCount =
+          sfCullOctree(particlesCuller, octree, bodies, &frustum);
+      sfCullerGatherBodies(particlesCuller, octree, bodies,
+                           particles->positions, particles->velocities,
+                           particles->weights);
+      particles->hasWeights = 1;
+    } else if (!hasStreamedParticles) {
+      sfBodiesGatherPositions(bodies, particles->positions);
+      sfBodiesGatherVelocities(bodies, particles->velocities);
     }
     glUseProgram(particlesProgram);
-    setUniformM44(particlesProgram, "projection", &projection);
-    setUniformM44(particlesProgram, "view", &view);
-    setUniformF3(particlesProgram, "cameraPos", camera.position.x,
-                 camera.position.y, camera.position.z);
-    setUniformI1(particlesProgram, "totalParticles", particles->count);
-    setUniformFloat(particlesProgram, "worldSize", v3_len(worldDimensions));
+    sfUniformSetI1(totalParticlesUniform, particles->count);
+    sfUniformSetFloat(worldSizeUniform, v3_len(worldDimensions));
+    sfUniformSetFloat(lodPixelsUniform, lodPixels);
 
-    sfParticlesRender(particles);
+    sfParticlesSubmit(renderQueue, particles, particlesProgram);
+    sfRenderQueueExecute(renderQueue);
 
     glUseProgram(0);
     glBindVertexArray(0);
@@ -490,13 +713,36 @@ int main() {
     //        physicsTime * 1000.0f);
 
     printf("r: %f\n",
-           v3_len(v3_sub(physCubes->positions[1], physCubes->positions[0])));
+           v3_len(v3_sub(sfBodiesPosition(bodies, 1),
+                         sfBodiesPosition(bodies, 0))));
 
     glfwSetWindowTitle(window, windowTitle);
   }
 
+  if (trajectoryReader) {
+    sfTrajectoryReaderClose(trajectoryReader);
+    sfArenaFree(&playbackArena);
+  }
+
+  if (trajectoryWriter) {
+    sfTrajectoryWriterClose(trajectoryWriter);
+    sfArenaFree(&trajectoryArena);
+  }
+
+  if (world) {
+    sfVoxelWorldDestroy(world);
+    sfArenaFree(&worldArena);
+  }
+
+  for (unsigned i = 0; i < voxelsCount; ++i) {
+    sfDestroyVoxels(voxels[i]);
+  }
+  sfParticlesDestroy(particles);
+  sfTextureLoaderDestroy(textureLoader);
+
+  sfArenaFree(&frameArena);
   sfArenaFree(&voxelsArena);
-  sfArenaFree(&cubesArena);
+  sfArenaFree(&bodiesArena);
   sfArenaFree(&inputArena);
 
   glfwDestroyWindow(window);
@@ -0,0 +1,614 @@
+#include "arena.h"
+#include "bodies.h"
+#include "gravity.h"
+#include "initial_conditions.h"
+#include "octree.h"
+#include "parallel.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_MAX_DISTRIBUTIONS 4
+#define BENCH_MAX_STEPS 1024
+#define BENCH_MAX_SETTINGS 16
+#define BENCH_DIRECT_MIN_BATCH 64
+
+typedef enum {
+  PHASE_OCTANT,
+  PHASE_OCTANT_SOA,
+  PHASE_CLEAR,
+  PHASE_INSERT,
+  PHASE_PROPAGATE,
+  PHASE_FORCE,
+  PHASE_INTEGRATE,
+  PHASE_STEP,
+  PHASE_COUNT
+} BenchPhase;
+
+static const char *phaseNames[PHASE_COUNT] = {
+    "octant_containing", "octant_containing_soa", "clear", "insert",
+    "propagate",         "force",                 "integrate", "step"};
+
+static const char *distributionNames[BENCH_MAX_DISTRIBUTIONS] = {
+    "plummer", "disk", "collapse", "pair"};
+
+typedef struct {
+  unsigned minBodies;
+  unsigned maxBodies;
+  unsigned seedCount;
+  unsigned warmupSteps;
+  unsigned steps;
+  float theta;
+  float epsilon;
+  float dt;
+  unsigned distributionCount;
+  const char *distributions[BENCH_MAX_DISTRIBUTIONS];
+
+  // NOTE: Accuracy mode only
+  unsigned char isAccuracy;
+  uint64_t seed;
+  unsigned thetaCount;
+  float thetas[BENCH_MAX_SETTINGS];
+  unsigned epsilonCount;
+  float epsilons[BENCH_MAX_SETTINGS];
+  float referenceEpsilon;
+} BenchOptions;
+
+/* NOTE:
+ * Timings of one (distribution, body count, seed) run, one sample per timed
+ * step and phase. `interactionCount` sums the force passes of those steps
+ */
+typedef struct {
+  double samples[PHASE_COUNT][BENCH_MAX_STEPS];
+  unsigned long long interactionCount;
+  unsigned nodeCount;
+} BenchRun;
+
+typedef struct {
+  float theta;
+  float epsilon;
+  double stepTime;
+  double forceTime;
+  float medianError;
+  float p99Error;
+  unsigned char isPareto;
+} AccuracyRow;
+
+typedef struct {
+  const Bodies *bodies;
+  float epsilonSquared;
+  float *ax;
+  float *ay;
+  float *az;
+} DirectContext;
+
+static double now() {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+static int compareDoubles(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+// NOTE: Linear interpolation between the closest ranks, `sorted` ascending
+static double percentile(const double *sorted, unsigned count, double p) {
+  double rank = p * (count - 1);
+  unsigned low = (unsigned)rank;
+  if (low + 1 >= count) {
+    return sorted[count - 1];
+  }
+  return sorted[low] + (rank - low) * (sorted[low + 1] - sorted[low]);
+}
+
+// NOTE: One step of `updatePhysics` without diagnostics, timed per phase.
+// `sfOctantContaining` is not part of the step, it is timed on the gathered
+// positions for comparison with the SoA variant the step uses
+static void benchStep(Octree *octree, Bodies *bodies, v3 *positions, float dt,
+                      double *times, unsigned long long *interactionCount) {
+  unsigned bodyCount = bodies->count;
+
+  sfBodiesGatherPositions(bodies, positions);
+  double start = now();
+  Octant octant = sfOctantContaining(positions, bodyCount);
+  times[PHASE_OCTANT] = now() - start;
+  (void)octant;
+
+  start = now();
+  octant = sfOctantContainingSoA(bodies->positionsX, bodies->positionsY,
+                                 bodies->positionsZ, bodyCount);
+  times[PHASE_OCTANT_SOA] = now() - start;
+
+  start = now();
+  sfOctreeClear(octree, &octant);
+  times[PHASE_CLEAR] = now() - start;
+
+  start = now();
+  for (unsigned i = 0; i < bodyCount; ++i) {
+    sfOctreeInsertBody(octree, i, sfBodiesPosition(bodies, i),
+                       bodies->masses[i]);
+  }
+  times[PHASE_INSERT] = now() - start;
+
+  start = now();
+  sfOctreePropagate(octree);
+  times[PHASE_PROPAGATE] = now() - start;
+
+  start = now();
+  sfOctreeAccelerations(octree, bodies->positionsX, bodies->positionsY,
+                        bodies->positionsZ, bodyCount, bodies->accelerationsX,
+                        bodies->accelerationsY, bodies->accelerationsZ, NULL);
+  times[PHASE_FORCE] = now() - start;
+  *interactionCount += atomic_load(&octree->interactionCount);
+
+  start = now();
+  sfBodiesIntegrate(bodies, 0, dt);
+  times[PHASE_INTEGRATE] = now() - start;
+
+  times[PHASE_STEP] = times[PHASE_OCTANT_SOA] + times[PHASE_CLEAR] +
+                      times[PHASE_INSERT] + times[PHASE_PROPAGATE] +
+                      times[PHASE_FORCE] + times[PHASE_INTEGRATE];
+}
+
+static void benchRun(const BenchOptions *options, Arena *bodiesArena,
+                     Arena *octreeArena, InitialConditionsType type,
+                     unsigned bodyCount, uint64_t seed, BenchRun *run) {
+  sfArenaReset(bodiesArena);
+  sfArenaReset(octreeArena);
+
+  Bodies *bodies = sfBodiesArenaAlloc(bodiesArena, bodyCount);
+  InitialConditions ic = sfInitialConditionsDefault(seed);
+  sfInitialConditionsGenerate(bodies, type, &ic);
+  v3 *positions = sfV3ArenaAlloc(bodiesArena, bodyCount);
+  Octree *octree = sfOctreeArenaAlloc(octreeArena, options->theta,
+                                      options->epsilon, 8 * bodyCount - 1);
+
+  double times[PHASE_COUNT];
+  unsigned long long interactionCount = 0;
+  for (unsigned step = 0; step < options->warmupSteps; ++step) {
+    benchStep(octree, bodies, positions, options->dt, times,
+              &interactionCount);
+  }
+
+  run->interactionCount = 0;
+  for (unsigned step = 0; step < options->steps; ++step) {
+    benchStep(octree, bodies, positions, options->dt, times,
+              &run->interactionCount);
+    for (unsigned phase = 0; phase < PHASE_COUNT; ++phase) {
+      run->samples[phase][step] = times[phase];
+    }
+  }
+  run->nodeCount = octree->count;
+}
+
+static void writeRun(FILE *out, const BenchOptions *options,
+                     const char *distribution, unsigned bodyCount,
+                     uint64_t seed, BenchRun *run, unsigned char isFirst) {
+  unsigned steps = options->steps;
+  double forceTime = 0.0;
+  for (unsigned step = 0; step < steps; ++step) {
+    forceTime += run->samples[PHASE_FORCE][step];
+  }
+
+  fprintf(out, "%s\n    {\n", isFirst ? "" : ",");
+  fprintf(out, "      \"distribution\": \"%s\",\n", distribution);
+  fprintf(out, "      \"bodies\": %u,\n", bodyCount);
+  fprintf(out, "      \"seed\": %llu,\n", (unsigned long long)seed);
+  fprintf(out, "      \"nodes_per_body\": %.4f,\n",
+          (double)run->nodeCount / bodyCount);
+  fprintf(out, "      \"interactions_per_body\": %.2f,\n",
+          (double)run->interactionCount / ((double)steps * bodyCount));
+  fprintf(out, "      \"interactions_per_second\": %.4e,\n",
+          forceTime > 0.0 ? run->interactionCount / forceTime : 0.0);
+  fprintf(out, "      \"phases\": {");
+  for (unsigned phase = 0; phase < PHASE_COUNT; ++phase) {
+    double *samples = run->samples[phase];
+    qsort(samples, steps, sizeof(double), compareDoubles);
+    fprintf(out,
+            "%s\n        \"%s\": {\"min_ms\": %.4f, \"median_ms\": %.4f, "
+            "\"p90_ms\": %.4f, \"p99_ms\": %.4f, \"max_ms\": %.4f}",
+            phase ? "," : "", phaseNames[phase], samples[0] * 1e3,
+            percentile(samples, steps, 0.5) * 1e3,
+            percentile(samples, steps, 0.9) * 1e3,
+            percentile(samples, steps, 0.99) * 1e3,
+            samples[steps - 1] * 1e3);
+  }
+  fprintf(out, "\n      }\n    }");
+  fflush(out);
+}
+
+static int compareFloats(const void *a, const void *b) {
+  float x = *(const float *)a;
+  float y = *(const float *)b;
+  return (x > y) - (x < y);
+}
+
+// NOTE: By epsilon, then by time
+static int compareRows(const void *a, const void *b) {
+  const AccuracyRow *x = (const AccuracyRow *)a;
+  const AccuracyRow *y = (const AccuracyRow *)b;
+  return compareDoubles(&x->stepTime, &y->stepTime);
+}
+
+// NOTE: Comma separated, e.g. "0.3,0.5,0.7". Returns how many were read
+static unsigned parseFloats(const char *text, float *values, unsigned max) {
+  unsigned count = 0;
+  char *end;
+  while (count < max) {
+    float value = strtof(text, &end);
+    if (end == text) {
+      break;
+    }
+    values[count++] = value;
+    if (*end != ',') {
+      break;
+    }
+    text = end + 1;
+  }
+  return count;
+}
+
+// NOTE: Every body against every body. The padding lanes of `Bodies` are
+// massless, so the whole capacity goes to the kernel as is
+static void directKernel(void *context, unsigned begin, unsigned end) {
+  const DirectContext *ctx = (const DirectContext *)context;
+  const Bodies *bodies = ctx->bodies;
+  GravitySources sources = {bodies->positionsX, bodies->positionsY,
+                            bodies->positionsZ, bodies->masses};
+  for (unsigned i = begin; i < end; ++i) {
+    v3 acceleration = v3_0();
+    sfGravityAccumulate(&sources, bodies->capacity, sfBodiesPosition(bodies, i),
+                        ctx->epsilonSquared, &acceleration, NULL);
+    ctx->ax[i] = acceleration.x;
+    ctx->ay[i] = acceleration.y;
+    ctx->az[i] = acceleration.z;
+  }
+}
+
+// NOTE: Builds the tree and runs the force pass, without integrating, so
+// every step sees the same positions. Returns the force pass time
+static double accuracyStep(Octree *octree, const Bodies *bodies, float *ax,
+                           float *ay, float *az) {
+  unsigned bodyCount = bodies->count;
+  Octant octant =
+      sfOctantContainingSoA(bodies->positionsX, bodies->positionsY,
+                            bodies->positionsZ, bodyCount);
+  sfOctreeClear(octree, &octant);
+  for (unsigned i = 0; i < bodyCount; ++i) {
+    sfOctreeInsertBody(octree, i, sfBodiesPosition(bodies, i),
+                       bodies->masses[i]);
+  }
+  sfOctreePropagate(octree);
+
+  double start = now();
+  sfOctreeAccelerations(octree, bodies->positionsX, bodies->positionsY,
+                        bodies->positionsZ, bodyCount, ax, ay, az, NULL);
+  return now() - start;
+}
+
+/* NOTE:
+ * Sweeps theta and epsilon over one distribution. Every row is measured
+ * against one direct sum at `referenceEpsilon`, unsoftened by default, so the
+ * errors include the softening as well as the tree approximation and rows of
+ * any epsilon compare. The direct sum goes through the same gravity kernels,
+ * which agree with a double precision sum to about 1e-6. A row is on the
+ * Pareto front when no other row is at least as fast and as accurate, at both
+ * the median and the 99th percentile, and better in one of them.
+ */
+static void benchAccuracy(const BenchOptions *options, FILE *out) {
+  unsigned bodyCount = options->minBodies;
+  const char *distribution = options->distributions[0];
+  InitialConditionsType type;
+  sfInitialConditionsParseType(distribution, &type);
+
+  Arena bodiesArena = sfArenaReserve(64 * GIGABYTE, ARENA_HUGE_PAGES);
+  Arena octreeArena = sfArenaReserve(64 * GIGABYTE, ARENA_HUGE_PAGES);
+  sfArenaTag(&bodiesArena, "bodies");
+  sfArenaTag(&octreeArena, "octree");
+
+  Bodies *bodies = sfBodiesArenaAlloc(&bodiesArena, bodyCount);
+  InitialConditions ic = sfInitialConditionsDefault(options->seed);
+  sfInitialConditionsGenerate(bodies, type, &ic);
+  float *directX = sfFloatsArenaAllocAligned(&bodiesArena, bodies->capacity);
+  float *directY = sfFloatsArenaAllocAligned(&bodiesArena, bodies->capacity);
+  float *directZ = sfFloatsArenaAllocAligned(&bodiesArena, bodies->capacity);
+  float *treeX = sfFloatsArenaAllocAligned(&bodiesArena, bodies->capacity);
+  float *treeY = sfFloatsArenaAllocAligned(&bodiesArena, bodies->capacity);
+  float *treeZ = sfFloatsArenaAllocAligned(&bodiesArena, bodies->capacity);
+  float *errors = sfFloatsArenaAllocAligned(&bodiesArena, bodies->capacity);
+
+  AccuracyRow rows[BENCH_MAX_SETTINGS * BENCH_MAX_SETTINGS];
+  unsigned rowCount = 0;
+  double samples[BENCH_MAX_STEPS];
+  double forceSamples[BENCH_MAX_STEPS];
+
+  float referenceEpsilon = options->referenceEpsilon;
+  fprintf(stderr, "Direct sum, epsilon %g\n", referenceEpsilon);
+  DirectContext context = {bodies, referenceEpsilon * referenceEpsilon,
+                           directX, directY, directZ};
+  double directStart = now();
+  sfParallelFor(bodyCount, BENCH_DIRECT_MIN_BATCH, directKernel, &context);
+  double directTime = now() - directStart;
+
+  for (unsigned e = 0; e < options->epsilonCount; ++e) {
+    float epsilon = options->epsilons[e];
+    for (unsigned t = 0; t < options->thetaCount; ++t) {
+      float theta = options->thetas[t];
+      fprintf(stderr, "Theta %g, epsilon %g\n", theta, epsilon);
+      sfArenaReset(&octreeArena);
+      Octree *octree =
+          sfOctreeArenaAlloc(&octreeArena, theta, epsilon, 8 * bodyCount - 1);
+
+      for (unsigned step = 0; step < options->warmupSteps; ++step) {
+        accuracyStep(octree, bodies, treeX, treeY, treeZ);
+      }
+      for (unsigned step = 0; step < options->steps; ++step) {
+        double start = now();
+        forceSamples[step] = accuracyStep(octree, bodies, treeX, treeY, treeZ);
+        samples[step] = now() - start;
+      }
+      qsort(samples, options->steps, sizeof(double), compareDoubles);
+      qsort(forceSamples, options->steps, sizeof(double), compareDoubles);
+
+      for (unsigned i = 0; i < bodyCount; ++i) {
+        v3 direct = v3_make(directX[i], directY[i], directZ[i]);
+        v3 tree = v3_make(treeX[i], treeY[i], treeZ[i]);
+        float magnitude = v3_len(direct);
+        errors[i] = magnitude > 0.0f
+                        ? v3_len(v3_sub(tree, direct)) / magnitude
+                        : 0.0f;
+      }
+      qsort(errors, bodyCount, sizeof(float), compareFloats);
+
+      AccuracyRow *row = &rows[rowCount++];
+      row->theta = theta;
+      row->epsilon = epsilon;
+      row->stepTime = percentile(samples, options->steps, 0.5);
+      row->forceTime = percentile(forceSamples, options->steps, 0.5);
+      row->medianError = errors[bodyCount / 2];
+      row->p99Error = errors[(unsigned)(0.99 * (bodyCount - 1))];
+    }
+  }
+
+  for (unsigned i = 0; i < rowCount; ++i) {
+    AccuracyRow *row = &rows[i];
+    row->isPareto = 1;
+    for (unsigned j = 0; j < rowCount && row->isPareto; ++j) {
+      const AccuracyRow *other = &rows[j];
+      unsigned char isNoWorse = other->stepTime <= row->stepTime &&
+                                other->medianError <= row->medianError &&
+                                other->p99Error <= row->p99Error;
+      unsigned char isBetter = other->stepTime < row->stepTime ||
+                               other->medianError < row->medianError ||
+                               other->p99Error < row->p99Error;
+      if (isNoWorse && isBetter) {
+        row->isPareto = 0;
+      }
+    }
+  }
+  qsort(rows, rowCount, sizeof(AccuracyRow), compareRows);
+
+  fprintf(out,
+          "%s, %u bodies, seed %llu, %s kernel, %u threads\n"
+          "Reference direct sum, epsilon %g, %.3f ms per step\n\n",
+          distribution, bodyCount, (unsigned long long)options->seed,
+          sfGravityKernelName(sfGravityKernelType()), sfParallelThreadCount(),
+          referenceEpsilon, directTime * 1e3);
+  fprintf(out, "%8s %8s %10s %10s %12s %12s %7s\n", "theta", "epsilon",
+          "step_ms", "force_ms", "median_err", "p99_err", "pareto");
+  for (unsigned i = 0; i < rowCount; ++i) {
+    const AccuracyRow *row = &rows[i];
+    fprintf(out, "%8.3f %8.3f %10.3f %10.3f %12.3e %12.3e %7s\n", row->theta,
+            row->epsilon, row->stepTime * 1e3, row->forceTime * 1e3,
+            row->medianError, row->p99Error, row->isPareto ? "*" : "");
+  }
+}
+
+static void usage(const char *name) {
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "  --bodies N            only run N bodies\n"
+          "  --min-bodies N        smallest body count, default 1000\n"
+          "  --max-bodies N        largest body count, default 10000000\n"
+          "  --seeds N             seeds 1..N per size, default 3\n"
+          "  --ic NAME             plummer, disk, collapse or pair, repeat "
+          "for several, default all\n"
+          "  --warmup N            untimed steps per run, default 2\n"
+          "  --steps N             timed steps per run, default 15\n"
+          "  --theta X             default 1.0\n"
+          "  --epsilon X           default 1.0\n"
+          "  --dt X                default 0.001\n"
+          "  --gravity-kernel NAME scalar, sse, avx2 or avx512\n"
+          "  --out PATH            output, default stdout\n"
+          "  --accuracy            sweep theta and epsilon against the "
+          "direct sum\n"
+          "                        for the first --ic, --bodies (default "
+          "20000)\n"
+          "                        and --seed, print a Pareto table\n"
+          "  --seed N              accuracy mode seed, default 1\n"
+          "  --thetas LIST         accuracy mode, default "
+          "0.2,0.3,0.5,0.7,1,1.5\n"
+          "  --epsilons LIST       accuracy mode, default 0.01,0.05,0.1,0.5,1\n"
+          "  --reference-epsilon X accuracy mode, softening of the direct "
+          "sum\n"
+          "                        every row is measured against, default 0\n",
+          name);
+}
+
+/* NOTE:
+ * Headless benchmark of the physics step. Body counts go up by decades from
+ * `--min-bodies` to `--max-bodies`, every distribution and seed is a run of
+ * its own. The octree is sized like the viewer's, 8 nodes per body, which is
+ * about 6 GB at 10^7 bodies. `--accuracy` runs `benchAccuracy` instead.
+ */
+int main(int argc, char **argv) {
+  BenchOptions options = {0};
+  options.minBodies = 1000;
+  options.maxBodies = 10000000;
+  options.seedCount = 3;
+  options.warmupSteps = 2;
+  options.steps = 15;
+  options.theta = 1.0f;
+  options.epsilon = 1.0f;
+  options.dt = 0.001f;
+  options.seed = 1;
+  const char *gravityKernelName = NULL;
+  const char *outPath = NULL;
+  unsigned char hasBodies = 0;
+
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--bodies") && i + 1 < argc) {
+      options.minBodies = (unsigned)atoi(argv[++i]);
+      options.maxBodies = options.minBodies;
+      hasBodies = 1;
+    } else if (!strcmp(argv[i], "--min-bodies") && i + 1 < argc) {
+      options.minBodies = (unsigned)atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--max-bodies") && i + 1 < argc) {
+      options.maxBodies = (unsigned)atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--seeds") && i + 1 < argc) {
+      options.seedCount = (unsigned)atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--ic") && i + 1 < argc) {
+      InitialConditionsType type;
+      if (sfInitialConditionsParseType(argv[++i], &type) &&
+          options.distributionCount < BENCH_MAX_DISTRIBUTIONS) {
+        options.distributions[options.distributionCount++] = argv[i];
+      }
+    } else if (!strcmp(argv[i], "--warmup") && i + 1 < argc) {
+      options.warmupSteps = (unsigned)atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--steps") && i + 1 < argc) {
+      options.steps = (unsigned)atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--theta") && i + 1 < argc) {
+      options.theta = (float)atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--epsilon") && i + 1 < argc) {
+      options.epsilon = (float)atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--dt") && i + 1 < argc) {
+      options.dt = (float)atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--gravity-kernel") && i + 1 < argc) {
+      gravityKernelName = argv[++i];
+    } else if (!strcmp(argv[i], "--out") && i + 1 < argc) {
+      outPath = argv[++i];
+    } else if (!strcmp(argv[i], "--accuracy")) {
+      options.isAccuracy = 1;
+    } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+      options.seed = strtoull(argv[++i], NULL, 10);
+    } else if (!strcmp(argv[i], "--thetas") && i + 1 < argc) {
+      options.thetaCount =
+          parseFloats(argv[++i], options.thetas, BENCH_MAX_SETTINGS);
+    } else if (!strcmp(argv[i], "--epsilons") && i + 1 < argc) {
+      options.epsilonCount =
+          parseFloats(argv[++i], options.epsilons, BENCH_MAX_SETTINGS);
+    } else if (!strcmp(argv[i], "--reference-epsilon") && i + 1 < argc) {
+      options.referenceEpsilon = (float)atof(argv[++i]);
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (!options.distributionCount) {
+    for (unsigned i = 0; i < BENCH_MAX_DISTRIBUTIONS; ++i) {
+      options.distributions[options.distributionCount++] =
+          distributionNames[i];
+    }
+  }
+  if (options.steps < 1) {
+    options.steps = 1;
+  }
+  if (options.steps > BENCH_MAX_STEPS) {
+    options.steps = BENCH_MAX_STEPS;
+  }
+  if (options.isAccuracy && !hasBodies) {
+    options.minBodies = 20000;
+  }
+  if (options.minBodies < 2) {
+    options.minBodies = 2;
+  }
+  if (!options.thetaCount) {
+    const float thetas[] = {0.2f, 0.3f, 0.5f, 0.7f, 1.0f, 1.5f};
+    options.thetaCount = sizeof(thetas) / sizeof(float);
+    memcpy(options.thetas, thetas, sizeof(thetas));
+  }
+  if (!options.epsilonCount) {
+    const float epsilons[] = {0.01f, 0.05f, 0.1f, 0.5f, 1.0f};
+    options.epsilonCount = sizeof(epsilons) / sizeof(float);
+    memcpy(options.epsilons, epsilons, sizeof(epsilons));
+  }
+
+  sfGravityInit();
+  if (gravityKernelName) {
+    unsigned type = 0;
+    while (type < GRAVITY_KERNEL_COUNT &&
+           strcmp(gravityKernelName, sfGravityKernelName(type))) {
+      type++;
+    }
+    if (!sfGravitySetKernel(type)) {
+      fprintf(stderr, "ERROR: Gravity kernel %s is not available\n",
+              gravityKernelName);
+      return 1;
+    }
+  }
+
+  FILE *out = stdout;
+  if (outPath) {
+    out = fopen(outPath, "w");
+    if (!out) {
+      fprintf(stderr, "ERROR: Failed to open %s\n", outPath);
+      return 1;
+    }
+  }
+
+  if (options.isAccuracy) {
+    benchAccuracy(&options, out);
+    if (out != stdout) {
+      fclose(out);
+    }
+    return 0;
+  }
+
+  Arena bodiesArena = sfArenaReserve(64 * GIGABYTE, ARENA_HUGE_PAGES);
+  Arena octreeArena = sfArenaReserve(64 * GIGABYTE, ARENA_HUGE_PAGES);
+  sfArenaTag(&bodiesArena, "bodies");
+  sfArenaTag(&octreeArena, "octree");
+  BenchRun *run = (BenchRun *)malloc(sizeof(BenchRun));
+
+  fprintf(out, "{\n");
+  fprintf(out, "  \"gravity_kernel\": \"%s\",\n",
+          sfGravityKernelName(sfGravityKernelType()));
+  fprintf(out, "  \"threads\": %u,\n", sfParallelThreadCount());
+  fprintf(out, "  \"theta\": %g,\n", options.theta);
+  fprintf(out, "  \"epsilon\": %g,\n", options.epsilon);
+  fprintf(out, "  \"dt\": %g,\n", options.dt);
+  fprintf(out, "  \"warmup_steps\": %u,\n", options.warmupSteps);
+  fprintf(out, "  \"steps\": %u,\n", options.steps);
+  fprintf(out, "  \"runs\": [");
+
+  unsigned char isFirst = 1;
+  for (unsigned long long bodyCount = options.minBodies;
+       bodyCount <= options.maxBodies; bodyCount *= 10) {
+    for (unsigned d = 0; d < options.distributionCount; ++d) {
+      InitialConditionsType type;
+      sfInitialConditionsParseType(options.distributions[d], &type);
+      for (uint64_t seed = 1; seed <= options.seedCount; ++seed) {
+        fprintf(stderr, "%s, %llu bodies, seed %llu\n",
+                options.distributions[d], bodyCount,
+                (unsigned long long)seed);
+        benchRun(&options, &bodiesArena, &octreeArena, type,
+                 (unsigned)bodyCount, seed, run);
+        writeRun(out, &options, options.distributions[d],
+                 (unsigned)bodyCount, seed, run, isFirst);
+        isFirst = 0;
+      }
+    }
+  }
+  fprintf(out, "\n  ]\n}\n");
+
+  free(run);
+  if (out != stdout) {
+    fclose(out);
+  }
+  return 0;
+}
@@ -1,14 +1,15 @@
 #include "arena.h"
+#include "dirty_ranges.h"
+#include "gl_extensions.h"
 #include "math3d.h"
 #include <glad/glad.h>
 #define GLFW_INCLUDE_NONE
 #include <GLFW/glfw3.h>
 #include <stdio.h>
 #include <stdlib.h>
-#define STB_IMAGE_IMPLEMENTATION
 #include "shader.h"
 #include "starfield.h"
-#include "stb_image.h"
+#include "texture_loader.h"
 
 void glfwFramebufferSizeCallback(GLFWwindow *window, int width, int height) {
   State *state = (State *)glfwGetWindowUserPointer(window);
@@ -124,51 +125,6 @@ GLFWwindow *initGlfwWindow(int width, int height) {
   return window;
 }
 
-typedef struct {
-  unsigned id;
-  int width;
-  int height;
-  int channels;
-} Texture;
-
-Texture loadImageAsTexture(const char *filename, GLint minFilter,
-                           GLint magFilter) {
-  stbi_set_flip_vertically_on_load(1);
-  Texture texture = {0};
-  unsigned char *texData = stbi_load(filename, &texture.width, &texture.height,
-                                     &texture.channels, 0);
-  if (!texData) {
-    fprintf(stderr, "ERROR: Failed to load texture\n");
-  }
-
-  GLint format = GL_RGB;
-  if (texture.channels > 3) {
-    format = GL_RGBA;
-  }
-
-  glGenTextures(1, &texture.id);
-
-  glBindTexture(GL_TEXTURE_2D, texture.id);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minFilter);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, magFilter);
-  glTexImage2D(GL_TEXTURE_2D, 0, format, texture.width, texture.height, 0,
-               format, GL_UNSIGNED_BYTE, texData);
-
-  switch (minFilter) {
-  case GL_NEAREST_MIPMAP_NEAREST:
-  case GL_NEAREST_MIPMAP_LINEAR:
-  case GL_LINEAR_MIPMAP_NEAREST:
-  case GL_LINEAR_MIPMAP_LINEAR:
-    glGenerateMipmap(GL_TEXTURE_2D);
-    break;
-  }
-
-  stbi_image_free(texData);
-  return texture;
-}
-
 int main() {
   if (!glfwInit()) {
     fprintf(stderr, "Failed to init glfw\n");
@@ -180,6 +136,7 @@ int main() {
   GLFWwindow *window = initGlfwWindow(windowWidth, windowHeight);
 
   gladLoadGLLoader((GLADloadproc)glfwGetProcAddress);
+  sfLoadGLExtensions((GLADloadproc)glfwGetProcAddress);
   glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 
   Arena stateArena = sfArenaCreate(MEGABYTE, 1);
@@ -197,8 +154,15 @@ int main() {
 
   int spritesheetProgram =
       createShaderProgram("shaders/tiles.vs", "shaders/tiles.fs");
-  Texture spritesheetTexture =
-      loadImageAsTexture("res/spritesheet.png", GL_NEAREST, GL_NEAREST);
+  unsigned cameraUniforms = sfCameraUniformsCreate();
+
+  // NOTE: Resolved once, the frame loop sets uniforms through the handles
+  ProgramUniform *textureIdUniform =
+      sfProgramUniform(spritesheetProgram, "textureId");
+  ProgramUniform *tileSizeUniform =
+      sfProgramUniform(spritesheetProgram, "tileSize");
+  ProgramUniform *spriteSheetSizeUniform =
+      sfProgramUniform(spritesheetProgram, "spriteSheetSize");
 
   unsigned quadVao;
   unsigned quadVbos[3];
@@ -218,8 +182,14 @@ int main() {
   };
 
   Arena tileArena = sfArenaCreate(MEGABYTE, 10);
+  TextureLoader *textureLoader = sfTextureLoaderArenaAlloc(&tileArena);
+  AsyncTexture *spritesheetTexture = sfTextureLoaderLoad(
+      textureLoader, "res/spritesheet.png", GL_NEAREST, GL_NEAREST);
   m44 *tileTransforms =
       (m44 *)sfArenaAlloc(&tileArena, sizeof(m44) * tileCount);
+  // NOTE: Tiles are static, the initial glBufferData is their only upload
+  // until something marks a range here
+  DirtyRanges tileTransformsDirty = {0};
 
   int tileIds[] = {
       1, 1, 1, 1, 1, 0, 0, 1, 1, 0, 0, 1, 1, 1, 1, 1,
@@ -285,6 +255,7 @@ int main() {
     glfwPollEvents();
 
     sfUpdate(input, &camera, &player, dt);
+    sfTextureLoaderUpdate(textureLoader, TEXTURE_LOADER_FRAME_BUDGET);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     glUseProgram(spritesheetProgram);
@@ -294,19 +265,21 @@ int main() {
                       v3_make(0.0f, 1.0f, 0.0f));
     m44 projection = orthographic(0, windowWidth, 0, windowHeight, 0, 1);
 
-    setUniformM44(spritesheetProgram, "projection", &projection);
-    setUniformM44(spritesheetProgram, "view", &view);
+    sfCameraUniformsUpdate(cameraUniforms, &projection, &view,
+                           v3_make(0.0f, 0.0f, 1.0f));
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, spritesheetTexture.id);
-    glUniform1i(glGetUniformLocation(spritesheetProgram, "textureId"), 0);
-    glUniform1f(glGetUniformLocation(spritesheetProgram, "tileSize"), 16.0f);
-    glUniform2f(glGetUniformLocation(spritesheetProgram, "spriteSheetSize"),
-                spritesheetTexture.width, spritesheetTexture.height);
+    glBindTexture(GL_TEXTURE_2D, spritesheetTexture->id);
+    sfUniformSetI1(textureIdUniform, 0);
+    sfUniformSetFloat(tileSizeUniform, 16.0f);
+    sfUniformSetF2(spriteSheetSizeUniform, spritesheetTexture->width,
+                   spritesheetTexture->height);
 
     glBindVertexArray(quadVao);
-    glBindBuffer(GL_ARRAY_BUFFER, quadVbos[2]);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(m44) * tileCount,
-                    tileTransforms);
+    if (tileTransformsDirty.count) {
+      glBindBuffer(GL_ARRAY_BUFFER, quadVbos[2]);
+      sfDirtyRangesUpload(&tileTransformsDirty, GL_ARRAY_BUFFER,
+                          tileTransforms, sizeof(m44));
+    }
 
     glDrawArraysInstanced(GL_TRIANGLES, 0, 6, tileCount);
 
@@ -330,6 +303,7 @@ int main() {
     glfwSetWindowTitle(window, windowTitle);
   }
 
+  sfTextureLoaderDestroy(textureLoader);
   sfArenaFree(&stateArena);
   sfArenaFree(&tileArena);
 
@@ -1,12 +1,18 @@
 #include "octree.h"
+#include "parallel.h"
 #include <math.h>
 
+#define MORTON_BITS 10
+#define MORTON_RADIX_BITS 11
+#define MORTON_RADIX_BUCKETS (1 << MORTON_RADIX_BITS)
+
 Octree *sfOctreeArenaAlloc(Arena *arena, float theta, float epsilon,
                            unsigned maxCount) {
   Octree *octree = (Octree *)sfArenaAlloc(arena, sizeof(Octree));
   octree->count = 0;
   octree->maxCount = maxCount;
   octree->parentsCount = 0;
+  atomic_init(&octree->interactionCount, 0);
   octree->thetaSquared = theta * theta;
   octree->epsilonSquared = epsilon * epsilon;
 
@@ -21,6 +27,18 @@ Octree *sfOctreeArenaAlloc(Arena *arena, float theta, float epsilon,
       (float *)sfArenaAlloc(arena, sizeof(float) * octree->maxCount);
   octree->octants =
       (Octant *)sfArenaAlloc(arena, sizeof(Octant) * octree->maxCount);
+  octree->bodies =
+      (unsigned *)sfArenaAlloc(arena, sizeof(unsigned) * octree->maxCount);
+  octree->bodyNexts =
+      (unsigned *)sfArenaAlloc(arena, sizeof(unsigned) * octree->maxCount);
+  octree->groupKeys =
+      (uint32_t *)sfArenaAlloc(arena, sizeof(uint32_t) * octree->maxCount);
+  octree->groupKeysScratch =
+      (uint32_t *)sfArenaAlloc(arena, sizeof(uint32_t) * octree->maxCount);
+  octree->groupOrder =
+      (unsigned *)sfArenaAlloc(arena, sizeof(unsigned) * octree->maxCount);
+  octree->groupOrderScratch =
+      (unsigned *)sfArenaAlloc(arena, sizeof(unsigned) * octree->maxCount);
 
   return octree;
 }
@@ -66,6 +84,27 @@ Octant sfOctantContaining(const v3 *positions, unsigned count) {
   return (Octant){size, center};
 }
 
+Octant sfOctantContainingSoA(const float *x, const float *y, const float *z,
+                            unsigned count) {
+  float minX = FLT_MAX, minY = FLT_MAX, minZ = FLT_MAX;
+  float maxX = -FLT_MAX, maxY = -FLT_MAX, maxZ = -FLT_MAX;
+  for (unsigned i = 0; i < count; ++i) {
+    minX = fminf(x[i], minX);
+    minY = fminf(y[i], minY);
+    minZ = fminf(z[i], minZ);
+
+    maxX = fmaxf(x[i], maxX);
+    maxY = fmaxf(y[i], maxY);
+    maxZ = fmaxf(z[i], maxZ);
+  }
+
+  v3 center = v3_make((minX + maxX) * 0.5f, (minY + maxY) * 0.5f,
+                      (minZ + maxZ) * 0.5f);
+  float size = fmaxf(maxX - minX, fmaxf(maxY - minY, maxZ - minZ));
+
+  return (Octant){size, center};
+}
+
 void octreeInsertParent(Octree *octree, unsigned node) {
   octree->parents[octree->parentsCount++] = node;
 }
@@ -84,6 +123,7 @@ unsigned octreeSubdivide(Octree *octree, unsigned node) {
     octree->octants[octree->count] = octants[i];
     octree->masses[octree->count] = 0.0f;
     octree->positions[octree->count] = v3_0();
+    octree->bodies[octree->count] = OCTREE_NO_BODY;
     ++octree->count;
   }
 
@@ -91,6 +131,7 @@ unsigned octreeSubdivide(Octree *octree, unsigned node) {
   octree->octants[octree->count] = octants[7];
   octree->masses[octree->count] = 0.0f;
   octree->positions[octree->count] = v3_0();
+  octree->bodies[octree->count] = OCTREE_NO_BODY;
 
   ++octree->count;
 
@@ -98,6 +139,16 @@ unsigned octreeSubdivide(Octree *octree, unsigned node) {
 }
 
 void sfOctreeInsert(Octree *octree, const v3 position, float mass) {
+  sfOctreeInsertBody(octree, OCTREE_NO_BODY, position, mass);
+}
+
+// NOTE: Body indices must be below `maxCount`, they index `bodyNexts`
+void sfOctreeInsertBody(Octree *octree, unsigned body, const v3 position,
+                        float mass) {
+  if (body != OCTREE_NO_BODY) {
+    octree->bodyNexts[body] = OCTREE_NO_BODY;
+  }
+
   unsigned node = 0; // root
   while (octree->children[node] != 0) {
     v3 center = octree->octants[node].center;
@@ -108,11 +159,19 @@ void sfOctreeInsert(Octree *octree, const v3 position, float mass) {
   if (octree->masses[node] == 0) { // is empty
     octree->positions[node] = position;
     octree->masses[node] = mass;
+    octree->bodies[node] = body;
     return;
   }
 
   if (v3_cmp(octree->positions[node], position)) {
     octree->masses[node] += mass;
+    unsigned resident = octree->bodies[node];
+    if (resident == OCTREE_NO_BODY) {
+      octree->bodies[node] = body;
+    } else if (body != OCTREE_NO_BODY) {
+      octree->bodyNexts[body] = octree->bodyNexts[resident];
+      octree->bodyNexts[resident] = body;
+    }
     return;
   }
 
@@ -123,21 +182,29 @@ void sfOctreeInsert(Octree *octree, const v3 position, float mass) {
     unsigned octant2 = findOctant(position, octree->octants[node].center);
 
     if (octant1 == octant2) {
-      node = children + octant1;
+      // NOTE: Carry the resident body down, it still has to be separated
+      unsigned child = children + octant1;
+      octree->positions[child] = octree->positions[node];
+      octree->masses[child] = octree->masses[node];
+      octree->bodies[child] = octree->bodies[node];
+      node = child;
     } else {
       unsigned n1 = children + octant1;
       unsigned n2 = children + octant2;
       octree->positions[n1] = octree->positions[node];
       octree->masses[n1] = octree->masses[node];
+      octree->bodies[n1] = octree->bodies[node];
       octree->positions[n2] = position;
       octree->masses[n2] = mass;
+      octree->bodies[n2] = body;
       return;
     }
   }
 }
 
 void sfOctreePropagate(Octree *octree) {
-  for (int node = octree->parentsCount - 1; node >= 0; --node) {
+  for (int parent = octree->parentsCount - 1; parent >= 0; --parent) {
+    unsigned node = octree->parents[parent];
     int i = octree->children[node];
     v3 centerOfMass = v3_0();
     for (int j = 0; j < 8; ++j) {
@@ -159,24 +226,66 @@ void sfOctreePropagate(Octree *octree) {
   }
 }
 
-v3 sfOctreeAcceleration(const Octree *octree, const v3 position) {
+/* NOTE:
+ * Nodes accepted by a walk, gathered as structure of arrays and handed to the
+ * gravity kernel a batch at a time. The walk stays scalar and the force
+ * evaluation runs at full SIMD width.
+ */
+typedef struct {
+  _Alignas(64) float x[OCTREE_INTERACTION_BATCH];
+  _Alignas(64) float y[OCTREE_INTERACTION_BATCH];
+  _Alignas(64) float z[OCTREE_INTERACTION_BATCH];
+  _Alignas(64) float masses[OCTREE_INTERACTION_BATCH];
+  unsigned count;
+} InteractionList;
+
+// NOTE: Returns 1 once the list is full and has to be flushed
+static inline unsigned char interactionListPush(InteractionList *list,
+                                                v3 position, float mass) {
+  list->x[list->count] = position.x;
+  list->y[list->count] = position.y;
+  list->z[list->count] = position.z;
+  list->masses[list->count] = mass;
+  return ++list->count == OCTREE_INTERACTION_BATCH;
+}
+
+// NOTE: Pads with massless entries up to the kernels' width
+static GravitySources interactionListSources(InteractionList *list) {
+  while (list->count % GRAVITY_SIMD_WIDTH) {
+    interactionListPush(list, v3_0(), 0.0f);
+  }
+  return (GravitySources){list->x, list->y, list->z, list->masses};
+}
+
+// NOTE: `computePotential` is a constant at every call site
+static inline v3 octreeWalk(const Octree *octree, const v3 position,
+                            const int computePotential, float *potential) {
+  InteractionList list;
+  list.count = 0;
+
   v3 acceleration = v3_0();
+  float phi = 0.0f;
+  float *phiOut = computePotential ? &phi : NULL;
   unsigned node = 0;
-  const float squaredSoftening = 40.0f;
 
   while (1) {
     v3 d = v3_sub(octree->positions[node], position);
-    float distance = v3_len(d);
-    float distanceSquared = distance * distance;
+    float distanceSquared = v3_dot(d, d);
 
     float sizeSquared = octree->octants[node].size * octree->octants[node].size;
     // is leaf or satisfies criterion
     if (octree->children[node] == 0 ||
         sizeSquared < distanceSquared * octree->thetaSquared) {
 
-      float denom = (distanceSquared + octree->epsilonSquared) * distance;
-      v3 inc = v3_scale(d, fminf((octree->masses[node] / denom), FLT_MAX));
-      acceleration = v3_add(acceleration, inc);
+      // NOTE: Empty leaves pull with nothing
+      if (octree->masses[node] > 0.0f &&
+          interactionListPush(&list, octree->positions[node],
+                              octree->masses[node])) {
+        GravitySources sources = interactionListSources(&list);
+        sfGravityAccumulate(&sources, list.count, position,
+                            octree->epsilonSquared, &acceleration, phiOut);
+        list.count = 0;
+      }
 
       if (octree->nexts[node] == 0) {
         break;
@@ -188,9 +297,212 @@ v3 sfOctreeAcceleration(const Octree *octree, const v3 position) {
     }
   }
 
+  GravitySources sources = interactionListSources(&list);
+  sfGravityAccumulate(&sources, list.count, position, octree->epsilonSquared,
+                      &acceleration, phiOut);
+
+  if (computePotential) {
+    *potential = phi;
+  }
   return acceleration;
 }
 
+v3 sfOctreeAcceleration(const Octree *octree, const v3 position) {
+  return octreeWalk(octree, position, 0, NULL);
+}
+
+v3 sfOctreeAccelerationPotential(const Octree *octree, const v3 position,
+                                 float *potential) {
+  return octreeWalk(octree, position, 1, potential);
+}
+
+// NOTE: Spreads the low 10 bits of `v` three bits apart
+static uint32_t mortonSpread(uint32_t v) {
+  v &= 0x3ff;
+  v = (v | (v << 16)) & 0x030000ff;
+  v = (v | (v << 8)) & 0x0300f00f;
+  v = (v | (v << 4)) & 0x030c30c3;
+  v = (v | (v << 2)) & 0x09249249;
+  return v;
+}
+
+// NOTE: Orders bodies along a Morton curve over the root octant, so
+// consecutive bodies are close and a run of them makes a tight group
+static void octreeGroupOrder(Octree *octree, const float *x, const float *y,
+                             const float *z, unsigned count) {
+  const Octant *root = &octree->octants[0];
+  float size = root->size > 0.0f ? root->size : 1.0f;
+  float scale = (float)((1 << MORTON_BITS) - 1) / size;
+  v3 origin = v3_sub(root->center, v3_make(size * 0.5f, size * 0.5f,
+                                           size * 0.5f));
+
+  for (unsigned i = 0; i < count; ++i) {
+    float cx = fminf(fmaxf((x[i] - origin.x) * scale, 0.0f), 1023.0f);
+    float cy = fminf(fmaxf((y[i] - origin.y) * scale, 0.0f), 1023.0f);
+    float cz = fminf(fmaxf((z[i] - origin.z) * scale, 0.0f), 1023.0f);
+    octree->groupKeys[i] = mortonSpread((uint32_t)cx) |
+                           mortonSpread((uint32_t)cy) << 1 |
+                           mortonSpread((uint32_t)cz) << 2;
+    octree->groupOrder[i] = i;
+  }
+
+  unsigned histogram[MORTON_RADIX_BUCKETS];
+  for (unsigned shift = 0; shift < 3 * MORTON_BITS;
+       shift += MORTON_RADIX_BITS) {
+    memset(histogram, 0, sizeof(histogram));
+    for (unsigned i = 0; i < count; ++i) {
+      histogram[(octree->groupKeys[i] >> shift) & (MORTON_RADIX_BUCKETS - 1)]++;
+    }
+    unsigned offset = 0;
+    for (unsigned bucket = 0; bucket < MORTON_RADIX_BUCKETS; ++bucket) {
+      unsigned bucketCount = histogram[bucket];
+      histogram[bucket] = offset;
+      offset += bucketCount;
+    }
+    for (unsigned i = 0; i < count; ++i) {
+      uint32_t key = octree->groupKeys[i];
+      unsigned slot = histogram[(key >> shift) & (MORTON_RADIX_BUCKETS - 1)]++;
+      octree->groupKeysScratch[slot] = key;
+      octree->groupOrderScratch[slot] = octree->groupOrder[i];
+    }
+
+    uint32_t *keys = octree->groupKeys;
+    octree->groupKeys = octree->groupKeysScratch;
+    octree->groupKeysScratch = keys;
+    unsigned *order = octree->groupOrder;
+    octree->groupOrder = octree->groupOrderScratch;
+    octree->groupOrderScratch = order;
+  }
+}
+
+typedef struct {
+  const Octree *octree;
+  const float *x;
+  const float *y;
+  const float *z;
+  unsigned count;
+  float *ax;
+  float *ay;
+  float *az;
+  float *potentials;
+  atomic_ullong *interactionCount;
+} GroupContext;
+
+// NOTE: Evaluates every body of the group against the list and empties it
+static void groupFlush(const GroupContext *ctx, const unsigned *bodies,
+                       unsigned bodyCount, InteractionList *list,
+                       v3 *accelerations, float *potentials) {
+  GravitySources sources = interactionListSources(list);
+  for (unsigned i = 0; i < bodyCount; ++i) {
+    unsigned body = bodies[i];
+    v3 position = v3_make(ctx->x[body], ctx->y[body], ctx->z[body]);
+    sfGravityAccumulate(&sources, list->count, position,
+                        ctx->octree->epsilonSquared, &accelerations[i],
+                        potentials ? &potentials[i] : NULL);
+  }
+  list->count = 0;
+}
+
+/* NOTE:
+ * One walk per group of OCTREE_GROUP_SIZE bodies. A node is accepted when it
+ * passes the opening criterion from the nearest point of the group's bounds,
+ * so it passes for every body of the group and the shared list is at least
+ * as accurate as per body walks. The walk is amortized over the group and the
+ * kernels see long lists.
+ */
+static void groupKernel(void *context, unsigned begin, unsigned end) {
+  const GroupContext *ctx = (const GroupContext *)context;
+  const Octree *octree = ctx->octree;
+  InteractionList list;
+  list.count = 0;
+  v3 accelerations[OCTREE_GROUP_SIZE];
+  float potentials[OCTREE_GROUP_SIZE];
+  unsigned long long interactionCount = 0;
+
+  for (unsigned group = begin; group < end; ++group) {
+    const unsigned *bodies = &octree->groupOrder[group * OCTREE_GROUP_SIZE];
+    unsigned bodyCount = ctx->count - group * OCTREE_GROUP_SIZE;
+    if (bodyCount > OCTREE_GROUP_SIZE) {
+      bodyCount = OCTREE_GROUP_SIZE;
+    }
+
+    v3 min = v3_make(FLT_MAX, FLT_MAX, FLT_MAX);
+    v3 max = v3_make(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    for (unsigned i = 0; i < bodyCount; ++i) {
+      unsigned body = bodies[i];
+      min = v3_make(fminf(min.x, ctx->x[body]), fminf(min.y, ctx->y[body]),
+                    fminf(min.z, ctx->z[body]));
+      max = v3_make(fmaxf(max.x, ctx->x[body]), fmaxf(max.y, ctx->y[body]),
+                    fmaxf(max.z, ctx->z[body]));
+      accelerations[i] = v3_0();
+      potentials[i] = 0.0f;
+    }
+
+    float *groupPotentials = ctx->potentials ? potentials : NULL;
+    unsigned node = 0;
+    while (1) {
+      v3 com = octree->positions[node];
+      float dx = fmaxf(fmaxf(min.x - com.x, com.x - max.x), 0.0f);
+      float dy = fmaxf(fmaxf(min.y - com.y, com.y - max.y), 0.0f);
+      float dz = fmaxf(fmaxf(min.z - com.z, com.z - max.z), 0.0f);
+      float distanceSquared = dx * dx + dy * dy + dz * dz;
+
+      float sizeSquared =
+          octree->octants[node].size * octree->octants[node].size;
+      if (octree->children[node] == 0 ||
+          sizeSquared < distanceSquared * octree->thetaSquared) {
+        if (octree->masses[node] > 0.0f) {
+          interactionCount += bodyCount;
+          if (interactionListPush(&list, com, octree->masses[node])) {
+            groupFlush(ctx, bodies, bodyCount, &list, accelerations,
+                       groupPotentials);
+          }
+        }
+
+        if (octree->nexts[node] == 0) {
+          break;
+        }
+        node = octree->nexts[node];
+      } else {
+        node = octree->children[node];
+      }
+    }
+    groupFlush(ctx, bodies, bodyCount, &list, accelerations, groupPotentials);
+
+    for (unsigned i = 0; i < bodyCount; ++i) {
+      unsigned body = bodies[i];
+      ctx->ax[body] = accelerations[i].x;
+      ctx->ay[body] = accelerations[i].y;
+      ctx->az[body] = accelerations[i].z;
+      if (ctx->potentials) {
+        ctx->potentials[body] = potentials[i];
+      }
+    }
+  }
+  atomic_fetch_add_explicit(ctx->interactionCount, interactionCount,
+                            memory_order_relaxed);
+}
+
+// NOTE: Accelerations of `count` bodies at (x, y, z) in the built tree,
+// written to (ax, ay, az) and their potentials to `potentials` unless it is
+// NULL. Groups of bodies run in parallel. Counts the body-node interactions
+// into `interactionCount`
+void sfOctreeAccelerations(Octree *octree, const float *x, const float *y,
+                           const float *z, unsigned count, float *ax,
+                           float *ay, float *az, float *potentials) {
+  if (count > octree->maxCount) {
+    count = octree->maxCount;
+  }
+  octreeGroupOrder(octree, x, y, z, count);
+
+  atomic_store(&octree->interactionCount, 0);
+  GroupContext context = {octree, x,  y,  z,
+                          count,  ax, ay, az,
+                          potentials, &octree->interactionCount};
+  unsigned groupCount = (count + OCTREE_GROUP_SIZE - 1) / OCTREE_GROUP_SIZE;
+  sfParallelFor(groupCount, OCTREE_GROUP_MIN_BATCH, groupKernel, &context);
+}
+
 void sfOctreeClear(Octree *octree, const Octant *octant) {
   memset(octree->children, 0, octree->maxCount * sizeof(unsigned));
   memset(octree->parents, 0, octree->maxCount * sizeof(unsigned));
@@ -198,6 +510,7 @@ void sfOctreeClear(Octree *octree, const Octant *octant) {
   memset(octree->masses, 0, octree->maxCount * sizeof(float));
   memset(octree->octants, 0, octree->maxCount * sizeof(Octant));
   memset(octree->nexts, 0, octree->maxCount * sizeof(unsigned));
+  memset(octree->bodies, 0xff, octree->maxCount * sizeof(unsigned));
 
   octree->parentsCount = 0;
 
@@ -3,14 +3,26 @@
 #include "arena.h"
 #include "common.h"
 #include "float.h"
+#include "gravity.h"
 #include "math3d.h"
 #include "string.h"
+#include <stdatomic.h>
+#include <stdint.h>
 
 typedef struct {
   float size;
   v3 center;
 } Octant;
 
+// NOTE: Body index of empty leaves and of bodies inserted without one
+#define OCTREE_NO_BODY 0xffffffffu
+// NOTE: Accepted nodes gathered per gravity kernel call, a multiple of
+// GRAVITY_SIMD_WIDTH
+#define OCTREE_INTERACTION_BATCH 256
+// NOTE: Bodies sharing one walk in `sfOctreeAccelerations`
+#define OCTREE_GROUP_SIZE 32
+#define OCTREE_GROUP_MIN_BATCH 16
+
 typedef struct {
   unsigned *children;
   unsigned *parents;
@@ -18,6 +30,19 @@ typedef struct {
   float *masses;
   Octant *octants;
   unsigned *nexts;
+  // NOTE: Per leaf, the body it holds. Bodies at the exact same position
+  // share a leaf, `bodyNexts` chains them from the leaf's body on, indexed
+  // by body and ended by OCTREE_NO_BODY
+  unsigned *bodies;
+  unsigned *bodyNexts;
+  // NOTE: Morton keys and body order for grouping, scratch of
+  // `sfOctreeAccelerations`
+  uint32_t *groupKeys;
+  uint32_t *groupKeysScratch;
+  unsigned *groupOrder;
+  unsigned *groupOrderScratch;
+  // NOTE: Body-node pairs evaluated by the last `sfOctreeAccelerations`
+  atomic_ullong interactionCount;
   unsigned count;
   unsigned parentsCount;
   unsigned maxCount;
@@ -34,9 +59,18 @@ unsigned octreeSubdivide(Octree *octree, unsigned node);
 Octree *sfOctreeArenaAlloc(Arena *arena, float theta, float epsilon,
                            unsigned maxCount);
 void sfOctreeInsert(Octree *octree, const v3 position, float mass);
+void sfOctreeInsertBody(Octree *octree, unsigned body, const v3 position,
+                        float mass);
 Octant sfOctantContaining(const v3 *positions, unsigned count);
+Octant sfOctantContainingSoA(const float *x, const float *y, const float *z,
+                            unsigned count);
 void sfOctreePropagate(Octree *octree);
 v3 sfOctreeAcceleration(const Octree *octree, const v3 position);
+v3 sfOctreeAccelerationPotential(const Octree *octree, const v3 position,
+                                 float *potential);
+void sfOctreeAccelerations(Octree *octree, const float *x, const float *y,
+                           const float *z, unsigned count, float *ax,
+                           float *ay, float *az, float *potentials);
 void sfOctreeClear(Octree *octree, const Octant *octant);
 
 #endif
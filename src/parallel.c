@@ -0,0 +1,146 @@
+#include "parallel.h"
+#include <pthread.h>
+#include <unistd.h>
+
+#define MAX_PARALLEL_THREADS 64
+
+typedef struct {
+  ParallelKernel kernel;
+  void *context;
+  unsigned begin;
+  unsigned end;
+  unsigned thread;
+} ParallelRange;
+
+/* NOTE:
+ * Long lived workers, started by the first `sfParallelFor` that needs them.
+ * A call publishes its ranges and bumps `generation`, worker i runs range i
+ * and the last one done wakes the caller, so no thread is created per call.
+ * `callMutex` lets one call use the pool at a time, nested or concurrent
+ * calls run their whole range on the calling thread.
+ */
+typedef struct {
+  pthread_t threads[MAX_PARALLEL_THREADS];
+  unsigned workerCount;
+  pthread_mutex_t callMutex;
+  pthread_mutex_t mutex;
+  pthread_cond_t start;
+  pthread_cond_t done;
+  ParallelRange ranges[MAX_PARALLEL_THREADS];
+  unsigned rangeCount;
+  unsigned pendingCount;
+  unsigned generation;
+} ParallelPool;
+
+static _Thread_local unsigned parallelThreadIndex = 0;
+static ParallelPool parallelPool = {.callMutex = PTHREAD_MUTEX_INITIALIZER,
+                                    .mutex = PTHREAD_MUTEX_INITIALIZER,
+                                    .start = PTHREAD_COND_INITIALIZER,
+                                    .done = PTHREAD_COND_INITIALIZER};
+static pthread_once_t parallelPoolOnce = PTHREAD_ONCE_INIT;
+
+static void runRange(const ParallelRange *range) {
+  unsigned previous = parallelThreadIndex;
+  parallelThreadIndex = range->thread;
+  range->kernel(range->context, range->begin, range->end);
+  parallelThreadIndex = previous;
+}
+
+static void *parallelWorker(void *data) {
+  ParallelPool *pool = &parallelPool;
+  unsigned worker = (unsigned)(size_t)data;
+  unsigned seen = 0;
+
+  pthread_mutex_lock(&pool->mutex);
+  while (1) {
+    while (pool->generation == seen) {
+      pthread_cond_wait(&pool->start, &pool->mutex);
+    }
+    seen = pool->generation;
+    if (worker >= pool->rangeCount) {
+      continue;
+    }
+
+    ParallelRange range = pool->ranges[worker];
+    pthread_mutex_unlock(&pool->mutex);
+    runRange(&range);
+    pthread_mutex_lock(&pool->mutex);
+
+    if (--pool->pendingCount == 0) {
+      pthread_cond_signal(&pool->done);
+    }
+  }
+  return NULL;
+}
+
+// NOTE: Worker i takes range i, the caller keeps range 0
+static void startParallelPool() {
+  ParallelPool *pool = &parallelPool;
+  unsigned threadCount = sfParallelThreadCount();
+  for (unsigned i = 1; i < threadCount; ++i) {
+    if (pthread_create(&pool->threads[i], NULL, parallelWorker,
+                       (void *)(size_t)i)) {
+      break;
+    }
+    pool->workerCount++;
+  }
+}
+
+// NOTE: Index of the range the calling thread runs inside `sfParallelFor`,
+// ranges are ordered, so range i covers items before range i + 1
+unsigned sfParallelThreadIndex() { return parallelThreadIndex; }
+
+unsigned sfParallelThreadCount() {
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  if (cores < 1) {
+    return 1;
+  }
+  return cores > MAX_PARALLEL_THREADS ? MAX_PARALLEL_THREADS : (unsigned)cores;
+}
+
+void sfParallelFor(unsigned count, unsigned minBatch, ParallelKernel kernel,
+                   void *context) {
+  unsigned threadCount = sfParallelThreadCount();
+  if (minBatch == 0) {
+    minBatch = 1;
+  }
+  if (count / minBatch < threadCount) {
+    threadCount = count / minBatch;
+  }
+
+  ParallelPool *pool = &parallelPool;
+  if (threadCount > 1) {
+    pthread_once(&parallelPoolOnce, startParallelPool);
+    if (threadCount > pool->workerCount + 1) {
+      threadCount = pool->workerCount + 1;
+    }
+  }
+
+  if (threadCount <= 1 || pthread_mutex_trylock(&pool->callMutex)) {
+    ParallelRange range = {kernel, context, 0, count, 0};
+    runRange(&range);
+    return;
+  }
+
+  unsigned batch = (count + threadCount - 1) / threadCount;
+  pthread_mutex_lock(&pool->mutex);
+  for (unsigned i = 0; i < threadCount; ++i) {
+    unsigned begin = i * batch > count ? count : i * batch;
+    unsigned end = begin + batch > count ? count : begin + batch;
+    pool->ranges[i] = (ParallelRange){kernel, context, begin, end, i};
+  }
+  pool->rangeCount = threadCount;
+  pool->pendingCount = threadCount - 1;
+  pool->generation++;
+  pthread_cond_broadcast(&pool->start);
+  pthread_mutex_unlock(&pool->mutex);
+
+  runRange(&pool->ranges[0]);
+
+  pthread_mutex_lock(&pool->mutex);
+  while (pool->pendingCount) {
+    pthread_cond_wait(&pool->done, &pool->mutex);
+  }
+  pthread_mutex_unlock(&pool->mutex);
+  pthread_mutex_unlock(&pool->callMutex);
+}
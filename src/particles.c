@@ -4,43 +4,38 @@ void initBuffers(Particles *particles) {
   glGenVertexArrays(1, &particles->vao);
   glBindVertexArray(particles->vao);
 
-  glGenBuffers(1, &particles->positionsVbo);
-  glBindBuffer(GL_ARRAY_BUFFER, particles->positionsVbo);
-  glBufferData(GL_ARRAY_BUFFER, particles->count * sizeof(v3),
-               particles->positions, GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, particles->positionsStream->vbo);
   glVertexAttribPointer(POSITION_LOCATION, 3, GL_FLOAT, GL_FALSE, sizeof(v3),
                         (void *)0);
   glEnableVertexAttribArray(POSITION_LOCATION);
 
-  glGenBuffers(1, &particles->velocitiesVbo);
-  glBindBuffer(GL_ARRAY_BUFFER, particles->velocitiesVbo);
-  glBufferData(GL_ARRAY_BUFFER, particles->count * sizeof(v3),
-               particles->velocities, GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, particles->velocitiesStream->vbo);
   glVertexAttribPointer(VELOCITY_LOCATION, 3, GL_FLOAT, GL_FALSE, sizeof(v3),
                         (void *)0);
   glEnableVertexAttribArray(VELOCITY_LOCATION);
 
+  glBindBuffer(GL_ARRAY_BUFFER, particles->weightsStream->vbo);
+  glVertexAttribPointer(WEIGHT_LOCATION, 1, GL_FLOAT, GL_FALSE, sizeof(float),
+                        (void *)0);
+
   glBindBuffer(GL_ARRAY_BUFFER, 0);
   glBindVertexArray(0);
-
-  // glGenBuffers(1, &particles->transformsVbo);
-  // glBindBuffer(GL_ARRAY_BUFFER, particles->transformsVbo);
-  // glBufferData(GL_ARRAY_BUFFER, particles->count * sizeof(m44),
-  //              particles->transforms, GL_DYNAMIC_DRAW);
-  //
-  // for (int i = 0; i < 4; ++i) {
-  //   glVertexAttribPointer(INSTANCE_TRANSFORM_LOCATION + i, 4, GL_FLOAT,
-  //                         GL_FALSE, sizeof(m44), (void *)(sizeof(v4) * i));
-  //   glEnableVertexAttribArray(INSTANCE_TRANSFORM_LOCATION + i);
-  //   glVertexAttribDivisor(INSTANCE_TRANSFORM_LOCATION + i, 1);
-  // }
 }
 
 Particles *sfParticlesArenaAlloc(Arena *arena, unsigned int count) {
   Particles *particles = (Particles *)sfArenaAlloc(arena, sizeof(Particles));
   particles->count = count;
-  particles->positions = sfV3ArenaAlloc(arena, count);
-  particles->velocities = sfV3ArenaAlloc(arena, count);
+  particles->drawCount = count;
+  particles->positionsStream =
+      sfStreamBufferArenaAlloc(arena, sizeof(v3) * count);
+  particles->velocitiesStream =
+      sfStreamBufferArenaAlloc(arena, sizeof(v3) * count);
+  particles->weightsStream =
+      sfStreamBufferArenaAlloc(arena, sizeof(float) * count);
+  particles->positions = NULL;
+  particles->velocities = NULL;
+  particles->weights = NULL;
+  particles->hasWeights = 0;
 
   initBuffers(particles);
 
@@ -48,23 +43,59 @@ Particles *sfParticlesArenaAlloc(Arena *arena, unsigned int count) {
 }
 
 void sfParticlesDestroy(Particles *particles) {
-  free(particles->positions);
-  free(particles->velocities);
+  sfStreamBufferDestroy(particles->positionsStream);
+  sfStreamBufferDestroy(particles->velocitiesStream);
+  sfStreamBufferDestroy(particles->weightsStream);
+  glDeleteVertexArrays(1, &particles->vao);
 }
 
-void sfParticlesRender(const Particles *particles) {
-  glBindVertexArray(particles->vao);
+void sfParticlesBeginFrame(Particles *particles) {
+  particles->positions =
+      (v3 *)sfStreamBufferBegin(particles->positionsStream);
+  particles->velocities =
+      (v3 *)sfStreamBufferBegin(particles->velocitiesStream);
+  particles->weights = (float *)sfStreamBufferBegin(particles->weightsStream);
+  particles->drawCount = particles->count;
+  particles->hasWeights = 0;
+}
 
-  glBindBuffer(GL_ARRAY_BUFFER, particles->positionsVbo);
-  glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(v3) * particles->count,
-                  particles->positions);
+// NOTE: Expects the program and the particles' VAO to be bound
+static void drawParticles(void *data) {
+  Particles *particles = (Particles *)data;
+  sfStreamBufferEnd(particles->positionsStream);
+  sfStreamBufferEnd(particles->velocitiesStream);
+  sfStreamBufferEnd(particles->weightsStream);
 
-  glBindBuffer(GL_ARRAY_BUFFER, particles->velocitiesVbo);
-  glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(v3) * particles->count,
-                  particles->velocities);
+  // NOTE: Both rings advance in lockstep, so one base vertex selects the
+  // current region of each
+  GLint first = particles->positionsStream->frame * particles->count;
 
-  glDrawArrays(GL_POINTS, 0, particles->count);
+  if (particles->hasWeights) {
+    glEnableVertexAttribArray(WEIGHT_LOCATION);
+  } else {
+    glDisableVertexAttribArray(WEIGHT_LOCATION);
+    glVertexAttrib1f(WEIGHT_LOCATION, 1.0f);
+  }
+  glDrawArrays(GL_POINTS, first, particles->drawCount);
 
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  sfStreamBufferFence(particles->positionsStream);
+  sfStreamBufferFence(particles->velocitiesStream);
+  sfStreamBufferFence(particles->weightsStream);
+  particles->positions = NULL;
+  particles->velocities = NULL;
+  particles->weights = NULL;
+}
+
+void sfParticlesRender(Particles *particles) {
+  glBindVertexArray(particles->vao);
+  drawParticles(particles);
   glBindVertexArray(0);
 }
+
+// NOTE: Like `sfParticlesRender`, the frame's views stay valid until the
+// queue executes
+void sfParticlesSubmit(RenderQueue *queue, Particles *particles,
+                       unsigned program) {
+  sfRenderQueueSubmit(queue, program, 0, particles->vao, 0.0f, drawParticles,
+                      particles);
+}
@@ -0,0 +1,101 @@
+#include "pool.h"
+#include <string.h>
+
+// NOTE: Each slot is a generation followed by the element, the element
+// keeps the default arena alignment
+typedef struct {
+  uint32_t generation;
+} PoolSlot;
+
+#define POOL_SLOT_HEADER ARENA_DEFAULT_ALIGNMENT
+
+Pool *sfPoolArenaAlloc(Arena *arena, size_t elementSize, unsigned maxCount) {
+  Pool *pool = (Pool *)sfArenaAlloc(arena, sizeof(Pool));
+  pool->arena = arena;
+  pool->elementSize = elementSize;
+  if (elementSize < sizeof(uint32_t)) {
+    elementSize = sizeof(uint32_t);
+  }
+  pool->stride = POOL_SLOT_HEADER + ((elementSize + ARENA_DEFAULT_ALIGNMENT - 1) &
+                                     ~(size_t)(ARENA_DEFAULT_ALIGNMENT - 1));
+  pool->maxPages = (maxCount + POOL_SLOTS_PER_PAGE - 1) / POOL_SLOTS_PER_PAGE;
+  pool->pages = (unsigned char **)sfArenaAlloc(
+      arena, sizeof(unsigned char *) * pool->maxPages);
+  pool->pageCount = 0;
+  pool->freeHead = POOL_NO_SLOT;
+  pool->liveCount = 0;
+  return pool;
+}
+
+static inline PoolSlot *poolSlot(const Pool *pool, uint32_t index) {
+  return (PoolSlot *)(pool->pages[index / POOL_SLOTS_PER_PAGE] +
+                      (index % POOL_SLOTS_PER_PAGE) * pool->stride);
+}
+
+static inline void *slotElement(PoolSlot *slot) {
+  return (unsigned char *)slot + POOL_SLOT_HEADER;
+}
+
+// NOTE: Links a fresh page into the free list, lowest slot first
+static int growPool(Pool *pool) {
+  if (pool->pageCount == pool->maxPages) {
+    return 0;
+  }
+  unsigned char *page = (unsigned char *)sfArenaAlloc(
+      pool->arena, pool->stride * POOL_SLOTS_PER_PAGE);
+  if (!page) {
+    return 0;
+  }
+  memset(page, 0, pool->stride * POOL_SLOTS_PER_PAGE);
+
+  uint32_t first = pool->pageCount * POOL_SLOTS_PER_PAGE;
+  pool->pages[pool->pageCount++] = page;
+  for (uint32_t i = POOL_SLOTS_PER_PAGE; i-- > 0;) {
+    PoolSlot *slot = poolSlot(pool, first + i);
+    memcpy(slotElement(slot), &pool->freeHead, sizeof(uint32_t));
+    pool->freeHead = first + i;
+  }
+  return 1;
+}
+
+// NOTE: The element comes back zeroed
+PoolHandle sfPoolAlloc(Pool *pool) {
+  PoolHandle handle = {0, 0};
+  if (pool->freeHead == POOL_NO_SLOT && !growPool(pool)) {
+    fprintf(stderr, "ERROR: Pool of %zu byte elements is full\n",
+            pool->elementSize);
+    return handle;
+  }
+
+  uint32_t index = pool->freeHead;
+  PoolSlot *slot = poolSlot(pool, index);
+  memcpy(&pool->freeHead, slotElement(slot), sizeof(uint32_t));
+  memset(slotElement(slot), 0, pool->elementSize);
+  slot->generation++;
+  pool->liveCount++;
+
+  handle.index = index;
+  handle.generation = slot->generation;
+  return handle;
+}
+
+// NOTE: Stale and zeroed handles are ignored
+void sfPoolFree(Pool *pool, PoolHandle handle) {
+  if (!sfPoolGet(pool, handle)) {
+    return;
+  }
+  PoolSlot *slot = poolSlot(pool, handle.index);
+  slot->generation++;
+  memcpy(slotElement(slot), &pool->freeHead, sizeof(uint32_t));
+  pool->freeHead = handle.index;
+  pool->liveCount--;
+}
+
+void *sfPoolGet(const Pool *pool, PoolHandle handle) {
+  if (!(handle.generation & 1) ||
+      handle.index >= pool->pageCount * POOL_SLOTS_PER_PAGE) {
+    return NULL;
+  }
+  PoolSlot *slot = poolSlot(pool, handle.index);
+  return slot->generation == handle.generation ? slotElement(slot) : NULL;
+}
@@ -0,0 +1,132 @@
+#include "render_queue.h"
+#include <string.h>
+
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+
+RenderQueue *sfRenderQueueArenaAlloc(Arena *arena, unsigned capacity) {
+  RenderQueue *queue = sfArenaAlloc(arena, sizeof(RenderQueue));
+  queue->packets = sfArenaAlloc(arena, capacity * sizeof(RenderPacket));
+  queue->sorted = sfArenaAlloc(arena, capacity * sizeof(RenderPacket));
+  queue->capacity = capacity;
+  atomic_init(&queue->count, 0);
+  return queue;
+}
+
+// NOTE: Non-negative floats order like their bit patterns, so the top 16 bits
+// (exponent and 7 bits of mantissa) are a coarse, monotonic depth
+uint64_t sfRenderKey(unsigned program, unsigned texture, unsigned vao,
+                     float depth) {
+  uint32_t depthBits = 0;
+  if (depth > 0.0f) {
+    memcpy(&depthBits, &depth, sizeof(float));
+  }
+
+  return (program & RENDER_KEY_FIELD_MASK) << RENDER_KEY_PROGRAM_SHIFT |
+         (texture & RENDER_KEY_FIELD_MASK) << RENDER_KEY_TEXTURE_SHIFT |
+         (vao & RENDER_KEY_FIELD_MASK) << RENDER_KEY_VAO_SHIFT |
+         depthBits >> 16;
+}
+
+void sfRenderQueueSubmit(RenderQueue *queue, unsigned program,
+                         unsigned texture, unsigned vao, float depth,
+                         RenderDraw draw, void *data) {
+  unsigned index =
+      atomic_fetch_add_explicit(&queue->count, 1, memory_order_relaxed);
+  if (index >= queue->capacity) {
+    return;
+  }
+
+  RenderPacket *packet = &queue->packets[index];
+  packet->key = sfRenderKey(program, texture, vao, depth);
+  packet->program = program;
+  packet->texture = texture;
+  packet->vao = vao;
+  packet->draw = draw;
+  packet->data = data;
+}
+
+// NOTE: LSD radix sort, stable, one byte per pass. Passes where every key
+// shares the byte are skipped, which is most of them for a typical frame
+void sfRenderQueueSort(RenderQueue *queue) {
+  unsigned count = atomic_load(&queue->count);
+  if (count > queue->capacity) {
+    count = queue->capacity;
+  }
+
+  unsigned histograms[sizeof(uint64_t)][RADIX_BUCKETS];
+  memset(histograms, 0, sizeof(histograms));
+  for (unsigned i = 0; i < count; ++i) {
+    uint64_t key = queue->packets[i].key;
+    for (unsigned pass = 0; pass < sizeof(uint64_t); ++pass) {
+      histograms[pass][(key >> (pass * RADIX_BITS)) & (RADIX_BUCKETS - 1)]++;
+    }
+  }
+
+  for (unsigned pass = 0; pass < sizeof(uint64_t); ++pass) {
+    unsigned *histogram = histograms[pass];
+    unsigned shift = pass * RADIX_BITS;
+    if (count && histogram[(queue->packets[0].key >> shift) &
+                           (RADIX_BUCKETS - 1)] == count) {
+      continue;
+    }
+
+    unsigned offset = 0;
+    for (unsigned bucket = 0; bucket < RADIX_BUCKETS; ++bucket) {
+      unsigned bucketCount = histogram[bucket];
+      histogram[bucket] = offset;
+      offset += bucketCount;
+    }
+
+    for (unsigned i = 0; i < count; ++i) {
+      const RenderPacket *packet = &queue->packets[i];
+      queue->sorted[histogram[(packet->key >> shift) & (RADIX_BUCKETS - 1)]++] =
+          *packet;
+    }
+
+    RenderPacket *swap = queue->packets;
+    queue->packets = queue->sorted;
+    queue->sorted = swap;
+  }
+}
+
+void sfRenderQueueExecute(RenderQueue *queue) {
+  sfRenderQueueSort(queue);
+
+  unsigned submitted = atomic_load(&queue->count);
+  unsigned count = submitted < queue->capacity ? submitted : queue->capacity;
+  queue->drawCount = count;
+  queue->droppedCount = submitted - count;
+  queue->programBinds = 0;
+  queue->textureBinds = 0;
+  queue->vaoBinds = 0;
+
+  // NOTE: Nothing is assumed about the state left by code outside the queue,
+  // so the first packet binds everything it uses
+  unsigned program = 0, texture = 0, vao = 0;
+  unsigned char isFirst = 1;
+  for (unsigned i = 0; i < count; ++i) {
+    const RenderPacket *packet = &queue->packets[i];
+    if (isFirst || packet->program != program) {
+      glUseProgram(packet->program);
+      program = packet->program;
+      queue->programBinds++;
+    }
+    if (packet->texture && packet->texture != texture) {
+      glBindTexture(GL_TEXTURE_2D, packet->texture);
+      texture = packet->texture;
+      queue->textureBinds++;
+    }
+    if (isFirst || packet->vao != vao) {
+      glBindVertexArray(packet->vao);
+      vao = packet->vao;
+      queue->vaoBinds++;
+    }
+    isFirst = 0;
+
+    packet->draw(packet->data);
+  }
+
+  glBindVertexArray(0);
+  atomic_store(&queue->count, 0);
+}
@@ -1,4 +1,18 @@
 #include "shader.h"
+#include "gl_extensions.h"
+#include <errno.h>
+#include <sys/stat.h>
+
+static ProgramReflection programReflections[MAX_SHADER_PROGRAMS];
+static unsigned programReflectionCount = 0;
+
+static uint32_t hashUniformName(const char *name) {
+  uint32_t hash = 2166136261u;
+  while (*name) {
+    hash = (hash ^ (unsigned char)*name++) * 16777619u;
+  }
+  return hash;
+}
 
 char *readShaderSource(const char *filepath) {
   FILE *file = fopen(filepath, "r");
@@ -58,22 +72,110 @@ int checkProgramLinking(GLuint program) {
   return 1;
 }
 
-GLuint createShaderProgram(const char *vertexPath, const char *fragmentPath) {
-  char *vertexSource = readShaderSource(vertexPath);
-  char *fragmentSource = readShaderSource(fragmentPath);
+static uint64_t hashCacheKey(uint64_t hash, const char *string) {
+  // NOTE: The terminator is hashed too, so ("ab", "c") != ("a", "bc")
+  do {
+    hash = (hash ^ (unsigned char)*string) * 1099511628211ull;
+  } while (*string++);
+  return hash;
+}
 
-  if (!vertexSource || !fragmentSource) {
-    free(vertexSource);
-    free(fragmentSource);
+static uint64_t shaderCacheKey(const char *vertexSource,
+                               const char *fragmentSource) {
+  const char *vendor = (const char *)glGetString(GL_VENDOR);
+  const char *renderer = (const char *)glGetString(GL_RENDERER);
+  const char *version = (const char *)glGetString(GL_VERSION);
+
+  uint64_t hash = 14695981039346656037ull;
+  hash = hashCacheKey(hash, vertexSource);
+  hash = hashCacheKey(hash, fragmentSource);
+  hash = hashCacheKey(hash, vendor ? vendor : "");
+  hash = hashCacheKey(hash, renderer ? renderer : "");
+  hash = hashCacheKey(hash, version ? version : "");
+  return hash;
+}
+
+static void shaderCachePath(uint64_t key, char *path, size_t size) {
+  snprintf(path, size, "%s/%016llx.bin", SHADER_CACHE_DIR,
+           (unsigned long long)key);
+}
+
+static GLuint loadCachedProgram(const char *path) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    return 0;
+  }
+
+  ShaderCacheHeader header;
+  void *binary = NULL;
+  GLuint program = 0;
+  if (fread(&header, sizeof(header), 1, file) == 1 &&
+      !memcmp(header.magic, "SFPB", 4) &&
+      header.version == SHADER_CACHE_VERSION && header.length > 0) {
+    binary = malloc(header.length);
+    if (binary && fread(binary, 1, header.length, file) == header.length) {
+      program = glCreateProgram();
+      sfGLExtensions.programBinary(program, header.format, binary,
+                                   header.length);
+    }
+  }
+  free(binary);
+  fclose(file);
+
+  if (!program) {
+    remove(path);
     return 0;
   }
 
+  // NOTE: Drivers may reject binaries from another build without changing
+  // their version string, that is not an error, just a cache miss
+  GLint success;
+  glGetProgramiv(program, GL_LINK_STATUS, &success);
+  if (!success) {
+    glDeleteProgram(program);
+    remove(path);
+    return 0;
+  }
+  return program;
+}
+
+static void saveCachedProgram(GLuint program, const char *path) {
+  GLint length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0) {
+    return;
+  }
+  void *binary = malloc(length);
+  if (binary == NULL) {
+    return;
+  }
+
+  ShaderCacheHeader header = {{'S', 'F', 'P', 'B'}, SHADER_CACHE_VERSION};
+  GLenum format;
+  GLsizei written = 0;
+  sfGLExtensions.getProgramBinary(program, length, &written, &format, binary);
+  header.format = format;
+  header.length = (uint32_t)written;
+
+  if (written > 0 &&
+      (mkdir(SHADER_CACHE_DIR, 0755) == 0 || errno == EEXIST)) {
+    FILE *file = fopen(path, "wb");
+    if (file) {
+      int ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+               fwrite(binary, 1, written, file) == (size_t)written;
+      if (fclose(file) != 0 || !ok) {
+        remove(path);
+      }
+    }
+  }
+  free(binary);
+}
+
+static GLuint linkShaderProgram(const char *vertexSource,
+                                const char *fragmentSource) {
   GLuint vertexShader = compileShader(vertexSource, GL_VERTEX_SHADER);
   GLuint fragmentShader = compileShader(fragmentSource, GL_FRAGMENT_SHADER);
 
-  free(vertexSource);
-  free(fragmentSource);
-
   if (!checkShaderCompilation(vertexShader, "VERTEX") ||
       !checkShaderCompilation(fragmentShader, "FRAGMENT")) {
     glDeleteShader(vertexShader);
@@ -84,6 +186,10 @@ GLuint createShaderProgram(const char *vertexPath, const char *fragmentPath) {
   GLuint program = glCreateProgram();
   glAttachShader(program, vertexShader);
   glAttachShader(program, fragmentShader);
+  if (sfGLExtensions.hasProgramBinary) {
+    sfGLExtensions.programParameteri(
+        program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  }
   glLinkProgram(program);
 
   glDeleteShader(vertexShader);
@@ -93,28 +199,234 @@ GLuint createShaderProgram(const char *vertexPath, const char *fragmentPath) {
     glDeleteProgram(program);
     return 0;
   }
+  return program;
+}
+
+GLuint createShaderProgram(const char *vertexPath, const char *fragmentPath) {
+  char *vertexSource = readShaderSource(vertexPath);
+  char *fragmentSource = readShaderSource(fragmentPath);
+
+  if (!vertexSource || !fragmentSource) {
+    free(vertexSource);
+    free(fragmentSource);
+    return 0;
+  }
+
+  GLuint program = 0;
+  char cachePath[64];
+  if (sfGLExtensions.hasProgramBinary) {
+    shaderCachePath(shaderCacheKey(vertexSource, fragmentSource), cachePath,
+                    sizeof(cachePath));
+    program = loadCachedProgram(cachePath);
+  }
+
+  if (!program) {
+    program = linkShaderProgram(vertexSource, fragmentSource);
+    if (program && sfGLExtensions.hasProgramBinary) {
+      saveCachedProgram(program, cachePath);
+    }
+  }
+
+  free(vertexSource);
+  free(fragmentSource);
+
+  if (!program) {
+    return 0;
+  }
+
+  GLuint cameraBlock = glGetUniformBlockIndex(program, "Camera");
+  if (cameraBlock != GL_INVALID_INDEX) {
+    glUniformBlockBinding(program, cameraBlock, CAMERA_UNIFORM_BINDING);
+  }
+  reflectProgram(program);
 
   return program;
 }
 
+void reflectProgram(GLuint program) {
+  ProgramReflection *reflection = NULL;
+  for (unsigned i = 0; i < programReflectionCount; ++i) {
+    if (programReflections[i].program == program) {
+      reflection = &programReflections[i];
+    }
+  }
+  if (!reflection) {
+    if (programReflectionCount == MAX_SHADER_PROGRAMS) {
+      fprintf(stderr, "ERROR: Too many shader programs to reflect\n");
+      return;
+    }
+    reflection = &programReflections[programReflectionCount++];
+  }
+
+  reflection->program = program;
+  reflection->uniformCount = 0;
+
+  GLint activeCount = 0;
+  glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &activeCount);
+  for (GLint i = 0; i < activeCount; ++i) {
+    char name[MAX_UNIFORM_NAME];
+    GLint size;
+    GLenum type;
+    glGetActiveUniform(program, i, sizeof(name), NULL, &size, &type, name);
+
+    // NOTE: Block members have no location, they are fed by buffers
+    GLint location = glGetUniformLocation(program, name);
+    if (location < 0) {
+      continue;
+    }
+    if (reflection->uniformCount == MAX_PROGRAM_UNIFORMS) {
+      fprintf(stderr, "ERROR: Too many uniforms in program %u\n", program);
+      break;
+    }
+
+    char *bracket = strchr(name, '[');
+    if (bracket) {
+      *bracket = '\0';
+    }
+
+    ProgramUniform *uniform =
+        &reflection->uniforms[reflection->uniformCount++];
+    memset(uniform, 0, sizeof(ProgramUniform));
+    strcpy(uniform->name, name);
+    uniform->hash = hashUniformName(name);
+    uniform->location = location;
+  }
+}
+
+static ProgramUniform *findUniform(int program, const char *name) {
+  uint32_t hash = hashUniformName(name);
+  for (unsigned i = 0; i < programReflectionCount; ++i) {
+    ProgramReflection *reflection = &programReflections[i];
+    if (reflection->program != (GLuint)program) {
+      continue;
+    }
+    for (unsigned j = 0; j < reflection->uniformCount; ++j) {
+      ProgramUniform *uniform = &reflection->uniforms[j];
+      if (uniform->hash == hash && !strcmp(uniform->name, name)) {
+        return uniform;
+      }
+    }
+    return NULL;
+  }
+  return NULL;
+}
+
+// NOTE: Resolve once at setup and keep the handle, it stays valid until the
+// program is reflected again. NULL if the uniform is not active
+ProgramUniform *sfProgramUniform(int program, const char *name) {
+  return findUniform(program, name);
+}
+
+GLint sfUniformLocation(int program, const char *name) {
+  ProgramUniform *uniform = findUniform(program, name);
+  return uniform ? uniform->location : -1;
+}
+
+// NOTE: Returns 1 if `value` differs from what the uniform last held, 0 if
+// it is inactive or unchanged
+static unsigned char uniformChanged(ProgramUniform *uniform,
+                                    const float *value, unsigned count) {
+  if (!uniform) {
+    return 0;
+  }
+  if (uniform->hasValue &&
+      !memcmp(uniform->value, value, sizeof(float) * count)) {
+    return 0;
+  }
+  memcpy(uniform->value, value, sizeof(float) * count);
+  uniform->hasValue = 1;
+  return 1;
+}
+
+unsigned sfCameraUniformsCreate() {
+  unsigned ubo;
+  glGenBuffers(1, &ubo);
+  glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+  glBufferData(GL_UNIFORM_BUFFER, sizeof(CameraUniforms), NULL,
+               GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  glBindBufferBase(GL_UNIFORM_BUFFER, CAMERA_UNIFORM_BINDING, ubo);
+  return ubo;
+}
+
+void sfCameraUniformsUpdate(unsigned ubo, const m44 *projection, const m44 *view,
+                            v3 position) {
+  CameraUniforms uniforms;
+  uniforms.projection = *projection;
+  uniforms.view = *view;
+  uniforms.position = v4_make(position.x, position.y, position.z, 1.0f);
+
+  glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+  glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(CameraUniforms), &uniforms);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void sfUniformSetI1(ProgramUniform *uniform, int i) {
+  float value;
+  memcpy(&value, &i, sizeof(float));
+  if (uniformChanged(uniform, &value, 1)) {
+    glUniform1i(uniform->location, i);
+  }
+}
+
+// NOTE: Matrices are not shadowed, per frame matrices belong in a block
+void sfUniformSetM44(ProgramUniform *uniform, const m44 *m) {
+  if (uniform) {
+    glUniformMatrix4fv(uniform->location, 1, GL_FALSE, (float *)m);
+  }
+}
+
+void sfUniformSetFloat(ProgramUniform *uniform, float f) {
+  if (uniformChanged(uniform, &f, 1)) {
+    glUniform1f(uniform->location, f);
+  }
+}
+
+void sfUniformSetF2(ProgramUniform *uniform, float r, float g) {
+  float value[2] = {r, g};
+  if (uniformChanged(uniform, value, 2)) {
+    glUniform2f(uniform->location, r, g);
+  }
+}
+
+void sfUniformSetF3(ProgramUniform *uniform, float r, float g, float b) {
+  float value[3] = {r, g, b};
+  if (uniformChanged(uniform, value, 3)) {
+    glUniform3f(uniform->location, r, g, b);
+  }
+}
+
+void sfUniformSetF4(ProgramUniform *uniform, float r, float g, float b,
+                    float a) {
+  float value[4] = {r, g, b, a};
+  if (uniformChanged(uniform, value, 4)) {
+    glUniform4f(uniform->location, r, g, b, a);
+  }
+}
+
+// NOTE: By name, each call looks the uniform up. Setup code only, frame loops
+// keep the handle from `sfProgramUniform`
 void setUniformI1(int program, const char *uniform, int i) {
-  glUniform1i(glGetUniformLocation(program, uniform), i);
+  sfUniformSetI1(findUniform(program, uniform), i);
 }
 
 void setUniformM44(int program, const char *uniform, const m44 *m) {
-  glUniformMatrix4fv(glGetUniformLocation(program, uniform), 1, GL_FALSE,
-                     (float *)m);
+  sfUniformSetM44(findUniform(program, uniform), m);
 }
 
 void setUniformFloat(int program, const char *uniform, float f) {
-  glUniform1f(glGetUniformLocation(program, uniform), f);
+  sfUniformSetFloat(findUniform(program, uniform), f);
+}
+
+void setUniformF2(int program, const char *uniform, float r, float g) {
+  sfUniformSetF2(findUniform(program, uniform), r, g);
 }
 
 void setUniformF3(int program, const char *uniform, float r, float g, float b) {
-  glUniform3f(glGetUniformLocation(program, uniform), r, g, b);
+  sfUniformSetF3(findUniform(program, uniform), r, g, b);
 }
 
 void setUniformF4(int program, const char *uniform, float r, float g, float b,
                   float a) {
-  glUniform4f(glGetUniformLocation(program, uniform), r, g, b, a);
+  sfUniformSetF4(findUniform(program, uniform), r, g, b, a);
 }
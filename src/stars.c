@@ -1,41 +1,16 @@
 #include "stars.h"
 
-void sfStarsDestroy(Stars *stars) {
-  free(stars->sizes);
-  free(stars->masses);
-  free(stars->positions);
-  free(stars->velocities);
-  free(stars->accelerations);
-}
-
-Stars *sfStarsArenaAlloc(Arena *arena, unsigned count) {
-  Stars *stars = (Stars *)sfArenaAlloc(arena, sizeof(Stars));
-
-  stars->count = count;
-
-  stars->masses = (float *)sfArenaAlloc(arena, sizeof(float) * stars->count);
-  stars->sizes = (float *)sfArenaAlloc(arena, sizeof(float) * stars->count);
-  stars->positions = (v3 *)sfV3ArenaAlloc(arena, stars->count);
-  stars->velocities = (v3 *)sfV3ArenaAlloc(arena, stars->count);
-  stars->accelerations = (v3 *)sfV3ArenaAlloc(arena, stars->count);
-
-  for (int i = 0; i < stars->count; ++i) {
-    stars->sizes[i] = 1.0f;
-  }
-
-  return stars;
-}
-
 void _initStarInstanceData(m44 *data, int numInstances) {
-  v3 positions[MAX_STARS];
   for (int i = 0; i < numInstances; ++i) {
+    RandomStream stream = sfRandomStream(STAR_SEED, i);
     m44 model = m44_identity(1.0f);
-    v3 position = {randf_clamped(-50.0f, 50.0f), randf_clamped(-50.0f, 50.0f),
-                   randf_clamped(-50.0f, 50.0f)};
+    v3 position = {sfRandomRange(&stream, -50.0f, 50.0f),
+                   sfRandomRange(&stream, -50.0f, 50.0f),
+                   sfRandomRange(&stream, -50.0f, 50.0f)};
 
-    float angle = rand_deg();
+    float angle = sfRandomRange(&stream, 0.0f, 360.0f);
 
-    float s = randf_clamped(0.01, 0.1);
+    float s = sfRandomRange(&stream, 0.01f, 0.1f);
 
     model = translate(&model, position.x, position.y, position.z);
     model = rotate(&model, angle, 0.0f, 0.0f, 1.0f);
@@ -0,0 +1,94 @@
+#include "stream_buffer.h"
+
+StreamBuffer *sfStreamBufferArenaAlloc(Arena *arena, GLsizeiptr regionSize) {
+  StreamBuffer *buffer =
+      (StreamBuffer *)sfArenaAlloc(arena, sizeof(StreamBuffer));
+  *buffer = (StreamBuffer){0};
+  buffer->regionSize = regionSize;
+
+  GLsizeiptr size = regionSize * STREAM_BUFFER_FRAMES;
+  glGenBuffers(1, &buffer->vbo);
+  glBindBuffer(GL_ARRAY_BUFFER, buffer->vbo);
+
+  if (sfGLExtensions.hasBufferStorage) {
+    GLbitfield flags =
+        GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    sfGLExtensions.bufferStorage(GL_ARRAY_BUFFER, size, NULL, flags);
+    buffer->mapped =
+        (unsigned char *)glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+    buffer->isPersistent = buffer->mapped != NULL;
+    if (!buffer->isPersistent) {
+      // NOTE: Immutable storage can't be respecified, start over
+      glDeleteBuffers(1, &buffer->vbo);
+      glGenBuffers(1, &buffer->vbo);
+      glBindBuffer(GL_ARRAY_BUFFER, buffer->vbo);
+    }
+  }
+
+  if (!buffer->isPersistent) {
+    glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+  }
+
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  return buffer;
+}
+
+void *sfStreamBufferBegin(StreamBuffer *buffer) {
+  GLsync fence = buffer->fences[buffer->frame];
+  if (fence) {
+    GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+    while (1) {
+      GLenum status = glClientWaitSync(fence, flags, 1000000);
+      if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED ||
+          status == GL_WAIT_FAILED) {
+        break;
+      }
+      flags = 0;
+    }
+    glDeleteSync(fence);
+    buffer->fences[buffer->frame] = NULL;
+  }
+
+  GLintptr offset = buffer->regionSize * buffer->frame;
+  if (buffer->isPersistent) {
+    return buffer->mapped + offset;
+  }
+
+  glBindBuffer(GL_ARRAY_BUFFER, buffer->vbo);
+  void *memory = glMapBufferRange(GL_ARRAY_BUFFER, offset, buffer->regionSize,
+                                  GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT |
+                                      GL_MAP_INVALIDATE_RANGE_BIT);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  return memory;
+}
+
+void sfStreamBufferEnd(StreamBuffer *buffer) {
+  if (buffer->isPersistent) {
+    return;
+  }
+
+  glBindBuffer(GL_ARRAY_BUFFER, buffer->vbo);
+  glUnmapBuffer(GL_ARRAY_BUFFER);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void sfStreamBufferFence(StreamBuffer *buffer) {
+  buffer->fences[buffer->frame] =
+      glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  buffer->frame = (buffer->frame + 1) % STREAM_BUFFER_FRAMES;
+}
+
+void sfStreamBufferDestroy(StreamBuffer *buffer) {
+  for (int i = 0; i < STREAM_BUFFER_FRAMES; ++i) {
+    if (buffer->fences[i]) {
+      glDeleteSync(buffer->fences[i]);
+    }
+  }
+
+  if (buffer->isPersistent) {
+    glBindBuffer(GL_ARRAY_BUFFER, buffer->vbo);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+  }
+  glDeleteBuffers(1, &buffer->vbo);
+}
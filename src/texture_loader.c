@@ -0,0 +1,304 @@
+#include "texture_loader.h"
+#include "parallel.h"
+#include <string.h>
+#include <time.h>
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+static double now() {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+static int levelSize(int size, unsigned level) {
+  size >>= level;
+  return size ? size : 1;
+}
+
+static GLenum channelsFormat(int channels) {
+  switch (channels) {
+  case 1:
+    return GL_RED;
+  case 2:
+    return GL_RG;
+  case 3:
+    return GL_RGB;
+  default:
+    return GL_RGBA;
+  }
+}
+
+static unsigned char isMipmapped(GLint minFilter) {
+  return minFilter == GL_NEAREST_MIPMAP_NEAREST ||
+         minFilter == GL_NEAREST_MIPMAP_LINEAR ||
+         minFilter == GL_LINEAR_MIPMAP_NEAREST ||
+         minFilter == GL_LINEAR_MIPMAP_LINEAR;
+}
+
+// NOTE: 2x2 box filter, the odd row or column of a level is clamped
+static void downsample(const unsigned char *src, int srcWidth, int srcHeight,
+                       unsigned char *dst, int dstWidth, int dstHeight,
+                       int channels) {
+  for (int y = 0; y < dstHeight; ++y) {
+    int y0 = 2 * y;
+    int y1 = y0 + 1 < srcHeight ? y0 + 1 : y0;
+    for (int x = 0; x < dstWidth; ++x) {
+      int x0 = 2 * x;
+      int x1 = x0 + 1 < srcWidth ? x0 + 1 : x0;
+      for (int c = 0; c < channels; ++c) {
+        unsigned sum = src[(y0 * srcWidth + x0) * channels + c] +
+                       src[(y0 * srcWidth + x1) * channels + c] +
+                       src[(y1 * srcWidth + x0) * channels + c] +
+                       src[(y1 * srcWidth + x1) * channels + c];
+        dst[(y * dstWidth + x) * channels + c] = (unsigned char)((sum + 2) / 4);
+      }
+    }
+  }
+}
+
+static unsigned char decodeTexture(AsyncTexture *texture) {
+  int width, height, channels;
+  stbi_set_flip_vertically_on_load_thread(1);
+  unsigned char *image =
+      stbi_load(texture->path, &width, &height, &channels, 0);
+  if (!image) {
+    fprintf(stderr, "ERROR: Failed to load texture %s\n", texture->path);
+    return 0;
+  }
+
+  unsigned levelCount = 1;
+  if (isMipmapped(texture->minFilter)) {
+    int size = width > height ? width : height;
+    while (size > 1 && levelCount < TEXTURE_LOADER_MAX_LEVELS) {
+      size >>= 1;
+      levelCount++;
+    }
+  }
+
+  size_t total = 0;
+  for (unsigned level = 0; level < levelCount; ++level) {
+    texture->levelOffsets[level] = total;
+    total += (size_t)levelSize(width, level) * levelSize(height, level) *
+             channels;
+  }
+
+  unsigned char *pixels = (unsigned char *)malloc(total);
+  if (!pixels) {
+    fprintf(stderr, "ERROR: Failed to allocate mips for %s\n", texture->path);
+    stbi_image_free(image);
+    return 0;
+  }
+  memcpy(pixels, image, (size_t)width * height * channels);
+  stbi_image_free(image);
+
+  for (unsigned level = 1; level < levelCount; ++level) {
+    downsample(pixels + texture->levelOffsets[level - 1],
+               levelSize(width, level - 1), levelSize(height, level - 1),
+               pixels + texture->levelOffsets[level], levelSize(width, level),
+               levelSize(height, level), channels);
+  }
+
+  texture->pixels = pixels;
+  texture->imageWidth = width;
+  texture->imageHeight = height;
+  texture->channels = channels;
+  texture->levelCount = levelCount;
+  return 1;
+}
+
+static void *workerThread(void *data) {
+  TextureLoader *loader = (TextureLoader *)data;
+
+  pthread_mutex_lock(&loader->mutex);
+  while (1) {
+    while (!loader->queueCount && !loader->shouldQuit) {
+      pthread_cond_wait(&loader->cond, &loader->mutex);
+    }
+    if (loader->shouldQuit) {
+      break;
+    }
+
+    AsyncTexture *texture = &loader->textures[loader->queue[loader->queueHead]];
+    loader->queueHead = (loader->queueHead + 1) % TEXTURE_LOADER_MAX_TEXTURES;
+    loader->queueCount--;
+    texture->state = TEXTURE_DECODING;
+    pthread_mutex_unlock(&loader->mutex);
+
+    unsigned char isDecoded = decodeTexture(texture);
+
+    pthread_mutex_lock(&loader->mutex);
+    texture->state = isDecoded ? TEXTURE_DECODED : TEXTURE_FAILED;
+  }
+
+  pthread_mutex_unlock(&loader->mutex);
+  return NULL;
+}
+
+TextureLoader *sfTextureLoaderArenaAlloc(Arena *arena) {
+  TextureLoader *loader =
+      (TextureLoader *)sfArenaAlloc(arena, sizeof(TextureLoader));
+  memset(loader, 0, sizeof(TextureLoader));
+  glGenBuffers(1, &loader->pbo);
+
+  unsigned workerCount = sfParallelThreadCount() - 1;
+  if (workerCount < 1) {
+    workerCount = 1;
+  }
+  if (workerCount > TEXTURE_LOADER_MAX_WORKERS) {
+    workerCount = TEXTURE_LOADER_MAX_WORKERS;
+  }
+  loader->workerCount = workerCount;
+
+  pthread_mutex_init(&loader->mutex, NULL);
+  pthread_cond_init(&loader->cond, NULL);
+  for (unsigned i = 0; i < workerCount; ++i) {
+    pthread_create(&loader->workers[i], NULL, workerThread, loader);
+  }
+
+  return loader;
+}
+
+AsyncTexture *sfTextureLoaderLoad(TextureLoader *loader, const char *path,
+                                  GLint minFilter, GLint magFilter) {
+  if (loader->textureCount == TEXTURE_LOADER_MAX_TEXTURES ||
+      strlen(path) >= TEXTURE_LOADER_MAX_PATH) {
+    fprintf(stderr, "ERROR: Cannot queue texture %s\n", path);
+    return NULL;
+  }
+
+  unsigned index = loader->textureCount++;
+  AsyncTexture *texture = &loader->textures[index];
+  strcpy(texture->path, path);
+  texture->minFilter = minFilter;
+  texture->magFilter = magFilter;
+  texture->width = 1;
+  texture->height = 1;
+
+  const unsigned char placeholder[4] = {128, 128, 128, 255};
+  glGenTextures(1, &texture->id);
+  glBindTexture(GL_TEXTURE_2D, texture->id);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minFilter);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, magFilter);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+               placeholder);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  pthread_mutex_lock(&loader->mutex);
+  texture->state = TEXTURE_QUEUED;
+  loader->queue[(loader->queueHead + loader->queueCount) %
+                TEXTURE_LOADER_MAX_TEXTURES] = index;
+  loader->queueCount++;
+  pthread_cond_signal(&loader->cond);
+  pthread_mutex_unlock(&loader->mutex);
+
+  return texture;
+}
+
+// NOTE: Expects the texture bound. The unpack buffer is orphaned for every
+// level, so the copy never waits on the previous upload
+static void uploadLevel(TextureLoader *loader, AsyncTexture *texture) {
+  unsigned level = texture->levelCount - 1 - texture->uploadedLevels;
+  int width = levelSize(texture->imageWidth, level);
+  int height = levelSize(texture->imageHeight, level);
+  GLsizeiptr size = (GLsizeiptr)width * height * texture->channels;
+  const unsigned char *pixels = texture->pixels + texture->levelOffsets[level];
+  GLenum format = channelsFormat(texture->channels);
+
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, loader->pbo);
+  glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+  void *mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+                                  GL_MAP_WRITE_BIT |
+                                      GL_MAP_INVALIDATE_BUFFER_BIT);
+  if (mapped) {
+    memcpy(mapped, pixels, size);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glTexImage2D(GL_TEXTURE_2D, level, format, width, height, 0, format,
+                 GL_UNSIGNED_BYTE, (void *)0);
+  } else {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glTexImage2D(GL_TEXTURE_2D, level, format, width, height, 0, format,
+                 GL_UNSIGNED_BYTE, pixels);
+  }
+
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL,
+                  texture->levelCount - 1);
+  texture->uploadedLevels++;
+}
+
+// NOTE: Call once per frame on the GL thread. Returns how many textures are
+// still on their placeholder
+unsigned sfTextureLoaderUpdate(TextureLoader *loader, double budget) {
+  double start = now();
+  unsigned char hasUploaded = 0;
+  unsigned pendingCount = 0;
+
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  for (unsigned i = 0; i < loader->textureCount; ++i) {
+    AsyncTexture *texture = &loader->textures[i];
+
+    pthread_mutex_lock(&loader->mutex);
+    if (texture->state == TEXTURE_DECODED) {
+      texture->state = TEXTURE_UPLOADING;
+    }
+    TextureState state = texture->state;
+    pthread_mutex_unlock(&loader->mutex);
+
+    if (state == TEXTURE_READY || state == TEXTURE_FAILED) {
+      continue;
+    }
+    if (state != TEXTURE_UPLOADING ||
+        (hasUploaded && now() - start >= budget)) {
+      pendingCount++;
+      continue;
+    }
+
+    glBindTexture(GL_TEXTURE_2D, texture->id);
+    while (texture->uploadedLevels < texture->levelCount &&
+           (!hasUploaded || now() - start < budget)) {
+      uploadLevel(loader, texture);
+      hasUploaded = 1;
+    }
+
+    if (texture->uploadedLevels < texture->levelCount) {
+      pendingCount++;
+      continue;
+    }
+
+    free(texture->pixels);
+    texture->pixels = NULL;
+    texture->width = texture->imageWidth;
+    texture->height = texture->imageHeight;
+    texture->state = TEXTURE_READY;
+  }
+
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  return pendingCount;
+}
+
+void sfTextureLoaderDestroy(TextureLoader *loader) {
+  pthread_mutex_lock(&loader->mutex);
+  loader->shouldQuit = 1;
+  pthread_cond_broadcast(&loader->cond);
+  pthread_mutex_unlock(&loader->mutex);
+
+  for (unsigned i = 0; i < loader->workerCount; ++i) {
+    pthread_join(loader->workers[i], NULL);
+  }
+  pthread_mutex_destroy(&loader->mutex);
+  pthread_cond_destroy(&loader->cond);
+
+  for (unsigned i = 0; i < loader->textureCount; ++i) {
+    AsyncTexture *texture = &loader->textures[i];
+    free(texture->pixels);
+    glDeleteTextures(1, &texture->id);
+  }
+  glDeleteBuffers(1, &loader->pbo);
+}
@@ -0,0 +1,82 @@
+#include "thread_arena.h"
+#include "parallel.h"
+#include <string.h>
+
+// NOTE: All or nothing, a child missing would leave its ranges without an
+// arena. On failure the parent is rolled back and NULL returned
+ThreadArenas *sfThreadArenasArenaAlloc(Arena *parent, size_t threadCapacity) {
+  ArenaMarker marker = sfArenaMark(parent);
+  ThreadArenas *arenas =
+      (ThreadArenas *)sfArenaAlloc(parent, sizeof(ThreadArenas));
+  if (!arenas) {
+    return NULL;
+  }
+  memset(arenas, 0, sizeof(ThreadArenas));
+
+  unsigned threadCount = sfParallelThreadCount();
+  if (threadCount > THREAD_ARENA_MAX_THREADS) {
+    threadCount = THREAD_ARENA_MAX_THREADS;
+  }
+  threadCapacity = (threadCapacity + THREAD_ARENA_ALIGNMENT - 1) &
+                   ~(size_t)(THREAD_ARENA_ALIGNMENT - 1);
+
+  for (unsigned i = 0; i < threadCount; ++i) {
+    Arena *child = &arenas->threads[i];
+    child->baseMemory =
+        sfArenaAllocAligned(parent, threadCapacity, THREAD_ARENA_ALIGNMENT);
+    if (!child->baseMemory) {
+      sfArenaRestore(parent, marker);
+      return NULL;
+    }
+    child->allocPosition = child->baseMemory;
+    child->capacity = threadCapacity;
+    child->committed = threadCapacity;
+    arenas->threadCount++;
+  }
+  return arenas;
+}
+
+// NOTE: The child of the calling `sfParallelFor` range
+Arena *sfThreadArena(ThreadArenas *arenas) {
+  return &arenas->threads[sfParallelThreadIndex()];
+}
+
+// NOTE: Hands out all remaining space of `arena` for output of unknown
+// length, `sfThreadArenaEnd` then keeps the first `used` bytes of it.
+// `capacity` receives the number of bytes the caller may write
+void *sfThreadArenaBegin(Arena *arena, size_t alignment, size_t *capacity) {
+  void *begin = sfArenaAllocAligned(arena, 0, alignment);
+  *capacity = begin ? arena->capacity - arena->size : 0;
+  return begin;
+}
+
+void sfThreadArenaEnd(Arena *arena, const void *begin, size_t used) {
+  ArenaMarker marker = {(size_t)((const char *)begin -
+                                 (const char *)arena->baseMemory) +
+                        used};
+  sfArenaRestore(arena, marker);
+}
+
+void sfThreadArenasReset(ThreadArenas *arenas) {
+  for (unsigned i = 0; i < arenas->threadCount; ++i) {
+    sfArenaReset(&arenas->threads[i]);
+  }
+}
+
+// NOTE: Concatenates every child's allocations in thread order, which is the
+// order of the ranges they ran. Returns the bytes written, stops short at
+// `capacity`
+size_t sfThreadArenasMerge(const ThreadArenas *arenas, void *destination,
+                           size_t capacity) {
+  size_t offset = 0;
+  for (unsigned i = 0; i < arenas->threadCount; ++i) {
+    const Arena *child = &arenas->threads[i];
+    size_t size = child->size;
+    if (size > capacity - offset) {
+      size = capacity - offset;
+    }
+    memcpy((char *)destination + offset, child->baseMemory, size);
+    offset += size;
+  }
+  return offset;
+}
@@ -0,0 +1,657 @@
+#include "trajectory.h"
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define VALUES_PER_BODY 6
+#define MAX_VARINT_BYTES 3
+
+static size_t writeVarint(uint8_t *out, uint32_t value) {
+  size_t n = 0;
+  while (value >= 0x80) {
+    out[n++] = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  out[n++] = (uint8_t)value;
+  return n;
+}
+
+// NOTE: Returns 0 when the varint runs past `size` or past 32 bits
+static size_t readVarint(const uint8_t *in, size_t size, uint32_t *value) {
+  size_t n = 0;
+  unsigned shift = 0;
+  *value = 0;
+  while (1) {
+    if (n == size || shift > 28) {
+      return 0;
+    }
+    uint8_t byte = in[n++];
+    *value |= (uint32_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return n;
+    }
+    shift += 7;
+  }
+}
+
+static uint32_t zigzag(int32_t value) {
+  return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static int32_t unzigzag(uint32_t value) {
+  return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+size_t sfTrajectoryEncode(const uint16_t *values, const uint16_t *previous,
+                          unsigned count, uint8_t *out) {
+  size_t size = 0;
+  unsigned i = 0;
+  while (i < count) {
+    int32_t delta = (int32_t)values[i] - (int32_t)previous[i];
+    size += writeVarint(out + size, zigzag(delta));
+    ++i;
+
+    // NOTE: A zero is followed by the length of the zero run that follows it
+    if (delta == 0) {
+      unsigned run = 0;
+      while (i < count && values[i] == previous[i]) {
+        ++run;
+        ++i;
+      }
+      size += writeVarint(out + size, run);
+    }
+  }
+
+  return size;
+}
+
+// NOTE: Reads no further than `inSize` bytes. Returns the bytes consumed, 0
+// if the input ends before `count` values are decoded
+size_t sfTrajectoryDecode(const uint8_t *in, size_t inSize,
+                          const uint16_t *previous, unsigned count,
+                          uint16_t *values) {
+  size_t size = 0;
+  unsigned i = 0;
+  while (i < count) {
+    uint32_t encoded;
+    size_t n = readVarint(in + size, inSize - size, &encoded);
+    if (!n) {
+      return 0;
+    }
+    size += n;
+    int32_t delta = unzigzag(encoded);
+    values[i] = (uint16_t)(previous[i] + delta);
+    ++i;
+
+    if (delta == 0) {
+      uint32_t run;
+      n = readVarint(in + size, inSize - size, &run);
+      if (!n) {
+        return 0;
+      }
+      size += n;
+      for (unsigned j = 0; j < run && i < count; ++j, ++i) {
+        values[i] = previous[i];
+      }
+    }
+  }
+
+  return size;
+}
+
+static uint16_t quantize(float value, float min, float scale) {
+  return (uint16_t)(clampf((value - min) * scale, 0.0f,
+                           TRAJECTORY_QUANTIZATION_MAX) +
+                    0.5f);
+}
+
+static void quantizeFrame(const v3 *positions, const v3 *velocities,
+                          unsigned count, TrajectoryFrameHeader *header,
+                          uint16_t *out) {
+  header->bounds = sfOctantContaining(positions, count);
+  float size = header->bounds.size;
+  float positionScale = size > 0.0f ? TRAJECTORY_QUANTIZATION_MAX / size : 0.0f;
+  v3 min = v3_sub(header->bounds.center, v3_make(size * 0.5f, size * 0.5f,
+                                                 size * 0.5f));
+
+  float range = 0.0f;
+  for (unsigned i = 0; i < count; ++i) {
+    for (int k = 0; k < 3; ++k) {
+      range = fmaxf(range, fabsf(velocities[i].v[k]));
+    }
+  }
+  header->velocityRange = range;
+  float velocityScale =
+      range > 0.0f ? TRAJECTORY_QUANTIZATION_MAX / (2.0f * range) : 0.0f;
+
+  for (unsigned i = 0; i < count; ++i) {
+    uint16_t *q = &out[i * VALUES_PER_BODY];
+    for (int k = 0; k < 3; ++k) {
+      q[k] = quantize(positions[i].v[k], min.v[k], positionScale);
+      q[3 + k] = quantize(velocities[i].v[k], -range, velocityScale);
+    }
+  }
+}
+
+void sfTrajectoryDequantize(const TrajectoryFrameHeader *header,
+                            const uint16_t *quantized, unsigned count,
+                            v3 *positions, v3 *velocities) {
+  float size = header->bounds.size;
+  float positionStep = size / TRAJECTORY_QUANTIZATION_MAX;
+  v3 min = v3_sub(header->bounds.center, v3_make(size * 0.5f, size * 0.5f,
+                                                 size * 0.5f));
+  float range = header->velocityRange;
+  float velocityStep = 2.0f * range / TRAJECTORY_QUANTIZATION_MAX;
+
+  for (unsigned i = 0; i < count; ++i) {
+    const uint16_t *q = &quantized[i * VALUES_PER_BODY];
+    for (int k = 0; k < 3; ++k) {
+      positions[i].v[k] = min.v[k] + q[k] * positionStep;
+      velocities[i].v[k] = -range + q[3 + k] * velocityStep;
+    }
+  }
+}
+
+// NOTE: Returns 0 if any of the writes came up short
+static unsigned char writeChunk(TrajectoryWriter *writer,
+                                const TrajectoryChunk *chunk) {
+  unsigned valueCount = writer->bodyCount * VALUES_PER_BODY;
+  memset(writer->previousQuantized, 0, valueCount * sizeof(uint16_t));
+
+  size_t payloadSize = 0;
+  for (unsigned f = 0; f < chunk->frameCount; ++f) {
+    const v3 *positions = &chunk->positions[f * writer->bodyCount];
+    const v3 *velocities = &chunk->velocities[f * writer->bodyCount];
+    TrajectoryFrameHeader *header = &writer->frameHeaders[f];
+    header->step = chunk->steps[f];
+    quantizeFrame(positions, velocities, writer->bodyCount, header,
+                  writer->quantized);
+
+    payloadSize += sfTrajectoryEncode(writer->quantized,
+                                      writer->previousQuantized, valueCount,
+                                      writer->payload + payloadSize);
+
+    uint16_t *tmp = writer->previousQuantized;
+    writer->previousQuantized = writer->quantized;
+    writer->quantized = tmp;
+  }
+
+  TrajectoryChunkHeader chunkHeader = {{'S', 'F', 'T', 'C'},
+                                       chunk->frameCount,
+                                       (uint32_t)payloadSize};
+  return fwrite(&chunkHeader, sizeof(chunkHeader), 1, writer->file) == 1 &&
+         fwrite(writer->frameHeaders, sizeof(TrajectoryFrameHeader),
+                chunk->frameCount, writer->file) == chunk->frameCount &&
+         fwrite(writer->payload, 1, payloadSize, writer->file) == payloadSize;
+}
+
+static void *writerThread(void *data) {
+  TrajectoryWriter *writer = (TrajectoryWriter *)data;
+
+  pthread_mutex_lock(&writer->mutex);
+  while (1) {
+    while (writer->pending < 0 && !writer->shouldQuit) {
+      pthread_cond_wait(&writer->cond, &writer->mutex);
+    }
+
+    if (writer->pending < 0) {
+      break;
+    }
+
+    TrajectoryChunk *chunk = &writer->chunks[writer->pending];
+    pthread_mutex_unlock(&writer->mutex);
+
+    // NOTE: After a failed write the file is truncated, later chunks are
+    // dropped so it at least ends on a chunk boundary the reader can index
+    if (!writer->hasFailed && !writeChunk(writer, chunk)) {
+      writer->hasFailed = 1;
+    }
+
+    pthread_mutex_lock(&writer->mutex);
+    chunk->frameCount = 0;
+    writer->pending = -1;
+    pthread_cond_broadcast(&writer->cond);
+  }
+  pthread_mutex_unlock(&writer->mutex);
+
+  return NULL;
+}
+
+static void submitActiveChunk(TrajectoryWriter *writer) {
+  pthread_mutex_lock(&writer->mutex);
+  while (writer->pending >= 0) {
+    pthread_cond_wait(&writer->cond, &writer->mutex);
+  }
+  writer->pending = writer->active;
+  pthread_cond_broadcast(&writer->cond);
+  pthread_mutex_unlock(&writer->mutex);
+
+  writer->active ^= 1;
+}
+
+TrajectoryWriter *sfTrajectoryWriterArenaAlloc(Arena *arena, const char *path,
+                                               unsigned bodyCount,
+                                               unsigned stride,
+                                               unsigned framesPerChunk) {
+  FILE *file = fopen(path, "wb");
+  if (!file) {
+    fprintf(stderr, "ERROR: Failed to open trajectory file: %s\n", path);
+    return NULL;
+  }
+
+  TrajectoryWriter *writer =
+      (TrajectoryWriter *)sfArenaAlloc(arena, sizeof(TrajectoryWriter));
+  writer->file = file;
+  writer->bodyCount = bodyCount;
+  writer->stride = stride ? stride : 1;
+  writer->framesPerChunk = framesPerChunk ? framesPerChunk : 1;
+  writer->active = 0;
+  writer->pending = -1;
+  writer->shouldQuit = 0;
+  writer->hasFailed = 0;
+
+  unsigned frameBodies = writer->framesPerChunk * bodyCount;
+  for (int i = 0; i < 2; ++i) {
+    TrajectoryChunk *chunk = &writer->chunks[i];
+    chunk->frameCount = 0;
+    chunk->steps = (unsigned *)sfArenaAlloc(
+        arena, sizeof(unsigned) * writer->framesPerChunk);
+    chunk->positions = sfV3ArenaAlloc(arena, frameBodies);
+    chunk->velocities = sfV3ArenaAlloc(arena, frameBodies);
+  }
+
+  unsigned valueCount = bodyCount * VALUES_PER_BODY;
+  writer->quantized =
+      (uint16_t *)sfArenaAlloc(arena, sizeof(uint16_t) * valueCount);
+  writer->previousQuantized =
+      (uint16_t *)sfArenaAlloc(arena, sizeof(uint16_t) * valueCount);
+  writer->frameHeaders = (TrajectoryFrameHeader *)sfArenaAlloc(
+      arena, sizeof(TrajectoryFrameHeader) * writer->framesPerChunk);
+  writer->payloadCapacity =
+      (size_t)writer->framesPerChunk * valueCount * MAX_VARINT_BYTES;
+  writer->payload = (uint8_t *)sfArenaAlloc(arena, writer->payloadCapacity);
+
+  TrajectoryHeader header = {{'S', 'F', 'T', 'R'},
+                             TRAJECTORY_VERSION,
+                             bodyCount,
+                             writer->stride,
+                             writer->framesPerChunk};
+  if (fwrite(&header, sizeof(header), 1, writer->file) != 1) {
+    writer->hasFailed = 1;
+  }
+
+  pthread_mutex_init(&writer->mutex, NULL);
+  pthread_cond_init(&writer->cond, NULL);
+  pthread_create(&writer->thread, NULL, writerThread, writer);
+
+  return writer;
+}
+
+void sfTrajectoryWriterRecord(TrajectoryWriter *writer, unsigned step,
+                              const Bodies *bodies) {
+  if (step % writer->stride != 0) {
+    return;
+  }
+
+  TrajectoryChunk *chunk = &writer->chunks[writer->active];
+  unsigned offset = chunk->frameCount * writer->bodyCount;
+  sfBodiesGatherPositions(bodies, &chunk->positions[offset]);
+  sfBodiesGatherVelocities(bodies, &chunk->velocities[offset]);
+  chunk->steps[chunk->frameCount++] = step;
+
+  if (chunk->frameCount == writer->framesPerChunk) {
+    submitActiveChunk(writer);
+  }
+}
+
+// NOTE: Returns 0 if the recording could not be written out in full
+unsigned char sfTrajectoryWriterClose(TrajectoryWriter *writer) {
+  if (writer->chunks[writer->active].frameCount > 0) {
+    submitActiveChunk(writer);
+  }
+
+  pthread_mutex_lock(&writer->mutex);
+  while (writer->pending >= 0) {
+    pthread_cond_wait(&writer->cond, &writer->mutex);
+  }
+  writer->shouldQuit = 1;
+  pthread_cond_broadcast(&writer->cond);
+  pthread_mutex_unlock(&writer->mutex);
+
+  pthread_join(writer->thread, NULL);
+  pthread_mutex_destroy(&writer->mutex);
+  pthread_cond_destroy(&writer->cond);
+  if (fclose(writer->file) != 0) {
+    writer->hasFailed = 1;
+  }
+
+  if (writer->hasFailed) {
+    fprintf(stderr, "ERROR: Failed to write trajectory file, the recording "
+                    "is incomplete\n");
+    return 0;
+  }
+  return 1;
+}
+
+static void decodeChunk(const TrajectoryReader *reader, TrajectorySlot *slot,
+                        unsigned chunk) {
+  unsigned bodyCount = reader->header.bodyCount;
+  unsigned valueCount = bodyCount * VALUES_PER_BODY;
+  const uint8_t *cursor = reader->data + reader->chunkOffsets[chunk];
+
+  TrajectoryChunkHeader chunkHeader;
+  memcpy(&chunkHeader, cursor, sizeof(chunkHeader));
+  cursor += sizeof(chunkHeader);
+  const uint8_t *payload =
+      cursor + sizeof(TrajectoryFrameHeader) * chunkHeader.frameCount;
+  const uint8_t *payloadEnd = payload + chunkHeader.payloadSize;
+  unsigned char isCorrupt = 0;
+
+  memset(slot->previousQuantized, 0, valueCount * sizeof(uint16_t));
+  for (unsigned f = 0; f < chunkHeader.frameCount; ++f) {
+    TrajectoryFrameHeader header;
+    memcpy(&header, cursor + sizeof(header) * f, sizeof(header));
+
+    // NOTE: Frames past a truncated payload repeat the last decoded one
+    size_t size = 0;
+    if (!isCorrupt) {
+      size = sfTrajectoryDecode(payload, payloadEnd - payload,
+                                slot->previousQuantized, valueCount,
+                                slot->quantized);
+    }
+    if (!size) {
+      if (!isCorrupt) {
+        fprintf(stderr, "ERROR: Corrupt trajectory chunk %u\n", chunk);
+        isCorrupt = 1;
+      }
+      memcpy(slot->quantized, slot->previousQuantized,
+             valueCount * sizeof(uint16_t));
+    }
+    payload += size;
+    sfTrajectoryDequantize(&header, slot->quantized, bodyCount,
+                           &slot->frames.positions[f * bodyCount],
+                           &slot->frames.velocities[f * bodyCount]);
+    slot->frames.steps[f] = header.step;
+
+    uint16_t *tmp = slot->previousQuantized;
+    slot->previousQuantized = slot->quantized;
+    slot->quantized = tmp;
+  }
+  slot->frames.frameCount = chunkHeader.frameCount;
+}
+
+static void adviseChunk(const TrajectoryReader *reader, unsigned chunk) {
+  size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+  size_t begin = reader->chunkOffsets[chunk] & ~(pageSize - 1);
+  size_t end = chunk + 1 < reader->chunkCount ? reader->chunkOffsets[chunk + 1]
+                                              : reader->size;
+  madvise((void *)(reader->data + begin), end - begin, MADV_WILLNEED);
+}
+
+static int findSlot(const TrajectoryReader *reader, unsigned chunk) {
+  for (int i = 0; i < TRAJECTORY_CACHE_SLOTS; ++i) {
+    if (reader->slots[i].state != TRAJECTORY_SLOT_EMPTY &&
+        reader->slots[i].chunk == chunk) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static int evictableSlot(const TrajectoryReader *reader) {
+  int slot = -1;
+  unsigned farthest = 0;
+  for (int i = 0; i < TRAJECTORY_CACHE_SLOTS; ++i) {
+    const TrajectorySlot *candidate = &reader->slots[i];
+    if (candidate->state == TRAJECTORY_SLOT_EMPTY) {
+      return i;
+    }
+    if (candidate->state == TRAJECTORY_SLOT_DECODING ||
+        candidate->chunk == reader->currentChunk) {
+      continue;
+    }
+
+    unsigned distance = candidate->chunk > reader->currentChunk
+                            ? candidate->chunk - reader->currentChunk
+                            : reader->chunkCount + reader->currentChunk -
+                                  candidate->chunk;
+    if (slot < 0 || distance > farthest) {
+      slot = i;
+      farthest = distance;
+    }
+  }
+  return slot;
+}
+
+// NOTE: Must be called with the mutex held, returns with it held
+static int acquireChunk(TrajectoryReader *reader, unsigned chunk) {
+  while (1) {
+    int slot = findSlot(reader, chunk);
+    if (slot >= 0 && reader->slots[slot].state == TRAJECTORY_SLOT_READY) {
+      return slot;
+    }
+    if (slot >= 0) {
+      pthread_cond_wait(&reader->cond, &reader->mutex);
+      continue;
+    }
+
+    slot = evictableSlot(reader);
+    if (slot < 0) {
+      pthread_cond_wait(&reader->cond, &reader->mutex);
+      continue;
+    }
+
+    reader->slots[slot].state = TRAJECTORY_SLOT_DECODING;
+    reader->slots[slot].chunk = chunk;
+    pthread_mutex_unlock(&reader->mutex);
+    decodeChunk(reader, &reader->slots[slot], chunk);
+    pthread_mutex_lock(&reader->mutex);
+    reader->slots[slot].state = TRAJECTORY_SLOT_READY;
+    pthread_cond_broadcast(&reader->cond);
+    return slot;
+  }
+}
+
+static void *prefetchThread(void *data) {
+  TrajectoryReader *reader = (TrajectoryReader *)data;
+
+  pthread_mutex_lock(&reader->mutex);
+  while (!reader->shouldQuit) {
+    int claimed = 0;
+    for (unsigned ahead = 1; ahead <= TRAJECTORY_PREFETCH_CHUNKS; ++ahead) {
+      unsigned chunk = (reader->currentChunk + ahead) % reader->chunkCount;
+      if (findSlot(reader, chunk) >= 0) {
+        continue;
+      }
+
+      int slot = evictableSlot(reader);
+      if (slot < 0) {
+        break;
+      }
+
+      reader->slots[slot].state = TRAJECTORY_SLOT_DECODING;
+      reader->slots[slot].chunk = chunk;
+      pthread_mutex_unlock(&reader->mutex);
+
+      adviseChunk(reader, chunk);
+      decodeChunk(reader, &reader->slots[slot], chunk);
+
+      pthread_mutex_lock(&reader->mutex);
+      reader->slots[slot].state = TRAJECTORY_SLOT_READY;
+      pthread_cond_broadcast(&reader->cond);
+      claimed = 1;
+      break;
+    }
+
+    if (!claimed) {
+      pthread_cond_wait(&reader->cond, &reader->mutex);
+    }
+  }
+  pthread_mutex_unlock(&reader->mutex);
+
+  return NULL;
+}
+
+TrajectoryReader *sfTrajectoryReaderArenaAlloc(Arena *arena, const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "ERROR: Failed to open trajectory file: %s\n", path);
+    return NULL;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(TrajectoryHeader)) {
+    fprintf(stderr, "ERROR: Invalid trajectory file: %s\n", path);
+    close(fd);
+    return NULL;
+  }
+
+  const uint8_t *data =
+      (const uint8_t *)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (data == MAP_FAILED) {
+    fprintf(stderr, "ERROR: Failed to map trajectory file: %s\n", path);
+    close(fd);
+    return NULL;
+  }
+
+  TrajectoryHeader header;
+  memcpy(&header, data, sizeof(header));
+  if (memcmp(header.magic, "SFTR", 4) != 0 ||
+      header.version != TRAJECTORY_VERSION || header.bodyCount == 0 ||
+      (uint64_t)header.framesPerChunk * header.bodyCount * VALUES_PER_BODY >
+          UINT32_MAX) {
+    fprintf(stderr, "ERROR: Unsupported trajectory file: %s\n", path);
+    munmap((void *)data, st.st_size);
+    close(fd);
+    return NULL;
+  }
+
+  // NOTE: Count chunks first so the index can be allocated in one go. Slots
+  // hold `framesPerChunk` frames, indexing stops at a chunk claiming more
+  unsigned chunkCount = 0;
+  size_t offset = sizeof(TrajectoryHeader);
+  while (offset + sizeof(TrajectoryChunkHeader) <= (size_t)st.st_size) {
+    TrajectoryChunkHeader chunkHeader;
+    memcpy(&chunkHeader, data + offset, sizeof(chunkHeader));
+    if (chunkHeader.frameCount == 0 ||
+        chunkHeader.frameCount > header.framesPerChunk) {
+      break;
+    }
+    size_t chunkSize = sizeof(chunkHeader) +
+                       sizeof(TrajectoryFrameHeader) * chunkHeader.frameCount +
+                       chunkHeader.payloadSize;
+    if (memcmp(chunkHeader.magic, "SFTC", 4) != 0 ||
+        offset + chunkSize > (size_t)st.st_size) {
+      break;
+    }
+    offset += chunkSize;
+    ++chunkCount;
+  }
+
+  if (chunkCount == 0) {
+    fprintf(stderr, "ERROR: Trajectory file has no frames: %s\n", path);
+    munmap((void *)data, st.st_size);
+    close(fd);
+    return NULL;
+  }
+
+  TrajectoryReader *reader =
+      (TrajectoryReader *)sfArenaAlloc(arena, sizeof(TrajectoryReader));
+  reader->fd = fd;
+  reader->data = data;
+  reader->size = st.st_size;
+  reader->header = header;
+  reader->chunkCount = chunkCount;
+  reader->currentChunk = 0;
+  reader->shouldQuit = 0;
+  reader->chunkOffsets =
+      (size_t *)sfArenaAlloc(arena, sizeof(size_t) * chunkCount);
+  reader->chunkFirstFrames =
+      (unsigned *)sfArenaAlloc(arena, sizeof(unsigned) * chunkCount);
+
+  reader->frameCount = 0;
+  offset = sizeof(TrajectoryHeader);
+  for (unsigned i = 0; i < chunkCount; ++i) {
+    TrajectoryChunkHeader chunkHeader;
+    memcpy(&chunkHeader, data + offset, sizeof(chunkHeader));
+    reader->chunkOffsets[i] = offset;
+    reader->chunkFirstFrames[i] = reader->frameCount;
+    reader->frameCount += chunkHeader.frameCount;
+    offset += sizeof(chunkHeader) +
+              sizeof(TrajectoryFrameHeader) * chunkHeader.frameCount +
+              chunkHeader.payloadSize;
+  }
+
+  unsigned frameBodies = header.framesPerChunk * header.bodyCount;
+  unsigned valueCount = header.bodyCount * VALUES_PER_BODY;
+  for (int i = 0; i < TRAJECTORY_CACHE_SLOTS; ++i) {
+    TrajectorySlot *slot = &reader->slots[i];
+    slot->state = TRAJECTORY_SLOT_EMPTY;
+    slot->chunk = 0;
+    slot->frames.frameCount = 0;
+    slot->frames.steps = (unsigned *)sfArenaAlloc(
+        arena, sizeof(unsigned) * header.framesPerChunk);
+    slot->frames.positions = sfV3ArenaAlloc(arena, frameBodies);
+    slot->frames.velocities = sfV3ArenaAlloc(arena, frameBodies);
+    slot->quantized =
+        (uint16_t *)sfArenaAlloc(arena, sizeof(uint16_t) * valueCount);
+    slot->previousQuantized =
+        (uint16_t *)sfArenaAlloc(arena, sizeof(uint16_t) * valueCount);
+  }
+
+  madvise((void *)reader->data, reader->size, MADV_SEQUENTIAL);
+
+  pthread_mutex_init(&reader->mutex, NULL);
+  pthread_cond_init(&reader->cond, NULL);
+  pthread_create(&reader->thread, NULL, prefetchThread, reader);
+
+  return reader;
+}
+
+unsigned sfTrajectoryReaderFrame(TrajectoryReader *reader, unsigned frame,
+                                 v3 *positions, v3 *velocities) {
+  frame %= reader->frameCount;
+
+  // NOTE: Binary search for the last chunk starting at or before `frame`
+  unsigned lo = 0, hi = reader->chunkCount - 1;
+  while (lo < hi) {
+    unsigned mid = (lo + hi + 1) / 2;
+    if (reader->chunkFirstFrames[mid] <= frame) {
+      lo = mid;
+    } else {
+      hi = mid - 1;
+    }
+  }
+  unsigned chunk = lo;
+
+  pthread_mutex_lock(&reader->mutex);
+  reader->currentChunk = chunk;
+  int slot = acquireChunk(reader, chunk);
+  pthread_cond_broadcast(&reader->cond);
+  pthread_mutex_unlock(&reader->mutex);
+
+  const TrajectoryChunk *frames = &reader->slots[slot].frames;
+  unsigned bodyCount = reader->header.bodyCount;
+  unsigned local = frame - reader->chunkFirstFrames[chunk];
+  memcpy(positions, &frames->positions[local * bodyCount],
+         sizeof(v3) * bodyCount);
+  memcpy(velocities, &frames->velocities[local * bodyCount],
+         sizeof(v3) * bodyCount);
+
+  return frames->steps[local];
+}
+
+void sfTrajectoryReaderClose(TrajectoryReader *reader) {
+  pthread_mutex_lock(&reader->mutex);
+  reader->shouldQuit = 1;
+  pthread_cond_broadcast(&reader->cond);
+  pthread_mutex_unlock(&reader->mutex);
+
+  pthread_join(reader->thread, NULL);
+  pthread_mutex_destroy(&reader->mutex);
+  pthread_cond_destroy(&reader->cond);
+  munmap((void *)reader->data, reader->size);
+  close(reader->fd);
+}
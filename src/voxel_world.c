@@ -0,0 +1,516 @@
+#include "voxel_world.h"
+#include "parallel.h"
+#include <string.h>
+
+#define CHUNK VOXEL_WORLD_CHUNK_SIZE
+#define PADDED VOXEL_WORLD_PADDED_SIZE
+
+static inline uint64_t paddedRow(const uint64_t *padded, int z, int y) {
+  return padded[(z + 1) * PADDED + (y + 1)];
+}
+
+// NOTE: Two triangles over the (col, row) rectangle of a face lying in
+// `slice` along `axis`, wound counter clockwise seen from outside
+static float *emitQuad(float *out, int axis, unsigned char isPositive,
+                       unsigned slice, unsigned row, unsigned col,
+                       unsigned height, unsigned width, v3 origin,
+                       float voxelSize) {
+  static const int colAxes[3] = {1, 0, 0};
+  static const int rowAxes[3] = {2, 2, 1};
+  const unsigned corners[4][2] = {{col, row},
+                                  {col + width, row},
+                                  {col + width, row + height},
+                                  {col, row + height}};
+  unsigned char isFlipped = axis == 1 ? isPositive : !isPositive;
+  const int order[2][6] = {{0, 1, 2, 0, 2, 3}, {0, 2, 1, 0, 3, 2}};
+
+  for (int i = 0; i < 6; ++i) {
+    const unsigned *corner = corners[order[isFlipped][i]];
+    float local[3];
+    local[axis] = (float)(slice + isPositive);
+    local[colAxes[axis]] = (float)corner[0];
+    local[rowAxes[axis]] = (float)corner[1];
+
+    *out++ = origin.x + local[0] * voxelSize;
+    *out++ = origin.y + local[1] * voxelSize;
+    *out++ = origin.z + local[2] * voxelSize;
+    *out++ = (float)corner[0];
+    *out++ = (float)corner[1];
+  }
+  return out;
+}
+
+// NOTE: Consumes `mask`. Runs along a row are widened down the following rows
+// for as long as they are fully covered
+static float *greedySlice(uint32_t *mask, float *out, int axis,
+                          unsigned char isPositive, unsigned slice, v3 origin,
+                          float voxelSize) {
+  for (unsigned row = 0; row < CHUNK; ++row) {
+    while (mask[row]) {
+      unsigned col = __builtin_ctz(mask[row]);
+      uint32_t rest = ~(mask[row] >> col);
+      unsigned width = rest ? (unsigned)__builtin_ctz(rest) : CHUNK - col;
+      uint32_t bits =
+          (width == CHUNK ? 0xffffffffu : ((1u << width) - 1u)) << col;
+
+      unsigned height = 1;
+      while (row + height < CHUNK && (mask[row + height] & bits) == bits) {
+        mask[row + height] &= ~bits;
+        ++height;
+      }
+      mask[row] &= ~bits;
+
+      out = emitQuad(out, axis, isPositive, slice, row, col, height, width,
+                     origin, voxelSize);
+    }
+  }
+  return out;
+}
+
+unsigned sfVoxelGreedyMesh(const uint64_t *padded, v3 origin, float voxelSize,
+                           float *vertices) {
+  float *out = vertices;
+  uint32_t faces[CHUNK][CHUNK];
+  uint32_t mask[CHUNK];
+
+  for (int direction = 0; direction < 6; ++direction) {
+    int axis = direction / 2;
+    unsigned char isPositive = (direction & 1) == 0;
+    int step = isPositive ? 1 : -1;
+
+    // NOTE: Hidden face removal, a face survives only against empty space.
+    // faces[z][y] bit x, neighbours come from the snapshot border
+    for (int z = 0; z < CHUNK; ++z) {
+      for (int y = 0; y < CHUNK; ++y) {
+        uint64_t row = paddedRow(padded, z, y);
+        uint64_t neighbour;
+        if (axis == 0) {
+          neighbour = isPositive ? row >> 1 : row << 1;
+        } else if (axis == 1) {
+          neighbour = paddedRow(padded, z, y + step);
+        } else {
+          neighbour = paddedRow(padded, z + step, y);
+        }
+        faces[z][y] = (uint32_t)((row & ~neighbour) >> 1);
+      }
+    }
+
+    for (unsigned slice = 0; slice < CHUNK; ++slice) {
+      if (axis == 0) {
+        // NOTE: rows z, bits y
+        for (unsigned z = 0; z < CHUNK; ++z) {
+          uint32_t bits = 0;
+          for (unsigned y = 0; y < CHUNK; ++y) {
+            bits |= ((faces[z][y] >> slice) & 1u) << y;
+          }
+          mask[z] = bits;
+        }
+      } else if (axis == 1) {
+        // NOTE: rows z, bits x
+        for (unsigned z = 0; z < CHUNK; ++z) {
+          mask[z] = faces[z][slice];
+        }
+      } else {
+        // NOTE: rows y, bits x
+        memcpy(mask, faces[slice], sizeof(mask));
+      }
+
+      out = greedySlice(mask, out, axis, isPositive, slice, origin, voxelSize);
+    }
+  }
+
+  return (unsigned)((out - vertices) / VOXEL_WORLD_VERTEX_FLOATS);
+}
+
+static v3 chunkOrigin(const VoxelWorld *world, unsigned chunk) {
+  unsigned x = chunk % world->dimensions[0];
+  unsigned y = (chunk / world->dimensions[0]) % world->dimensions[1];
+  unsigned z = chunk / (world->dimensions[0] * world->dimensions[1]);
+  float size = CHUNK * world->voxelSize;
+  return v3_add(world->origin, v3_make(x * size, y * size, z * size));
+}
+
+// NOTE: Expects `world->mutex` held
+static void freeMesh(VoxelWorld *world, PoolHandle mesh) {
+  VoxelMeshBlock *block;
+  while ((block = sfPoolGetAs(VoxelMeshBlock, world->meshBlocks, mesh))) {
+    PoolHandle next = block->next;
+    sfPoolFree(world->meshBlocks, mesh);
+    mesh = next;
+  }
+}
+
+static void *workerThread(void *data) {
+  VoxelWorld *world = (VoxelWorld *)data;
+
+  pthread_mutex_lock(&world->mutex);
+  unsigned worker = world->startedCount++;
+  float *scratch = world->scratch[worker];
+
+  while (1) {
+    while (!world->queueCount && !world->shouldQuit) {
+      pthread_cond_wait(&world->cond, &world->mutex);
+    }
+    if (world->shouldQuit) {
+      break;
+    }
+
+    unsigned chunkIndex = world->queue[world->queueHead];
+    world->queueHead = (world->queueHead + 1) % world->chunkCount;
+    world->queueCount--;
+    pthread_mutex_unlock(&world->mutex);
+
+    VoxelWorldChunk *chunk = &world->chunks[chunkIndex];
+    unsigned vertexCount =
+        sfVoxelGreedyMesh(chunk->snapshot, chunkOrigin(world, chunkIndex),
+                          world->voxelSize, scratch);
+    unsigned blockCount = (vertexCount + VOXEL_WORLD_MESH_BLOCK_VERTICES - 1) /
+                          VOXEL_WORLD_MESH_BLOCK_VERTICES;
+
+    // NOTE: Blocks are linked back to front so the chain reads in vertex
+    // order, and resolved under the lock so the copy can run without it
+    VoxelMeshBlock *blocks[VOXEL_WORLD_MAX_MESH_BLOCKS];
+    PoolHandle mesh = {0, 0};
+    pthread_mutex_lock(&world->mutex);
+    for (unsigned b = blockCount; b-- > 0;) {
+      PoolHandle handle = sfPoolAlloc(world->meshBlocks);
+      blocks[b] = sfPoolGetAs(VoxelMeshBlock, world->meshBlocks, handle);
+      if (!blocks[b]) {
+        freeMesh(world, mesh);
+        mesh = (PoolHandle){0, 0};
+        vertexCount = 0;
+        blockCount = 0;
+        break;
+      }
+      blocks[b]->next = mesh;
+      mesh = handle;
+    }
+    pthread_mutex_unlock(&world->mutex);
+
+    for (unsigned b = 0; b < blockCount; ++b) {
+      unsigned first = b * VOXEL_WORLD_MESH_BLOCK_VERTICES;
+      unsigned count = vertexCount - first < VOXEL_WORLD_MESH_BLOCK_VERTICES
+                           ? vertexCount - first
+                           : VOXEL_WORLD_MESH_BLOCK_VERTICES;
+      memcpy(blocks[b]->vertices, scratch + first * VOXEL_WORLD_VERTEX_FLOATS,
+             sizeof(float) * count * VOXEL_WORLD_VERTEX_FLOATS);
+    }
+
+    pthread_mutex_lock(&world->mutex);
+    chunk->mesh = mesh;
+    chunk->vertexCount = vertexCount;
+    chunk->state = VOXEL_CHUNK_MESHED;
+  }
+
+  pthread_mutex_unlock(&world->mutex);
+  return NULL;
+}
+
+VoxelWorld *sfVoxelWorldArenaAlloc(Arena *arena, unsigned chunksX,
+                                   unsigned chunksY, unsigned chunksZ,
+                                   v3 origin, float voxelSize) {
+  VoxelWorld *world = (VoxelWorld *)sfArenaAlloc(arena, sizeof(VoxelWorld));
+  memset(world, 0, sizeof(VoxelWorld));
+  world->dimensions[0] = chunksX;
+  world->dimensions[1] = chunksY;
+  world->dimensions[2] = chunksZ;
+  world->chunkCount = chunksX * chunksY * chunksZ;
+  world->origin = origin;
+  world->voxelSize = voxelSize;
+
+  world->chunks = (VoxelWorldChunk *)sfArenaAlloc(
+      arena, sizeof(VoxelWorldChunk) * world->chunkCount);
+  memset(world->chunks, 0, sizeof(VoxelWorldChunk) * world->chunkCount);
+  world->queue =
+      (unsigned *)sfArenaAlloc(arena, sizeof(unsigned) * world->chunkCount);
+  world->meshBlocks =
+      sfPoolArenaAlloc(arena, sizeof(VoxelMeshBlock),
+                       world->chunkCount * VOXEL_WORLD_MAX_MESH_BLOCKS);
+
+  for (unsigned i = 0; i < world->chunkCount; ++i) {
+    VoxelWorldChunk *chunk = &world->chunks[i];
+    glGenVertexArrays(1, &chunk->vao);
+    glGenBuffers(1, &chunk->vbo);
+    glBindVertexArray(chunk->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, chunk->vbo);
+    glEnableVertexAttribArray(VERTEX_POSITION_LOCATION);
+    glVertexAttribPointer(VERTEX_POSITION_LOCATION, 3, GL_FLOAT, GL_FALSE,
+                          VOXEL_WORLD_VERTEX_FLOATS * sizeof(float),
+                          (void *)0);
+    glEnableVertexAttribArray(TEX_COORD_LOCATION);
+    glVertexAttribPointer(TEX_COORD_LOCATION, 2, GL_FLOAT, GL_FALSE,
+                          VOXEL_WORLD_VERTEX_FLOATS * sizeof(float),
+                          (void *)(3 * sizeof(float)));
+  }
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  unsigned workerCount = sfParallelThreadCount() - 1;
+  if (workerCount < 1) {
+    workerCount = 1;
+  }
+  if (workerCount > VOXEL_WORLD_MAX_WORKERS) {
+    workerCount = VOXEL_WORLD_MAX_WORKERS;
+  }
+  world->workerCount = workerCount;
+  for (unsigned i = 0; i < workerCount; ++i) {
+    world->scratch[i] = (float *)sfArenaAlloc(
+        arena, sizeof(float) * VOXEL_WORLD_MAX_QUADS * 6 *
+                   VOXEL_WORLD_VERTEX_FLOATS);
+  }
+
+  pthread_mutex_init(&world->mutex, NULL);
+  pthread_cond_init(&world->cond, NULL);
+  for (unsigned i = 0; i < workerCount; ++i) {
+    pthread_create(&world->workers[i], NULL, workerThread, world);
+  }
+
+  return world;
+}
+
+static void markDirty(VoxelWorld *world, unsigned chunkIndex) {
+  VoxelWorldChunk *chunk = &world->chunks[chunkIndex];
+  if (chunk->state == VOXEL_CHUNK_CLEAN) {
+    chunk->state = VOXEL_CHUNK_DIRTY;
+  } else if (chunk->state != VOXEL_CHUNK_DIRTY) {
+    chunk->isStale = 1;
+  }
+}
+
+// NOTE: Must be called from the thread running `sfVoxelWorldUpdate`
+void sfVoxelWorldSet(VoxelWorld *world, unsigned x, unsigned y, unsigned z,
+                     unsigned char isSolid) {
+  unsigned position[3] = {x, y, z};
+  unsigned chunkCoordinates[3];
+  unsigned local[3];
+  for (int axis = 0; axis < 3; ++axis) {
+    chunkCoordinates[axis] = position[axis] / CHUNK;
+    local[axis] = position[axis] % CHUNK;
+    if (chunkCoordinates[axis] >= world->dimensions[axis]) {
+      return;
+    }
+  }
+
+  unsigned chunkIndex =
+      (chunkCoordinates[2] * world->dimensions[1] + chunkCoordinates[1]) *
+          world->dimensions[0] +
+      chunkCoordinates[0];
+  VoxelWorldChunk *chunk = &world->chunks[chunkIndex];
+  uint32_t *row = &chunk->occupancy[local[2] * CHUNK + local[1]];
+  uint32_t bit = 1u << local[0];
+  if (((*row & bit) != 0) == (isSolid != 0)) {
+    return;
+  }
+  *row = isSolid ? (*row | bit) : (*row & ~bit);
+
+  pthread_mutex_lock(&world->mutex);
+  markDirty(world, chunkIndex);
+
+  // NOTE: Voxels on a chunk border also uncover or hide neighbour faces
+  unsigned strides[3] = {1, world->dimensions[0],
+                         world->dimensions[0] * world->dimensions[1]};
+  for (int axis = 0; axis < 3; ++axis) {
+    if (local[axis] == 0 && chunkCoordinates[axis] > 0) {
+      markDirty(world, chunkIndex - strides[axis]);
+    }
+    if (local[axis] == CHUNK - 1 &&
+        chunkCoordinates[axis] + 1 < world->dimensions[axis]) {
+      markDirty(world, chunkIndex + strides[axis]);
+    }
+  }
+  pthread_mutex_unlock(&world->mutex);
+}
+
+void sfVoxelWorldInitFloor(VoxelWorld *world, unsigned width, unsigned depth) {
+  for (unsigned z = 0; z < depth; ++z) {
+    for (unsigned x = 0; x < width; ++x) {
+      sfVoxelWorldSet(world, x, 0, z, 1);
+    }
+  }
+}
+
+static uint32_t occupancyRow(const VoxelWorld *world, int cx, int cy, int cz,
+                             int y, int z) {
+  if (cx < 0 || cy < 0 || cz < 0 || cx >= (int)world->dimensions[0] ||
+      cy >= (int)world->dimensions[1] || cz >= (int)world->dimensions[2]) {
+    return 0;
+  }
+  unsigned chunk =
+      (cz * world->dimensions[1] + cy) * world->dimensions[0] + cx;
+  return world->chunks[chunk].occupancy[z * CHUNK + y];
+}
+
+// NOTE: Copies the chunk with a one voxel border, so the worker never reads
+// occupancy the main thread may be editing
+static void snapshotChunk(const VoxelWorld *world, unsigned chunkIndex,
+                          uint64_t *padded) {
+  int cx = chunkIndex % world->dimensions[0];
+  int cy = (chunkIndex / world->dimensions[0]) % world->dimensions[1];
+  int cz = chunkIndex / (world->dimensions[0] * world->dimensions[1]);
+
+  for (int pz = 0; pz < PADDED; ++pz) {
+    for (int py = 0; py < PADDED; ++py) {
+      int z = pz - 1;
+      int y = py - 1;
+      int oz = cz + (z < 0 ? -1 : z >= CHUNK ? 1 : 0);
+      int oy = cy + (y < 0 ? -1 : y >= CHUNK ? 1 : 0);
+      int lz = (z + CHUNK) % CHUNK;
+      int ly = (y + CHUNK) % CHUNK;
+
+      uint64_t row = (uint64_t)occupancyRow(world, cx, oy, oz, ly, lz) << 1;
+      if (oy == cy && oz == cz) {
+        row |= (uint64_t)(occupancyRow(world, cx - 1, cy, cz, ly, lz) >>
+                          (CHUNK - 1));
+        row |= (uint64_t)(occupancyRow(world, cx + 1, cy, cz, ly, lz) & 1u)
+               << (CHUNK + 1);
+      }
+      padded[pz * PADDED + py] = row;
+    }
+  }
+}
+
+// NOTE: Uploads finished meshes and queues dirty chunks, call once a frame
+// on the GL thread
+void sfVoxelWorldUpdate(VoxelWorld *world) {
+  pthread_mutex_lock(&world->mutex);
+  for (unsigned i = 0; i < world->chunkCount; ++i) {
+    VoxelWorldChunk *chunk = &world->chunks[i];
+    if (chunk->state == VOXEL_CHUNK_MESHED) {
+      const GLsizeiptr vertexSize = sizeof(float) * VOXEL_WORLD_VERTEX_FLOATS;
+      glBindBuffer(GL_ARRAY_BUFFER, chunk->vbo);
+      glBufferData(GL_ARRAY_BUFFER, vertexSize * chunk->vertexCount, NULL,
+                   GL_STATIC_DRAW);
+
+      unsigned uploaded = 0;
+      VoxelMeshBlock *block;
+      PoolHandle handle = chunk->mesh;
+      while ((block = sfPoolGetAs(VoxelMeshBlock, world->meshBlocks, handle))) {
+        unsigned count =
+            chunk->vertexCount - uploaded < VOXEL_WORLD_MESH_BLOCK_VERTICES
+                ? chunk->vertexCount - uploaded
+                : VOXEL_WORLD_MESH_BLOCK_VERTICES;
+        glBufferSubData(GL_ARRAY_BUFFER, vertexSize * uploaded,
+                        vertexSize * count, block->vertices);
+        uploaded += count;
+        handle = block->next;
+      }
+      freeMesh(world, chunk->mesh);
+      chunk->mesh = (PoolHandle){0, 0};
+
+      chunk->uploadedCount = chunk->vertexCount;
+      chunk->state = chunk->isStale ? VOXEL_CHUNK_DIRTY : VOXEL_CHUNK_CLEAN;
+      chunk->isStale = 0;
+    }
+
+    if (chunk->state == VOXEL_CHUNK_DIRTY) {
+      snapshotChunk(world, i, chunk->snapshot);
+      chunk->state = VOXEL_CHUNK_QUEUED;
+      world->queue[(world->queueHead + world->queueCount) % world->chunkCount] =
+          i;
+      world->queueCount++;
+      pthread_cond_signal(&world->cond);
+    }
+  }
+  pthread_mutex_unlock(&world->mutex);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void sfVoxelWorldRender(const VoxelWorld *world, const Frustum *frustum) {
+  if (world->texture) {
+    glBindTexture(GL_TEXTURE_2D, world->texture);
+  }
+  __setIdentityInstance(VOXEL_INSTANCE_COMPACT);
+  __setIdentityInstance(VOXEL_INSTANCE_MATRIX);
+
+  float size = CHUNK * world->voxelSize;
+  for (unsigned i = 0; i < world->chunkCount; ++i) {
+    const VoxelWorldChunk *chunk = &world->chunks[i];
+    if (!chunk->uploadedCount) {
+      continue;
+    }
+
+    v3 min = chunkOrigin(world, i);
+    if (frustum && sfFrustumTestBox(frustum, min,
+                                    v3_add(min, v3_make(size, size, size))) ==
+                       CULL_OUTSIDE) {
+      continue;
+    }
+
+    glBindVertexArray(chunk->vao);
+    glDrawArrays(GL_TRIANGLES, 0, chunk->uploadedCount);
+  }
+  glBindVertexArray(0);
+}
+
+#define VOXEL_WORLD_SUBMIT_MIN_BATCH 256
+
+typedef struct {
+  const VoxelWorld *world;
+  RenderQueue *queue;
+  unsigned program;
+  const Frustum *frustum;
+  v3 eye;
+} SubmitChunksContext;
+
+// NOTE: Run by the queue with the chunk's VAO bound
+static void drawChunk(void *data) {
+  const VoxelWorldChunk *chunk = (const VoxelWorldChunk *)data;
+  __setIdentityInstance(VOXEL_INSTANCE_COMPACT);
+  __setIdentityInstance(VOXEL_INSTANCE_MATRIX);
+  glDrawArrays(GL_TRIANGLES, 0, chunk->uploadedCount);
+}
+
+static void submitChunksKernel(void *data, unsigned begin, unsigned end) {
+  SubmitChunksContext *context = (SubmitChunksContext *)data;
+  const VoxelWorld *world = context->world;
+  float size = CHUNK * world->voxelSize;
+  v3 extent = v3_make(size, size, size);
+
+  for (unsigned i = begin; i < end; ++i) {
+    VoxelWorldChunk *chunk = &world->chunks[i];
+    if (!chunk->uploadedCount) {
+      continue;
+    }
+
+    v3 min = chunkOrigin(world, i);
+    if (context->frustum &&
+        sfFrustumTestBox(context->frustum, min, v3_add(min, extent)) ==
+            CULL_OUTSIDE) {
+      continue;
+    }
+
+    v3 center = v3_add(min, v3_scale(extent, 0.5f));
+    sfRenderQueueSubmit(context->queue, context->program, world->texture,
+                        chunk->vao, v3_len(v3_sub(center, context->eye)),
+                        drawChunk, chunk);
+  }
+}
+
+// NOTE: Submits every uploaded chunk inside `frustum` (all of them if NULL),
+// keyed front to back from `eye`. Chunks are tested on worker threads, which
+// submit to the queue directly
+void sfVoxelWorldSubmit(RenderQueue *queue, const VoxelWorld *world,
+                        unsigned program, const Frustum *frustum, v3 eye) {
+  SubmitChunksContext context = {world, queue, program, frustum, eye};
+  sfParallelFor(world->chunkCount, VOXEL_WORLD_SUBMIT_MIN_BATCH,
+                submitChunksKernel, &context);
+}
+
+void sfVoxelWorldDestroy(VoxelWorld *world) {
+  pthread_mutex_lock(&world->mutex);
+  world->shouldQuit = 1;
+  pthread_cond_broadcast(&world->cond);
+  pthread_mutex_unlock(&world->mutex);
+
+  for (unsigned i = 0; i < world->workerCount; ++i) {
+    pthread_join(world->workers[i], NULL);
+  }
+  pthread_mutex_destroy(&world->mutex);
+  pthread_cond_destroy(&world->cond);
+
+  for (unsigned i = 0; i < world->chunkCount; ++i) {
+    VoxelWorldChunk *chunk = &world->chunks[i];
+    glDeleteBuffers(1, &chunk->vbo);
+    glDeleteVertexArrays(1, &chunk->vao);
+  }
+}
@@ -1,6 +1,10 @@
 #include "voxels.h"
+#include "parallel.h"
 
-void sfVoxelInitFloorInstances(const Voxels *voxels) {
+#define VOXEL_GATHER_MIN_BATCH 4096
+#define VOXEL_TRANSFORM_MIN_BATCH 4096
+
+void sfVoxelInitFloorInstances(Voxels *voxels, Arena *scratch) {
   int width = 1, height = voxels->count;
   for (int i = 1; i * i <= voxels->count; i++) {
     if (voxels->count % i == 0) {
@@ -11,43 +15,80 @@ void sfVoxelInitFloorInstances(const Voxels *voxels) {
 
   float scaleFactor = 2.0f;
 
-  v3 *positions = calloc(voxels->count, sizeof(v3));
-  if (!positions) {
-    fprintf(stderr, "ERROR: Failed to calloc positions\n");
+  ArenaMarker marker = sfArenaMark(scratch);
+  size_t arraySize = voxels->count * sizeof(float);
+  float *positionsX = (float *)sfArenaAlloc(scratch, arraySize);
+  float *positionsY = (float *)sfArenaAlloc(scratch, arraySize);
+  float *positionsZ = (float *)sfArenaAlloc(scratch, arraySize);
+  float *scales = (float *)sfArenaAlloc(scratch, arraySize);
+  if (!positionsX || !positionsY || !positionsZ || !scales) {
+    sfArenaRestore(scratch, marker);
+    return;
   }
 
   for (int i = 0; i < height; ++i) {
     for (int j = 0; j < width; ++j) {
       unsigned index = width * i + j;
-      positions[index] =
-          (v3){(float)j * scaleFactor, 0.0f, (float)i * scaleFactor};
+      positionsX[index] = (float)j * scaleFactor;
+      positionsY[index] = 0.0f;
+      positionsZ[index] = (float)i * scaleFactor;
+      scales[index] = scaleFactor;
     }
   }
-  for (int i = 0; i < voxels->count; ++i) {
-    m44 model = m44_identity(1.0f);
-    v3 position = positions[i];
+  transform_soa transforms = {positionsX, positionsY, positionsZ, scales};
+  sfUpdateVoxelTransforms(voxels, &transforms);
+
+  sfArenaRestore(scratch, marker);
+}
 
-    float angle = rand_deg();
+static size_t __instanceSize(const Voxels *voxels) {
+  return voxels->format == VOXEL_INSTANCE_COMPACT ? sizeof(VoxelInstance)
+                                                  : sizeof(m44);
+}
 
-    model = translate(&model, position.x, position.y, position.z);
-    model = scale(&model, scaleFactor, scaleFactor, scaleFactor);
-    voxels->transforms[i] = model;
+// NOTE: Points the instance attributes of the bound VAO at `offset` bytes
+// into the bound buffer
+static void __instanceAttributes(const Voxels *voxels, size_t offset) {
+  if (voxels->format == VOXEL_INSTANCE_COMPACT) {
+    glVertexAttribPointer(INSTANCE_COMPACT_LOCATION, 4, GL_FLOAT, GL_FALSE,
+                          sizeof(VoxelInstance), (void *)offset);
+    glEnableVertexAttribArray(INSTANCE_COMPACT_LOCATION);
+    glVertexAttribDivisor(INSTANCE_COMPACT_LOCATION, 1);
+  } else {
+    for (unsigned int i = 0; i < 4; ++i) {
+      glVertexAttribPointer(INSTANCE_TRANSFORM_LOCATION + i, 4, GL_FLOAT,
+                            GL_FALSE, sizeof(m44),
+                            (void *)(offset + sizeof(v4) * i));
+      glEnableVertexAttribArray(INSTANCE_TRANSFORM_LOCATION + i);
+      glVertexAttribDivisor(INSTANCE_TRANSFORM_LOCATION + i, 1);
+    }
   }
+}
 
-  free(positions);
+static void __colorAttribute(size_t offset) {
+  glVertexAttribPointer(INSTANCE_COLOR_LOCATION, 4, GL_UNSIGNED_BYTE, GL_TRUE,
+                        sizeof(uint32_t), (void *)offset);
+  glEnableVertexAttribArray(INSTANCE_COLOR_LOCATION);
+  glVertexAttribDivisor(INSTANCE_COLOR_LOCATION, 1);
 }
 
 void __bufferInstanceData(Voxels *voxels) {
   glBindVertexArray(voxels->vao);
-  glGenBuffers(1, &voxels->transformsVbo);
-  glBindBuffer(GL_ARRAY_BUFFER, voxels->transformsVbo);
-  glBufferData(GL_ARRAY_BUFFER, voxels->count * sizeof(m44), voxels->transforms,
+  glGenBuffers(1, &voxels->instancesVbo);
+  glBindBuffer(GL_ARRAY_BUFFER, voxels->instancesVbo);
+  glBufferData(GL_ARRAY_BUFFER, voxels->count * __instanceSize(voxels),
+               voxels->format == VOXEL_INSTANCE_COMPACT
+                   ? (void *)voxels->instances
+                   : (void *)voxels->transforms,
                GL_DYNAMIC_DRAW);
-  for (unsigned int i = 0; i < 4; ++i) {
-    glVertexAttribPointer(INSTANCE_TRANSFORM_LOCATION + i, 4, GL_FLOAT,
-                          GL_FALSE, sizeof(m44), (void *)(sizeof(v4) * i));
-    glEnableVertexAttribArray(INSTANCE_TRANSFORM_LOCATION + i);
-    glVertexAttribDivisor(INSTANCE_TRANSFORM_LOCATION + i, 1);
+  __instanceAttributes(voxels, 0);
+
+  if (voxels->colors) {
+    glGenBuffers(1, &voxels->colorsVbo);
+    glBindBuffer(GL_ARRAY_BUFFER, voxels->colorsVbo);
+    glBufferData(GL_ARRAY_BUFFER, voxels->count * sizeof(uint32_t),
+                 voxels->colors, GL_DYNAMIC_DRAW);
+    __colorAttribute(0);
   }
 
   glBindVertexArray(0);
@@ -80,35 +121,286 @@ void __initBuffers(Voxels *voxels) {
   __bufferInstanceData(voxels);
 }
 
-void sfDestroyVoxels(Voxels *voxels) { free(voxels->transforms); }
+// NOTE: Releases the GL objects only, the instance arrays belong to the arena
+void sfDestroyVoxels(Voxels *voxels) {
+  glDeleteBuffers(1, &voxels->vbo);
+  glDeleteBuffers(1, &voxels->instancesVbo);
+  if (voxels->colors) {
+    glDeleteBuffers(1, &voxels->colorsVbo);
+  }
+  glDeleteVertexArrays(1, &voxels->vao);
+
+  if (voxels->culler) {
+    sfStreamBufferDestroy(voxels->visibleInstances);
+    if (voxels->visibleColors) {
+      sfStreamBufferDestroy(voxels->visibleColors);
+    }
+    glDeleteVertexArrays(1, &voxels->cullVao);
+  }
+}
+
+// NOTE: Disabled attributes read the context's current generic value, so the
+// unused instance layout is pinned to identity before every draw
+void __setIdentityInstance(VoxelInstanceFormat format) {
+  if (format == VOXEL_INSTANCE_COMPACT) {
+    for (unsigned i = 0; i < 4; ++i) {
+      glVertexAttrib4f(INSTANCE_TRANSFORM_LOCATION + i, i == 0, i == 1, i == 2,
+                       i == 3);
+    }
+  } else {
+    glVertexAttrib4f(INSTANCE_COMPACT_LOCATION, 0.0f, 0.0f, 0.0f, 1.0f);
+  }
+}
 
-void sfRenderVoxels(const Voxels *voxels) {
+static unsigned __voxelsVao(const Voxels *voxels) {
+  return voxels->isCulled ? voxels->cullVao : voxels->vao;
+}
+
+// NOTE: Expects the program, texture and `__voxelsVao` to be bound
+static void __drawVoxels(void *data) {
+  Voxels *voxels = (Voxels *)data;
+  __setIdentityInstance(voxels->format);
+
+  if (voxels->isCulled) {
+    voxels->isCulled = 0;
+    sfStreamBufferEnd(voxels->visibleInstances);
+    if (voxels->visibleColors) {
+      sfStreamBufferEnd(voxels->visibleColors);
+    }
+
+    // NOTE: GL 3.3 has no base instance, so the attributes are re-pointed at
+    // this frame's region instead
+    glBindBuffer(GL_ARRAY_BUFFER, voxels->visibleInstances->vbo);
+    __instanceAttributes(voxels, voxels->visibleInstances->frame *
+                                     voxels->visibleInstances->regionSize);
+    if (voxels->visibleColors) {
+      glBindBuffer(GL_ARRAY_BUFFER, voxels->visibleColors->vbo);
+      __colorAttribute(voxels->visibleColors->frame *
+                       voxels->visibleColors->regionSize);
+    }
+
+    glDrawArraysInstanced(GL_TRIANGLES, 0, VERTEX_COUNT,
+                          voxels->culler->visibleCount);
+
+    sfStreamBufferFence(voxels->visibleInstances);
+    if (voxels->visibleColors) {
+      sfStreamBufferFence(voxels->visibleColors);
+    }
+    return;
+  }
+
+  if (voxels->instancesDirty.count) {
+    glBindBuffer(GL_ARRAY_BUFFER, voxels->instancesVbo);
+    if (voxels->format == VOXEL_INSTANCE_COMPACT) {
+      sfDirtyRangesUpload(&voxels->instancesDirty, GL_ARRAY_BUFFER,
+                          voxels->instances, sizeof(VoxelInstance));
+    } else {
+      sfDirtyRangesUpload(&voxels->instancesDirty, GL_ARRAY_BUFFER,
+                          voxels->transforms, sizeof(m44));
+    }
+  }
+
+  if (voxels->colors && voxels->colorsDirty.count) {
+    glBindBuffer(GL_ARRAY_BUFFER, voxels->colorsVbo);
+    sfDirtyRangesUpload(&voxels->colorsDirty, GL_ARRAY_BUFFER, voxels->colors,
+                        sizeof(uint32_t));
+  }
+
+  glDrawArraysInstanced(GL_TRIANGLES, 0, VERTEX_COUNT, voxels->count);
+}
+
+// NOTE: Draws immediately with the caller's program
+void sfRenderVoxels(Voxels *voxels) {
   if (voxels->texture) {
     glBindTexture(GL_TEXTURE_2D, voxels->texture);
   }
+  glBindVertexArray(__voxelsVao(voxels));
+  __drawVoxels(voxels);
+}
 
-  glBindVertexArray(voxels->vao);
+// NOTE: Culling must happen before submitting, it picks the VAO
+void sfVoxelsSubmit(RenderQueue *queue, Voxels *voxels, unsigned program,
+                    float depth) {
+  sfRenderQueueSubmit(queue, program, voxels->texture, __voxelsVao(voxels),
+                      depth, __drawVoxels, voxels);
+}
 
-  glBindBuffer(GL_ARRAY_BUFFER, voxels->transformsVbo);
-  glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(m44) * voxels->count,
-                  voxels->transforms);
+void sfSetVoxelInstance(Voxels *voxels, unsigned index, v3 position,
+                        float scaleFactor) {
+  sfDirtyRangesMark(&voxels->instancesDirty, index, 1);
+  voxels->areChunksStale = 1;
+  if (voxels->format == VOXEL_INSTANCE_COMPACT) {
+    voxels->instances[index] = (VoxelInstance){position, scaleFactor};
+    return;
+  }
 
-  glDrawArraysInstanced(GL_TRIANGLES, 0, VERTEX_COUNT, voxels->count);
+  transform_soa transform = {&position.x, &position.y, &position.z,
+                             &scaleFactor};
+  voxels->transforms[index] = transform_m44(&transform, 0);
+}
+
+void sfSetVoxelColor(Voxels *voxels, unsigned index, uint32_t color) {
+  voxels->colors[index] = color;
+  sfDirtyRangesMark(&voxels->colorsDirty, index, 1);
+}
+
+void sfVoxelsMarkDirty(Voxels *voxels, unsigned first, unsigned count) {
+  sfDirtyRangesMark(&voxels->instancesDirty, first, count);
+  voxels->areChunksStale = 1;
+}
+
+// NOTE: Culling stays off, and every instance drawn, if `arena` cannot hold
+// the culler
+void sfVoxelsEnableCulling(Arena *arena, Voxels *voxels) {
+  voxels->culler = sfCullerArenaAlloc(arena, voxels->count);
+  if (!voxels->culler) {
+    return;
+  }
+  voxels->chunks = sfVoxelChunksArenaAlloc(arena, voxels->count);
+  voxels->visibleInstances =
+      sfStreamBufferArenaAlloc(arena, voxels->count * __instanceSize(voxels));
+  if (voxels->colors) {
+    voxels->visibleColors =
+        sfStreamBufferArenaAlloc(arena, voxels->count * sizeof(uint32_t));
+  }
+  voxels->areChunksStale = 1;
+
+  glGenVertexArrays(1, &voxels->cullVao);
+  glBindVertexArray(voxels->cullVao);
+  glBindBuffer(GL_ARRAY_BUFFER, voxels->vbo);
+  glEnableVertexAttribArray(VERTEX_POSITION_LOCATION);
+  glVertexAttribPointer(VERTEX_POSITION_LOCATION, 3, GL_FLOAT, GL_FALSE,
+                        5 * sizeof(float), (void *)0);
+  glEnableVertexAttribArray(TEX_COORD_LOCATION);
+  glVertexAttribPointer(TEX_COORD_LOCATION, 2, GL_FLOAT, GL_FALSE,
+                        5 * sizeof(float), (void *)(3 * sizeof(float)));
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
-void sfUpdateVoxelTransforms(Voxels *voxels, const v3 *positions) {
-  for (int i = 0; i < voxels->count; ++i) {
-    voxels->transforms[i] = m44_identity(1.0f);
-    const v3 *position = &positions[i];
-    voxels->transforms[i] = translate(&voxels->transforms[i], position->x,
-                                      position->y, position->z);
+// NOTE: Bounding sphere of the unit cube under the instance transform
+static void __voxelBounds(const Voxels *voxels, unsigned index, v3 *center,
+                          float *radius) {
+  const float halfDiagonal = 0.8660254f;
+  if (voxels->format == VOXEL_INSTANCE_COMPACT) {
+    *center = voxels->instances[index].position;
+    *radius = voxels->instances[index].scale * halfDiagonal;
+    return;
+  }
+
+  // NOTE: Corners are sums of half the (possibly rotated and sheared) axes
+  const m44 *model = &voxels->transforms[index];
+  *center = v3_make(model->dx, model->dy, model->dz);
+  float axes = 0.0f;
+  for (int i = 0; i < 3; ++i) {
+    const v4 *row = &model->v[i];
+    axes += sqrtf(row->x * row->x + row->y * row->y + row->z * row->z);
   }
+  *radius = axes * 0.5f;
 }
 
-Voxels *sfVoxelsArenaAlloc(Arena *arena, unsigned count) {
+typedef struct {
+  const Voxels *voxels;
+  unsigned char *instances;
+  uint32_t *colors;
+} GatherVisibleContext;
+
+static void __gatherVisibleKernel(void *context, unsigned begin,
+                                  unsigned end) {
+  GatherVisibleContext *ctx = (GatherVisibleContext *)context;
+  const Voxels *voxels = ctx->voxels;
+  const unsigned *visible = voxels->culler->visible;
+  size_t instanceSize = __instanceSize(voxels);
+  const unsigned char *source =
+      voxels->format == VOXEL_INSTANCE_COMPACT
+          ? (const unsigned char *)voxels->instances
+          : (const unsigned char *)voxels->transforms;
+
+  for (unsigned i = begin; i < end; ++i) {
+    memcpy(ctx->instances + i * instanceSize,
+           source + visible[i] * instanceSize, instanceSize);
+    if (ctx->colors) {
+      ctx->colors[i] = voxels->colors[visible[i]];
+    }
+  }
+}
+
+// NOTE: Writes the visible instances into this frame's stream regions, the
+// next `sfRenderVoxels` draws only those
+unsigned sfCullVoxels(Voxels *voxels, const Frustum *frustum) {
+  if (voxels->areChunksStale) {
+    for (unsigned i = 0; i < voxels->count; ++i) {
+      __voxelBounds(voxels, i, &voxels->chunks->centers[i],
+                    &voxels->chunks->radii[i]);
+    }
+    sfVoxelChunksBuild(voxels->chunks, voxels->count);
+    voxels->areChunksStale = 0;
+  }
+
+  unsigned visibleCount = sfCullVoxelChunks(voxels->culler, voxels->chunks,
+                                            frustum);
+
+  GatherVisibleContext context = {voxels, NULL, NULL};
+  context.instances =
+      (unsigned char *)sfStreamBufferBegin(voxels->visibleInstances);
+  if (voxels->visibleColors) {
+    context.colors = (uint32_t *)sfStreamBufferBegin(voxels->visibleColors);
+  }
+  sfParallelFor(visibleCount, VOXEL_GATHER_MIN_BATCH, __gatherVisibleKernel,
+                &context);
+
+  voxels->isCulled = 1;
+  return visibleCount;
+}
+
+typedef struct {
+  Voxels *voxels;
+  const transform_soa *transforms;
+} TransformContext;
+
+static void __transformKernel(void *context, unsigned begin, unsigned end) {
+  TransformContext *ctx = (TransformContext *)context;
+  Voxels *voxels = ctx->voxels;
+  if (voxels->format == VOXEL_INSTANCE_COMPACT) {
+    v4_batch_instances((float *)voxels->instances, ctx->transforms, begin,
+                       end);
+  } else {
+    m44_batch_transforms(voxels->transforms, ctx->transforms, begin, end);
+  }
+}
+
+// NOTE: Rewrites every instance from `transforms`, compact instances drop
+// the rotation
+void sfUpdateVoxelTransforms(Voxels *voxels,
+                             const transform_soa *transforms) {
+  TransformContext context = {voxels, transforms};
+  sfParallelFor(voxels->count, VOXEL_TRANSFORM_MIN_BATCH, __transformKernel,
+                &context);
+  sfVoxelsMarkDirty(voxels, 0, voxels->count);
+}
+
+Voxels *sfVoxelsArenaAllocFormat(Arena *arena, unsigned count,
+                                 VoxelInstanceFormat format,
+                                 unsigned char hasColors) {
   Voxels *voxels = (Voxels *)sfArenaAlloc(arena, sizeof(Voxels));
+  memset(voxels, 0, sizeof(Voxels));
+  voxels->areChunksStale = 1;
   voxels->count = count;
-  voxels->transforms = (m44 *)sfArenaAlloc(arena, sizeof(m44) * count);
+  voxels->format = format;
+  if (format == VOXEL_INSTANCE_COMPACT) {
+    voxels->instances =
+        (VoxelInstance *)sfArenaAlloc(arena, sizeof(VoxelInstance) * count);
+  } else {
+    voxels->transforms = (m44 *)sfArenaAlloc(arena, sizeof(m44) * count);
+  }
+  if (hasColors) {
+    voxels->colors = (uint32_t *)sfArenaAlloc(arena, sizeof(uint32_t) * count);
+    memset(voxels->colors, 0xff, sizeof(uint32_t) * count);
+  }
   __initBuffers(voxels);
   return voxels;
 }
+
+Voxels *sfVoxelsArenaAlloc(Arena *arena, unsigned count) {
+  return sfVoxelsArenaAllocFormat(arena, count, VOXEL_INSTANCE_COMPACT, 0);
+}